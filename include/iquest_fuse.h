@@ -75,9 +75,48 @@
 #define IQF_DEFAULT_SLASH_REMAP "\\"
 #define IQF_PATH_SEP            "/"
 
+/*
+ * Inode numbers are derived from what identifies an object in iRODS, so
+ * that the same object always has the same inode, across lookups, cache
+ * reloads and mounts.  The top bits of an inode say which namespace the
+ * rest comes from.
+ */
+#define IQF_INO_NS_SHIFT	60
+#define IQF_INO_NS_DATA_OBJ	1ULL	/* DATA_ID */
+#define IQF_INO_NS_COLL		2ULL	/* hash of the collection path (listings have no COLL_ID) */
+#define IQF_INO_NS_VIRTUAL	3ULL	/* hash of the mounted path (query directories) */
+#define IQF_INO(ns, id)		((ino_t) (((ns) << IQF_INO_NS_SHIFT) | \
+					  ((uint64_t) (id) & ((1ULL << IQF_INO_NS_SHIFT) - 1))))
+
 #define IQF_CONN_TIMEOUT	120	/* 2 min connection timeout */
-#define IQF_CONN_MANAGER_SLEEP_TIME 60
-#define IQF_CONN_REQ_SLEEP_TIME 30
+
+/* iRODS connections kept open however idle, and the most ever opened (at
+ * most IQF_CONN_POOL_CEILING, to be kind to the server) */
+#define IQF_DEFAULT_CONN_POOL_MIN	1
+#define IQF_DEFAULT_CONN_POOL_MAX	10
+#define IQF_CONN_POOL_CEILING		128
+/* classes of iRODS connection, each with its own pool, so that streaming
+ * data cannot hold every connection while someone waits to list a
+ * directory */
+#define IQF_CONN_CATALOG	0	/* stats, listings and queries */
+#define IQF_CONN_BULK		1	/* open data objects: reads and gets */
+#define IQF_NUM_CONN_CLASSES	2
+#define IQF_DEFAULT_BULK_CONN_POOL_MIN	0
+#define IQF_DEFAULT_BULK_CONN_POOL_MAX	10
+/* secs a request waits for a connection before failing (0 for ever) */
+#define IQF_DEFAULT_CONN_WAIT_TIMEOUT	60
+
+/* concurrent stat misses in one collection are gathered for this long
+ * (msecs) and looked up together, up to this many names (and this much
+ * query condition) at a time */
+#define IQF_DEFAULT_STAT_BATCH_WINDOW	2
+#define IQF_STAT_BATCH_MAX_NAMES	64
+#define IQF_STAT_BATCH_MAX_COND_LEN	4000
+
+/* kernel cache timeouts derived from our own are capped at this, since
+ * invalidating our caches does not reach the kernel */
+#define IQF_MAX_DERIVED_KERNEL_TIMEOUT	60
+#define IQF_CONN_MANAGER_SLEEP_TIME 1	/* secs between connection pool adjustments */
 
 /* 
  * iquestFuse Types
@@ -95,18 +134,40 @@ typedef struct iquest_fuse_conf {
   int require_conn; /* >0 if an iRODS connection is required at startup */
   int show_indicator; /* >0 if we should include the query indicator in directory listings */
   int debug_level; 
+  unsigned int cache_ttl; /* seconds before a cached stat expires */
+  unsigned int neg_cache_ttl; /* seconds before a cached non-existent path expires */
+  unsigned long cache_max_entries; /* bound on the number of cached stats (0 for none) */
+  unsigned long cache_max_bytes; /* bound on memory used by cached stats (0 for none) */
+  char *cache_file; /* file to keep cached stats in across mounts (NULL for none) */
+  unsigned int list_cache_ttl; /* seconds before a cached directory listing expires */
+  unsigned long list_cache_max_bytes; /* bound on memory used by cached listings (0 for none) */
+  unsigned int list_cache_rescan; /* seconds between full listings of a collection (0 to always list in full) */
+  unsigned long query_cache_max_bytes; /* bound on memory used by cached query results (0 for none) */
+  double entry_timeout; /* seconds the kernel caches name lookups (<0 to derive from cache_ttl) */
+  double attr_timeout; /* seconds the kernel caches attributes (<0 to derive from cache_ttl) */
+  double negative_timeout; /* seconds the kernel caches failed lookups (<0 to derive from neg_cache_ttl) */
+  unsigned int stat_batch_window; /* msecs to gather concurrent stat misses in a collection for one query (0 for none) */
+  unsigned int conn_pool_min; /* catalog connections kept open however idle */
+  unsigned int conn_pool_max; /* most catalog connections open at once */
+  unsigned int conn_pool_warm; /* catalog connections to open at mount (and keep open) */
+  unsigned int bulk_conn_pool_min; /* data connections kept open however idle */
+  unsigned int bulk_conn_pool_max; /* most data connections open at once */
+  unsigned int conn_wait_timeout; /* secs a request waits for a connection (0 for ever) */
+  unsigned long read_ahead_max_bytes; /* most to read ahead of a file being read sequentially (0 for none) */
+  unsigned long block_cache_max_bytes; /* bound on memory used by cached file data (0 for no caching) */
 } iquest_fuse_conf_t;
 
 
 typedef struct iquest_fuse_irods_conn {
   rcComm_t *conn;    //TODO change to rcComm
-  pthread_mutex_t lock;
+  pthread_mutex_t lock; /* held by whoever is talking over conn */
   time_t actTime;
-  int inuseCnt;
-  int pendingCnt;
-  int status;
+  time_t checkTime; /* when last found to work */
+  int state; /* CONN_POOL_* state word, updated atomically */
+  int slot; /* index in the pool */
+  unsigned int nextFree; /* slot + 1 of the next connection on the same pool stack */
+  struct ConnPool *pool;
   struct iquest_fuse *iqf;
-  struct iquest_fuse_irods_conn *next;
 } iquest_fuse_irods_conn_t;
 
 /* 
@@ -116,7 +177,7 @@ typedef struct iquest_fuse_irods_conn {
 typedef struct iquest_fuse {
   iquest_fuse_conf_t *conf;
   //iquest_fuse_irods_conn_t *irods_conn;
-  iquest_fuse_irods_conn_t *irods_conn_head;
+  struct ConnPool *conn_pool[IQF_NUM_CONN_CLASSES]; /* indexed by IQF_CONN_* */
   rodsEnv *rods_env;
 } iquest_fuse_t;
 
@@ -0,0 +1,82 @@
+/*****************************************************************************
+ * Copyright (c) 2012 Genome Research Ltd.
+ *
+ * Author: Joshua C. Randall <jcrandall@alum.mit.edu>
+ *
+ * This file is part of iquestFuse.
+ *
+ * iquestFuse is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Declarations for the iquestFuse block cache.
+ *
+ * File data read from iRODS is kept in fixed-size blocks, keyed by the
+ * object (its path, size and modification time, so a rewritten object is
+ * a different key) and block number, and shared by every descriptor in the
+ * process.  A block that is missing is fetched by the first reader to ask
+ * for it; anyone else asking meanwhile waits for that fetch rather than
+ * starting another.
+ *****************************************************************************/
+#ifndef IQUEST_FUSE_BLOCK_CACHE_H
+#define IQUEST_FUSE_BLOCK_CACHE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "rodsClient.h"
+
+#define BLOCK_CACHE_BLOCK_SIZE		(1024*1024)	/* 1 mb */
+#define BLOCK_CACHE_DEFAULT_MAX_BYTES	(256*1024*1024)	/* 256 mb */
+#define BLOCK_CACHE_MIN_SLOTS		64	/* must be a power of 2 */
+
+/* cacheBlock states */
+#define CACHE_BLOCK_FETCHING	0
+#define CACHE_BLOCK_READY	1
+#define CACHE_BLOCK_FAILED	2
+
+typedef struct CacheBlock {
+    char *key;			/* of the object */
+    rodsLong_t blockNum;
+    uint64_t hash;		/* of key and blockNum */
+    int state;			/* CACHE_BLOCK_*, under the table lock */
+    int refCnt;			/* updated atomically */
+    size_t len;			/* bytes in data, short only at the end of the object */
+    char *data;
+    size_t allocSize;		/* bytes charged against the cache budget */
+    struct CacheBlock *next;	/* hash chain */
+    struct CacheBlock *lruPrev;	/* only ready blocks are on the lru list */
+    struct CacheBlock *lruNext;
+} cacheBlock_t;
+
+typedef struct BlockCacheTable {
+    pthread_mutex_t lock;
+    pthread_cond_t fetchDone;	/* broadcast whenever a fetch finishes */
+    size_t blockSize;
+    unsigned long maxBytes;	/* 0 means no caching at all */
+    unsigned long numBytes;
+    unsigned long numBlocks;
+    unsigned int numSlots;	/* always a power of 2 */
+    cacheBlock_t **slot;
+    cacheBlock_t lru;		/* sentinel: lru.lruNext is most recently used */
+} blockCacheTable_t;
+
+
+int initBlockCacheTable(blockCacheTable_t *table, size_t blockSize, unsigned long maxBytes);
+cacheBlock_t *getBlockFromCache(blockCacheTable_t *table, const char *key, rodsLong_t blockNum, int *out_fetch);
+void blockFetched(blockCacheTable_t *table, cacheBlock_t *block, int status);
+void releaseBlock(cacheBlock_t *block);
+
+#endif	/* IQUEST_FUSE_BLOCK_CACHE_H */
@@ -0,0 +1,170 @@
+/*****************************************************************************
+ * Copyright (c) 2012 Genome Research Ltd.
+ *
+ * Author: Joshua C. Randall <jcrandall@alum.mit.edu>
+ *
+ * This file is part of iquestFuse.
+ *
+ * iquestFuse is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Declarations for the iquestFuse path (stat) cache.
+ *****************************************************************************/
+#ifndef IQUEST_FUSE_CACHE_H
+#define IQUEST_FUSE_CACHE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/*
+ * The path cache is split into NUM_PATH_CACHE_SHARD independently locked
+ * shards, each of which is an open-addressing (linear probing) hash table
+ * that doubles in size when it gets too full.
+ */
+#define NUM_PATH_CACHE_SHARD_BITS	6
+#define NUM_PATH_CACHE_SHARD		(1 << NUM_PATH_CACHE_SHARD_BITS)
+#define PATH_CACHE_SHARD_INIT_SLOTS	64	/* must be a power of 2 */
+#define PATH_CACHE_MAX_LOAD_PCT		70	/* grow (or rehash) above this load */
+#define CACHE_EXPIRE_TIME	600	/* 10 minutes before expiration */
+
+/*
+ * Default bounds on the size of PathArray.  NonExistPathArray gets a quarter
+ * of whatever is configured for PathArray.  When a bound is exceeded, entries
+ * are evicted (CLOCK second-chance order) until the table is back under
+ * PATH_CACHE_LOW_WATER_PCT of the bound.
+ */
+#define PATH_CACHE_DEFAULT_MAX_ENTRIES	500000
+#define PATH_CACHE_DEFAULT_MAX_BYTES	(128*1024*1024)	/* 128 mb */
+#define PATH_CACHE_LOW_WATER_PCT	90
+
+/*
+ * Expiry, eviction and freeing of entries is done by a maintenance thread,
+ * which wakes up every PATH_CACHE_MANAGER_SLEEP_TIME seconds or as soon as a
+ * table goes over its budget.
+ */
+#define PATH_CACHE_MANAGER_SLEEP_TIME	30
+#define PATH_CACHE_EXPIRE_BATCH		512	/* slots scanned per shard lock */
+#define MAX_MANAGED_PATH_CACHE		4
+#define PATH_CACHE_RETIRE_HIGH_WATER	4096	/* wake the manager to reclaim */
+
+/* which table a cache file record belongs to (see iquest_fuse_cache_file.h) */
+#define PATH_CACHE_FILE_NONE		0
+#define PATH_CACHE_FILE_STAT		1
+#define PATH_CACHE_FILE_NONEXIST	2
+
+typedef enum {
+    NO_FILE_CACHE,
+    HAVE_READ_CACHE,
+    HAVE_NEWLY_CREATED_CACHE,
+} readCacheState_t;
+
+typedef struct PathCache {
+    char* filePath;	/* points into the same allocation as the entry */
+    char* locCachePath;
+    struct stat stbuf;
+    uint cachedTime;
+    uint64_t hash;
+    unsigned int allocSize;	/* bytes charged against the cache budget */
+    int referenced;		/* CLOCK reference bit, set on every hit */
+    readCacheState_t locCacheState;
+    unsigned long retireEpoch;	/* epoch in which it was unlinked */
+    struct PathCache *next;	/* only used on eviction and retire lists */
+} pathCache_t;
+
+typedef struct PathCacheSlots {
+    unsigned int numSlots;	/* always a power of 2 */
+    unsigned long retireEpoch;
+    struct PathCacheSlots *next;
+    pathCache_t *slot[];	/* NULL (never used), tombstone or entry */
+} pathCacheSlots_t;
+
+typedef struct PathCacheShard {
+    pthread_mutex_t lock;	/* taken by writers only */
+    pathCacheSlots_t *slots;	/* replaced (not modified) on resize */
+    unsigned int numUsed;	/* live entries */
+    unsigned int numDeleted;	/* tombstones */
+} pathCacheShard_t;
+
+/* per-thread record of the epoch a lock-free reader is in */
+typedef struct PathCacheReader {
+    unsigned long epoch;	/* 0 when not in a read-side critical section */
+    int depth;
+    int inuse;
+    struct PathCacheReader *next;
+} pathCacheReader_t;
+
+typedef struct PathCacheTable {
+    const char *name;
+    uint ttl;			/* seconds before an entry expires */
+    unsigned long maxEntries;	/* 0 means unbounded */
+    unsigned long maxBytes;	/* 0 means unbounded */
+    unsigned long numEntries;	/* updated atomically */
+    unsigned long numBytes;	/* updated atomically */
+    pthread_mutex_t clockLock;	/* serializes evictors */
+    unsigned int clockShard;	/* CLOCK hand: shard ... */
+    unsigned int clockSlot;	/* ... and slot within it */
+    int persistId;		/* PATH_CACHE_FILE_* if kept in the cache file */
+    pathCacheShard_t shard[NUM_PATH_CACHE_SHARD];
+} pathCacheTable_t;
+
+
+uint64_t iquest_path_hash(const char *path);
+int initPathCacheTable(pathCacheTable_t *table, const char *name, uint ttl, unsigned long maxEntries, unsigned long maxBytes);
+int pathCacheOverBudget(pathCacheTable_t *table);
+int evictPathCache(pathCacheTable_t *table, pathCache_t **victims);
+int expirePathCache(pathCacheTable_t *table, pathCache_t **victims);
+int retirePathCacheList(pathCache_t *victims);
+void pathCacheReadLock();
+void pathCacheReadUnlock();
+int managePathCache(pathCacheTable_t *table);
+int signalPathCacheManager();
+int startPathCacheManager();
+int
+matchPathInPathCache (char *inPath, pathCacheTable_t *table,
+pathCache_t **outPathCache);
+int
+addPathToCache (char *inPath, pathCacheTable_t *table,
+struct stat *stbuf, pathCache_t **outPathCache);
+int
+_addPathToCache (char *inPath, pathCacheTable_t *table,
+struct stat *stbuf, uint cachedTime, pathCache_t **outPathCache);
+int
+getPathCacheStat (char *inPath, pathCacheTable_t *table, struct stat *stbuf);
+int
+getPathCacheFile (char *inPath, pathCacheTable_t *table, struct stat *stbuf,
+char *locCachePath);
+int
+_addPathToCacheWithFile (char *inPath, pathCacheTable_t *table,
+struct stat *stbuf, uint cachedTime, char *locCachePath,
+readCacheState_t locCacheState, int replaceFile);
+int
+setPathCacheSize (char *inPath, pathCacheTable_t *table, off_t size);
+int
+takePathCacheFile (char *inPath, pathCacheTable_t *table,
+char **outLocCachePath);
+int addChildPathsToCache(pathCacheTable_t *table, const char *parent, unsigned int numNames, char **names, struct stat *stbufs, int replace);
+int
+rmPathFromCache (char *inPath, pathCacheTable_t *table);
+int
+_rmPathFromCache (char *inPath, pathCacheTable_t *table);
+int walkPathCache(pathCacheTable_t *table, int (*func)(pathCache_t *entry, void *arg), void *arg);
+int
+freePathCache (pathCache_t *tmpPathCache);
+int
+freeFileCache (pathCache_t *tmpPathCache);
+
+#endif	/* IQUEST_FUSE_CACHE_H */
@@ -0,0 +1,93 @@
+/*****************************************************************************
+ * Copyright (c) 2012 Genome Research Ltd.
+ *
+ * Author: Joshua C. Randall <jcrandall@alum.mit.edu>
+ *
+ * This file is part of iquestFuse.
+ *
+ * iquestFuse is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Declarations for the persistent path cache file.
+ *
+ * The cache file is a header followed by a log of fixed-layout records,
+ * each of which adds or removes one path in PathArray or NonExistPathArray.
+ * It is memory-mapped and replayed at startup, appended to by the cache
+ * manager thread while mounted, and rewritten (compacted) from the live
+ * tables when it has grown too far beyond them.
+ *****************************************************************************/
+#ifndef IQUEST_FUSE_CACHE_FILE_H
+#define IQUEST_FUSE_CACHE_FILE_H
+
+#include <stdint.h>
+
+#include "iquest_fuse.h"
+#include "iquest_fuse_cache.h"
+
+#define PATH_CACHE_FILE_MAGIC		"IQFPCF\r\n"
+#define PATH_CACHE_FILE_VERSION		2	/* 2: stable inode numbers */
+
+/*
+ * records appended since the last flush are kept in memory; beyond
+ * PATH_CACHE_FILE_MAX_PENDING they are dropped and the file is compacted
+ * (rewritten from the tables) instead
+ */
+#define PATH_CACHE_FILE_SIGNAL_PENDING	(1024*1024)	/* wake the manager */
+#define PATH_CACHE_FILE_MAX_PENDING	(16*1024*1024)
+
+/* compact when the file is more than twice as big as it was after the last
+ * compaction (plus some slack) */
+#define PATH_CACHE_FILE_COMPACT_SLACK	(8*1024*1024)
+
+/* records from the future (beyond some clock skew) are not trusted */
+#define PATH_CACHE_FILE_MAX_SKEW	60
+
+#define PATH_CACHE_REC_ADD	1
+#define PATH_CACHE_REC_RM	2
+
+typedef struct PathCacheFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t confHash;		/* mount this cache is valid for */
+    uint32_t createdTime;
+    uint32_t pad;
+} pathCacheFileHeader_t;
+
+/* followed by the NUL-terminated path, padded to a multiple of 8 bytes */
+typedef struct PathCacheFileRecord {
+    uint32_t recSize;		/* including the path and padding */
+    uint32_t check;		/* hash of the rest of the record */
+    uint8_t op;			/* PATH_CACHE_REC_* */
+    uint8_t table;		/* PATH_CACHE_FILE_STAT or _NONEXIST */
+    uint16_t pathLen;
+    uint32_t cachedTime;
+    uint64_t ino;
+    uint64_t size;
+    uint32_t mode;
+    uint32_t nlink;
+    uint32_t atime;
+    uint32_t mtime;
+    uint32_t ctime;
+    uint32_t pad;
+} pathCacheFileRecord_t;
+
+int openPathCacheFile(iquest_fuse_t *iqf, pathCacheTable_t *statTable, pathCacheTable_t *nonExistTable);
+int logPathCacheAdd(pathCacheTable_t *table, const char *path, struct stat *stbuf, uint cachedTime);
+int logPathCacheRm(pathCacheTable_t *table, const char *path);
+int syncPathCacheFile();
+int closePathCacheFile();
+
+#endif	/* IQUEST_FUSE_CACHE_FILE_H */
@@ -0,0 +1,126 @@
+/*****************************************************************************
+ * Copyright (c) 2012 Genome Research Ltd.
+ *
+ * Author: Joshua C. Randall <jcrandall@alum.mit.edu>
+ *
+ * This file is part of iquestFuse.
+ *
+ * iquestFuse is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+/*****************************************************************************
+ * Declarations for the iquestFuse iRODS connection pool.
+ *
+ * The pool is a fixed number of connection slots.  Idle connections sit on
+ * a lock-free stack, as do slots with no connection, so taking or giving
+ * back a connection is a single compare-and-swap.  Each connection has a
+ * state word counting the callers using it and the open descriptors bound
+ * to it; whoever drops it to zero puts the connection back on a stack.
+ * There is a pool for each class of connection (see IQF_CONN_CATALOG).
+ *
+ * How many slots may be connected at once (the limit) is adapted by the
+ * conn manager between the pool's minimum and its capacity: raised when
+ * callers spend time waiting for a connection, lowered when connections
+ * sit idle.
+ *
+ * The conn manager also probes connections that have been idle for a
+ * while, and all idle connections when one has been found broken, so that
+ * they are replaced before a request gets them.  After a failed attempt to
+ * connect, the pool backs off (with jitter) and lets only one caller at a
+ * time try again.
+ *****************************************************************************/
+#ifndef IQUEST_FUSE_CONN_POOL_H
+#define IQUEST_FUSE_CONN_POOL_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "iquest_fuse.h"
+
+/* the state word of a connection */
+#define CONN_POOL_IDLE		0x40000000	/* on a pool stack */
+#define CONN_POOL_DESC_ONE	0x00010000	/* one open descriptor bound to it */
+#define CONN_POOL_DESC_MASK	0x3fff0000
+#define CONN_POOL_BUSY_MASK	0x0000ffff	/* callers using it (or waiting for its lock) */
+
+/* raise the limit when callers waited this long (usecs, in total) since
+ * the last adjustment, or are waiting now */
+#define CONN_POOL_GROW_WAIT_USECS	10000
+/* lower it by one when there have been idle connections and nobody
+ * waiting for this long (secs) */
+#define CONN_POOL_SHRINK_DELAY		10
+/* probe idle connections that have not been known to work for this long
+ * (secs) */
+#define CONN_POOL_PROBE_INTERVAL	30
+/* bounds on the wait (secs) between attempts to connect after one fails */
+#define CONN_POOL_MIN_BACKOFF		1
+#define CONN_POOL_MAX_BACKOFF		60
+/* what ifuseConnect returns instead of trying while backing off (iRODS
+ * error codes are all -1000 or below) */
+#define CONN_POOL_BACKING_OFF		(-2)
+
+/* a stack top is an ABA tag in the high 32 bits and slot + 1 in the low */
+#define CONN_POOL_TOP_SLOT(top)	((unsigned int) ((top) & 0xffffffff))
+
+typedef struct ConnWaiter {
+    pthread_cond_t cond;
+    iquest_fuse_irods_conn_t *conn;	/* handed over by whoever gave it back */
+    struct ConnWaiter *next;
+} connWaiter_t;
+
+typedef struct ConnPool {
+    iquest_fuse_t *iqf;
+    const char *name;
+    int capacity;		/* maximum number of connections */
+    int minConns;		/* never disconnected below this */
+    int limit;			/* connections allowed at the moment */
+    iquest_fuse_irods_conn_t *conn;	/* capacity slots */
+    iquest_fuse_irods_conn_t **reap;	/* scratch space for manageConnPool */
+    iquest_fuse_irods_conn_t **probe;	/* and more */
+    uint64_t idleTop;		/* stack of idle connections */
+    uint64_t emptyTop;		/* stack of slots with no connection */
+    int numConns;		/* slots not on the empty stack */
+    int numWaiting;		/* callers queued for a connection */
+    unsigned long numWaits;	/* acquires that had to wait */
+    unsigned long waitUsecs;	/* how long they waited in total */
+    unsigned long lastWaitUsecs;	/* waitUsecs at the last adjustment */
+    time_t idleSince;		/* since when there have been idle connections */
+    int suspect;		/* a connection was found broken: probe the rest */
+    int backoff;		/* secs to wait after the last failed connect */
+    time_t retryTime;		/* when to try connecting again (0 if no failure) */
+    /* probes an idle connection, reconnecting it if need be; returns 0 if
+     * it is good to use */
+    int (*checkConn)(iquest_fuse_irods_conn_t *conn);
+    pthread_mutex_t waitLock;
+    connWaiter_t *waitHead;	/* queue of callers waiting, oldest first */
+    connWaiter_t *waitTail;
+} connPool_t;
+
+connPool_t *newConnPool(iquest_fuse_t *iqf, const char *name, int minConns, int capacity, int (*checkConn)(iquest_fuse_irods_conn_t *conn));
+iquest_fuse_irods_conn_t *acquireConn(connPool_t *pool, unsigned int timeout);
+iquest_fuse_irods_conn_t *tryAcquireSpareConn(connPool_t *pool);
+int connPoolWaiting(connPool_t *pool);
+void holdConn(iquest_fuse_irods_conn_t *conn);
+int releaseConn(iquest_fuse_irods_conn_t *conn);
+void bindConnDesc(iquest_fuse_irods_conn_t *conn);
+int unbindConnDesc(iquest_fuse_irods_conn_t *conn);
+int countConnPool(connPool_t *pool);
+int connPoolLimit(connPool_t *pool);
+int manageConnPool(connPool_t *pool, time_t idleTimeout);
+void suspectConnPool(connPool_t *pool);
+int mayConnect(connPool_t *pool);
+void connectDone(connPool_t *pool, int ok);
+int disconnectConnPool(connPool_t *pool);
+
+#endif	/* IQUEST_FUSE_CONN_POOL_H */
@@ -0,0 +1,64 @@
+/*****************************************************************************
+ * Copyright (c) 2012 Genome Research Ltd.
+ *
+ * Author: Joshua C. Randall <jcrandall@alum.mit.edu>
+ *
+ * This file is part of iquestFuse.
+ *
+ * iquestFuse is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+/*****************************************************************************
+ * Declarations for the iquestFuse in-flight request table.
+ *
+ * Catalog requests that are already being made (the stat of a path, the
+ * listing of a collection, the values of an attribute under some query
+ * conditions, ...) are registered under a key naming the operation and its
+ * arguments.  Anyone wanting the same thing meanwhile waits for the first
+ * caller's result instead of making the request again.
+ *****************************************************************************/
+#ifndef IQUEST_FUSE_IN_FLIGHT_H
+#define IQUEST_FUSE_IN_FLIGHT_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "iquest_fuse_list_cache.h"
+
+#define IN_FLIGHT_SLOTS		64	/* must be a power of 2 */
+
+typedef struct InFlight {
+    char *key;
+    uint64_t hash;		/* of key */
+    int done;
+    int numWaiters;		/* callers waiting for the result */
+    int status;			/* the result */
+    struct stat stbuf;
+    nameList_t *list;		/* not referenced by the entry itself */
+    struct InFlight *next;	/* hash chain */
+} inFlight_t;
+
+typedef struct InFlightTable {
+    const char *name;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;	/* broadcast whenever a request finishes */
+    inFlight_t *slot[IN_FLIGHT_SLOTS];
+} inFlightTable_t;
+
+int initInFlightTable(inFlightTable_t *table, const char *name);
+int joinInFlight(inFlightTable_t *table, const char *key, inFlight_t **out_flight, int *out_status, struct stat *out_stbuf, nameList_t **out_list);
+void finishInFlight(inFlightTable_t *table, inFlight_t *flight, int status, struct stat *stbuf, nameList_t *list);
+
+#endif	/* IQUEST_FUSE_IN_FLIGHT_H */
@@ -42,6 +42,13 @@
 #include "rodsClient.h"
 #include "rodsPath.h"
 
+#include "iquest_fuse_cache.h"
+#include "iquest_fuse_list_cache.h"
+#include "iquest_fuse_query_cache.h"
+#include "iquest_fuse_in_flight.h"
+#include "iquest_fuse_conn_pool.h"
+#include "iquest_fuse_block_cache.h"
+
 #define CACHE_FUSE_PATH         1
 #ifdef CACHE_FUSE_PATH
 #define CACHE_FILE_FOR_READ     1
@@ -49,11 +56,18 @@
 #endif
 
 #define MAX_BUF_CACHE   2
-#define MAX_IFUSE_DESC   512
+/* 
+ * the descriptor table grows a chunk at a time, up to MAX_IFUSE_DESC.
+ * fuse file handles carry a generation in the high 32 bits, so that a
+ * handle to a freed (and maybe reused) descriptor is rejected
+ */
+#define IFUSE_DESC_CHUNK_BITS	8
+#define IFUSE_DESC_CHUNK_SIZE	(1 << IFUSE_DESC_CHUNK_BITS)
+#define MAX_IFUSE_DESC   (64*1024)
+#define NUM_IFUSE_DESC_CHUNKS	(MAX_IFUSE_DESC / IFUSE_DESC_CHUNK_SIZE)
+#define DESC_PATH_INDEX_SLOTS	1024	/* must be a power of 2 */
 #define MAX_READ_CACHE_SIZE   (1024*1024)	/* 1 mb */
 #define MAX_NEWLY_CREATED_CACHE_SIZE   (4*1024*1024)	/* 4 mb */
-#define HIGH_NUM_CONN	5	/* high water mark */
-#define MAX_NUM_CONN	10
 
 #define NUM_NEWLY_CREATED_SLOT	5
 #define MAX_NEWLY_CREATED_TIME	5	/* in sec */
@@ -64,24 +78,18 @@
 #define IRODS_INUSE	1 
 
 
+/* bufCache states */
+#define BUF_CACHE_EMPTY		0
+#define BUF_CACHE_FILLING	1	/* a read-ahead is reading into it */
+#define BUF_CACHE_READY		2
+
 typedef struct BufCache {
     rodsLong_t beginOffset;
-    rodsLong_t endOffset;
+    rodsLong_t endOffset;	/* while filling, where it will end if not at eof */
     void *buf;
-} bufCache_t;
-
-typedef enum { 
-    NO_FILE_CACHE,
-    HAVE_READ_CACHE,
-    HAVE_NEWLY_CREATED_CACHE,
-} readCacheState_t;
-
-typedef struct ConnReqWait {
-    pthread_mutex_t mutex;
-    pthread_cond_t cond;
+    size_t bufSize;
     int state;
-    struct ConnReqWait *next;
-} connReqWait_t;
+} bufCache_t;
 
 typedef struct IFuseDesc {
   iquest_fuse_irods_conn_t *irods_conn;    
@@ -95,28 +103,38 @@ typedef struct IFuseDesc {
   rodsLong_t bytesWritten;
   char *objPath;
   char *localPath;
+  uint64_t pathHash;	/* of localPath */
+  int pathNext;		/* next descInx in the path index chain (0 ends it) */
+  int pathLinked;	/* in the path index */
+  int nextFree;		/* next descInx on the free list (0 ends it) */
+  unsigned int gen;	/* bumped each time the descriptor is freed */
   readCacheState_t locCacheState;
+  char *blockKey;	/* the object's key in ObjBlockCache (NULL if not read through it) */
+  rodsLong_t objSize;	/* when blockKey was made */
   pthread_mutex_t lock;
+  /* read-ahead (see iquest_fuse_read_ahead.h), all under lock */
+  rodsLong_t raNextOffset;	/* where a sequential read would start */
+  int raSeqReads;		/* sequential reads in a row */
+  size_t raWindow;		/* bytes the last read-ahead asked for */
+  int raEof;			/* a read-ahead found the end, at raEofOffset */
+  rodsLong_t raEofOffset;
+  int raFilling;		/* a read-ahead is in flight, into bufCache[raFillInx] */
+  int raFillInx;
+  rodsLong_t raAheadOffset;	/* with blockKey: where read-ahead has got to */
+  rodsLong_t raFillOffset;	/* and what the one in flight reads */
+  size_t raFillSize;
+  int raFailed;			/* a read-ahead failed: don't try again */
+  pthread_cond_t raCond;	/* a read-ahead finished */
+  iquest_fuse_irods_conn_t *raConn;	/* spare connection read-ahead uses */
+  int raFd;			/* objPath opened on raConn (0 if not yet) */
+  rodsLong_t raFdOffset;	/* where raFd is */
 } iFuseDesc_t;
 
-#define NUM_PATH_HASH_SLOT	201
-#define CACHE_EXPIRE_TIME	600	/* 10 minutes before expiration */
+extern iFuseDesc_t *IFuseDescChunk[];
 
-typedef struct PathCache {
-    char* filePath;
-    char* locCachePath;
-    struct stat stbuf;
-    uint cachedTime;
-    struct PathCache *prev;
-    struct PathCache *next;
-    void *pathCacheQue;
-    readCacheState_t locCacheState;
-} pathCache_t;
-
-typedef struct PathCacheQue {
-    pathCache_t *top;
-    pathCache_t *bottom;
-} pathCacheQue_t;
+/* the descriptor at descInx, which must have been allocated */
+#define IFUSE_DESC(descInx) \
+  (IFuseDescChunk[(descInx) >> IFUSE_DESC_CHUNK_BITS][(descInx) & (IFUSE_DESC_CHUNK_SIZE - 1)])
 
 typedef struct specialPath {
     char *path;
@@ -138,13 +156,15 @@ int
 initIFuseDesc ();
 int
 allocIFuseDesc ();
+uint64_t
+getIFuseDescHandle (int descInx);
+int
+getIFuseDescInx (uint64_t fh);
 int
 lockDesc (int descInx);
 int
 unlockDesc (int descInx);
 int
-irods_connInuse (iquest_fuse_irods_conn_t *irods_conn);
-int
 freeIFuseDesc (int descInx);
 int get_iquest_fuse_irods_conn_by_path(iquest_fuse_irods_conn_t **irods_conn, iquest_fuse_t *iqf, char *localPath);
 int
@@ -157,15 +177,18 @@ int
 ifuseRead (char *path, int descInx, char *buf, size_t size, 
 off_t offset);
 int
+_ifuseRead (char *path, int descInx, char *buf, size_t size, 
+off_t offset);
+int
+setIFuseDescBlockKey (int descInx, char *path);
+int
 ifuseLseek (char *path, int descInx, off_t offset);
  int get_iquest_fuse_irods_conn(iquest_fuse_irods_conn_t **irods_conn, iquest_fuse_t *iqf);
+int get_iquest_fuse_irods_bulk_conn(iquest_fuse_irods_conn_t **irods_conn, iquest_fuse_t *iqf);
+int _get_iquest_fuse_irods_conn(iquest_fuse_irods_conn_t **irods_conn, iquest_fuse_t *iqf, int connClass);
 int
 useIFuseConn (iquest_fuse_irods_conn_t *irods_conn);
 int
-useFreeIFuseConn (iquest_fuse_irods_conn_t *irods_conn);
-int
-_useIFuseConn (iquest_fuse_irods_conn_t *irods_conn);
-int
 unuseIFuseConn (iquest_fuse_irods_conn_t *irods_conn);
 int
 relIFuseConn (iquest_fuse_irods_conn_t *irods_conn);
@@ -174,6 +197,7 @@ _relIFuseConn (iquest_fuse_irods_conn_t *irods_conn);
 
 void conn_manager(iquest_fuse_t *iqf);
 int disconnect_all (iquest_fuse_t *iqf);
+int warm_iquest_fuse_irods_conns (iquest_fuse_t *iqf, int numConns);
 int signal_conn_manager(iquest_fuse_t *iqf);
 int get_conn_count(iquest_fuse_t *iqf);
 
@@ -182,38 +206,10 @@ iFuseDescInuse ();
 int
 checkFuseDesc (int descInx);
 int
-initPathCache ();
-int
-getHashSlot (int value, int numHashSlot);
-int
-matchPathInPathSlot (pathCacheQue_t *pathCacheQue, char *inPath,
-pathCache_t **outPathCache);
-int
-chkCacheExpire (pathCacheQue_t *pathCacheQue);
-int
-addPathToCache (char *inPath, pathCacheQue_t *pathQueArray,
-struct stat *stbuf, pathCache_t **outPathCache);
-int
-_addPathToCache (char *inPath, pathCacheQue_t *pathQueArray,
-struct stat *stbuf, pathCache_t **outPathCache);
-int
-addToCacheSlot (char *inPath, pathCacheQue_t *pathCacheQue,
-struct stat *stbuf, pathCache_t **outPathCache);
-int
-pathSum (char *inPath);
-int
-matchPathInPathCache (char *inPath, pathCacheQue_t *pathQueArray,
-pathCache_t **outPathCache);
-int
-_matchPathInPathCache (char *inPath, pathCacheQue_t *pathQueArray,
-pathCache_t **outPathCache);
+initPathCache (iquest_fuse_conf_t *conf);
 int
 isSpecialPath (char *inPath);
 int
-rmPathFromCache (char *inPath, pathCacheQue_t *pathQueArray);
-int
-_rmPathFromCache (char *inPath, pathCacheQue_t *pathQueArray);
-int
 addNewlyCreatedToCache (char *path, int descInx, int mode,
 pathCache_t **tmpPathCache);
 int
@@ -222,19 +218,20 @@ int
 closeIrodsFd (iquest_fuse_irods_conn_t *irods_conn, int fd);
 int
 getDescInxInNewlyCreatedCache (char *path, int flags);
-int fill_dir_stat(struct stat *stbuf, uint ctime, uint mtime, uint atime);
-int fill_file_stat(struct stat *stbuf, uint mode, rodsLong_t size, uint ctime, uint mtime, uint atime);
+ino_t iquest_data_obj_ino(const char *data_id);
+ino_t iquest_coll_ino(const char *coll_path);
+ino_t iquest_virtual_ino(const char *path);
+int fill_dir_stat(struct stat *stbuf, ino_t ino, uint ctime, uint mtime, uint atime);
+int fill_file_stat(struct stat *stbuf, ino_t ino, uint mode, rodsLong_t size, uint ctime, uint mtime, uint atime);
 int
 irodsMknodWithCache (char *path, mode_t mode, char *cachePath);
 int iquest_fuse_open_with_read_cache (iquest_fuse_irods_conn_t *irods_conn, char *path, int flags);
 int
-freePathCache (pathCache_t *tmpPathCache);
-int
 getFileCachePath (char *inPath, char *cacehPath);
 int
 setAndMkFileCacheDir ();
 int 
-updatePathCacheStat (pathCache_t *tmpPathCache);
+updatePathCacheStat (char *path, char *locCachePath, struct stat *stbuf);
 int
 ifuseClose (char *path, int descInx);
 int
@@ -243,28 +240,40 @@ int dataObjCreateByFusePath (iquest_fuse_irods_conn_t *irods_conn, char *path, i
 int
 ifusePut (iquest_fuse_irods_conn_t *irods_conn, char *path, char *locCachePath, int mode,
 rodsLong_t srcSize);
-int
-freeFileCache (pathCache_t *tmpPathCache);
 int ifuseReconnect (iquest_fuse_irods_conn_t *irods_conn);
 int ifuseConnect (iquest_fuse_irods_conn_t *irods_conn);
+int check_iquest_fuse_irods_conn (iquest_fuse_irods_conn_t *irods_conn);
 int
 getNewlyCreatedDescByPath (char *path);
 int renmeOpenedIFuseDesc(iquest_fuse_t *iqf, pathCache_t *fromPathCache, char *to);
 int map_irods_auth_errors(int irods_err, int fuse_err);
 
-int _iquest_fuse_irods_getattr(iquest_fuse_irods_conn_t *irods_conn, const char *path, struct stat *stbuf, pathCache_t **out_pathCache);
+int _iquest_fuse_irods_getattr(iquest_fuse_irods_conn_t *irods_conn, const char *path, struct stat *stbuf);
+int iquest_fuse_irods_getattr(iquest_fuse_t *iqf, const char *path, struct stat *stbuf);
 
 int iquest_parse_rods_path_str(iquest_fuse_t *iqf, char *in_path, char *out_path);
 int iquest_zone_hint_from_rods_path(iquest_fuse_t *iqf, char *rods_path, char *zone_hint);
 int iquest_parse_fuse_path(iquest_fuse_t *iqf, char *path, char **rods_path, iquest_fuse_query_cond_t **query_cond, char **query_part_attr, char **post_query_path);
+int iquest_fuse_query_cond_create(iquest_fuse_query_cond_t **query_cond);
+int iquest_fuse_query_cond_destroy(iquest_fuse_query_cond_t *query_cond);
 void iquest_fuse_t_destroy(iquest_fuse_t *iqf);
 void iquest_fuse_conf_t_destroy(iquest_fuse_conf_t *conf);
 int iquest_readdir_coll(iquest_fuse_t *iqf, const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi);
-
+int rmParentListFromCache(char *path);
+int iquest_fetch_coll_list(iquest_fuse_t *iqf, const char *path, char *coll_path, nameList_t **out_list);
+int iquest_refresh_coll_list(iquest_fuse_t *iqf, const char *path, char *coll_path, nameList_t *old_list, nameList_t **out_list);
+int iquest_fill_coll_list(const char *path, nameList_t *list, int from_cache, void *buf, fuse_fill_dir_t filler);
+
+int iquest_get_attr_list(iquest_fuse_t *iqf, char *query_zone, iquest_fuse_query_cond_t *query_cond, nameList_t **out_list);
+int iquest_get_value_list(iquest_fuse_t *iqf, char *query_zone, iquest_fuse_query_cond_t *query_cond, char *attr, nameList_t **out_list);
+int iquest_get_query_result(iquest_fuse_t *iqf, char *coll_path, char *query_zone, iquest_fuse_query_cond_t *query_cond, nameList_t **out_result);
+int iquest_query_path_to_obj_path(iquest_fuse_t *iqf, const char *path, char *obj_path);
 int iquest_query_attr_exists(iquest_fuse_t *iqf, char *query_zone, iquest_fuse_query_cond_t *query_cond, char *attr);
-int iquest_query_and_fill_attr_list(iquest_fuse_t *iqf, char *query_zone, iquest_fuse_query_cond_t *query_cond, void *buf, fuse_fill_dir_t filler);
-int iquest_query_and_fill_value_list(iquest_fuse_t *iqf, char *query_zone, iquest_fuse_query_cond_t *query_cond, char *attr, void *buf, fuse_fill_dir_t filler);
+int iquest_query_and_fill_attr_list(iquest_fuse_t *iqf, const char *path, char *query_zone, iquest_fuse_query_cond_t *query_cond, void *buf, fuse_fill_dir_t filler);
+int iquest_query_and_fill_value_list(iquest_fuse_t *iqf, const char *path, char *query_zone, iquest_fuse_query_cond_t *query_cond, char *attr, void *buf, fuse_fill_dir_t filler);
 
+char *iquest_query_cond_key(char *query_zone, iquest_fuse_query_cond_t *query_cond, char *extra);
+int iquest_genquery_run(iquest_fuse_t *iqf, genQueryInp_t *genQueryInp, int (*row_func)(genQueryOut_t *genQueryOut, int row, void *arg), void *arg);
 int iquest_genquery_add_where_str(genQueryInp_t *genQueryInp, char *where_attr, char *where_op, char *where_val);
 int iquest_genquery_add_select_str(genQueryInp_t *genQueryInp, char *select);
 
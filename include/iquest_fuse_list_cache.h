@@ -0,0 +1,99 @@
+/*****************************************************************************
+ * Copyright (c) 2012 Genome Research Ltd.
+ *
+ * Author: Joshua C. Randall <jcrandall@alum.mit.edu>
+ *
+ * This file is part of iquestFuse.
+ *
+ * iquestFuse is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Declarations for the iquestFuse listing cache.
+ *
+ * A name list holds the names in a directory listing in one contiguous
+ * string arena (plus an array of offsets into it), optionally with a stat
+ * for each name, and a hash index for membership tests.  Lists are built
+ * privately, then published in a list cache table keyed by a string, after
+ * which they are immutable and shared by reference count.
+ *****************************************************************************/
+#ifndef IQUEST_FUSE_LIST_CACHE_H
+#define IQUEST_FUSE_LIST_CACHE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define LIST_CACHE_DEFAULT_MAX_BYTES	(64*1024*1024)	/* 64 mb */
+#define LIST_CACHE_DEFAULT_RESCAN	3600	/* seconds between full listings */
+#define LIST_CACHE_REFRESH_SKEW		120	/* overlap between refreshes, for clock skew */
+#define LIST_CACHE_INIT_SLOTS		256	/* must be a power of 2 */
+#define NAME_LIST_INIT_NAMES		64
+#define NAME_LIST_INIT_ARENA		1024
+
+/* the i'th name in a name list */
+#define NAME_LIST_NAME(list, i)	((list)->arena + (list)->nameOffset[i])
+
+typedef struct NameList {
+    char *key;
+    uint64_t hash;		/* of key */
+    uint cachedTime;
+    uint queryTime;		/* when the contents were last queried */
+    uint fullTime;		/* when they were last queried in full */
+    int refCnt;			/* updated atomically */
+    unsigned int numNames;
+    unsigned int maxNames;
+    unsigned int *nameOffset;	/* offset of each name in arena */
+    char *arena;		/* NUL-terminated names, back to back */
+    size_t arenaLen;
+    size_t arenaSize;
+    struct stat *stbuf;		/* stat of each name (NULL if not kept) */
+    unsigned int *index;	/* hash set of name number + 1 (0 is empty) */
+    unsigned int indexSize;	/* always a power of 2 */
+    size_t allocSize;		/* bytes charged against the cache budget */
+    void *attach;		/* extra data kept and freed with the list */
+    size_t attachSize;		/* bytes in attach, set before publishing */
+    void (*freeAttach)(void *attach);
+    struct NameList *next;	/* hash chain */
+    struct NameList *lruPrev;
+    struct NameList *lruNext;
+} nameList_t;
+
+typedef struct ListCacheTable {
+    const char *name;
+    pthread_mutex_t lock;
+    uint ttl;			/* seconds before a list expires */
+    unsigned long maxBytes;	/* 0 means unbounded */
+    unsigned long numBytes;
+    unsigned long numLists;
+    unsigned int numSlots;	/* always a power of 2 */
+    nameList_t **slot;
+    nameList_t lru;		/* sentinel: lru.lruNext is most recently used */
+} listCacheTable_t;
+
+
+nameList_t *newNameList(const char *key, int withStat);
+int addNameToList(nameList_t *list, const char *name, struct stat *stbuf);
+int internNameInList(nameList_t *list, const char *name, struct stat *stbuf);
+int findNameInList(nameList_t *list, const char *name);
+void holdNameList(nameList_t *list);
+void releaseNameList(nameList_t *list);
+int initListCacheTable(listCacheTable_t *table, const char *name, uint ttl, unsigned long maxBytes);
+nameList_t *_getListFromCache(listCacheTable_t *table, const char *key, nameList_t **out_expired);
+nameList_t *getListFromCache(listCacheTable_t *table, const char *key);
+int addListToCache(listCacheTable_t *table, nameList_t *list);
+int rmListFromCache(listCacheTable_t *table, const char *key);
+
+#endif	/* IQUEST_FUSE_LIST_CACHE_H */
@@ -0,0 +1,68 @@
+/*****************************************************************************
+ * Copyright (c) 2012 Genome Research Ltd.
+ *
+ * Author: Joshua C. Randall <jcrandall@alum.mit.edu>
+ *
+ * This file is part of iquestFuse.
+ *
+ * iquestFuse is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+/*****************************************************************************
+ * Declarations for the iquestFuse completed-query result cache.
+ *
+ * The result of a completed query is a name list of the data objects it
+ * found (the entries of the query directory), with the rest of each row
+ * attached as packed column arrays indexed by name number.  Collection
+ * names, which repeat across rows, are interned in a second name list.
+ * Results are cached in a list cache table like any other listing.
+ *****************************************************************************/
+#ifndef IQUEST_FUSE_QUERY_CACHE_H
+#define IQUEST_FUSE_QUERY_CACHE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "iquest_fuse_list_cache.h"
+
+#define QUERY_CACHE_DEFAULT_MAX_BYTES	(64*1024*1024)	/* 64 mb */
+
+/* a data object whose name is taken is listed as <name>~<DATA_ID> */
+#define QUERY_RESULT_DUP_SEP		'~'
+/* set in the mode column of such a row */
+#define QUERY_RESULT_MODE_DUP		0x8000
+
+typedef struct QueryResultCols {
+    unsigned int maxRows;
+    uint64_t *dataId;
+    int64_t *size;
+    uint32_t *createTime;
+    uint32_t *modifyTime;
+    uint32_t *collNum;		/* name number in colls */
+    uint16_t *mode;
+    nameList_t *colls;		/* interned collection names */
+} queryResultCols_t;
+
+/* the columns of a query result */
+#define QUERY_RESULT_COLS(result)	((queryResultCols_t *)(result)->attach)
+
+nameList_t *newQueryResult(const char *key);
+int addRowToQueryResult(nameList_t *result, const char *name, const char *coll, uint64_t dataId, int64_t size, uint createTime, uint modifyTime, uint mode);
+int finishQueryResult(nameList_t *result);
+int getQueryResultStat(nameList_t *result, unsigned int row, struct stat *stbuf);
+int getQueryResultPath(nameList_t *result, unsigned int row, char *objPath);
+
+#endif	/* IQUEST_FUSE_QUERY_CACHE_H */
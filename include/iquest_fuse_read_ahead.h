@@ -0,0 +1,49 @@
+/*****************************************************************************
+ * Copyright (c) 2012 Genome Research Ltd.
+ *
+ * Author: Joshua C. Randall <jcrandall@alum.mit.edu>
+ *
+ * This file is part of iquestFuse.
+ *
+ * iquestFuse is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Declarations for iquestFuse read-ahead.
+ *
+ * Once a descriptor has been read sequentially for a few reads, the data
+ * following each read is fetched in the background into the descriptor's
+ * bufCache, over a spare bulk connection on which the data object is
+ * opened a second time, and later reads are answered from there.  Each
+ * read-ahead asks for twice as much as the one before, up to a maximum,
+ * and a read that is not sequential starts over.  Only one read-ahead per
+ * descriptor is in flight at a time, so with two buffers one is being
+ * read while the other fills.  A descriptor that reads through the block
+ * cache reads ahead into the block cache instead.
+ *****************************************************************************/
+#ifndef IQUEST_FUSE_READ_AHEAD_H
+#define IQUEST_FUSE_READ_AHEAD_H
+
+#include "iquest_fuse.h"
+#include "iquest_fuse_lib.h"
+
+#define READ_AHEAD_DEFAULT_MAX_BYTES	(8*1024*1024)	/* 8 mb */
+#define READ_AHEAD_CEILING		(256*1024*1024)	/* most read-ahead-max-bytes may be */
+#define READ_AHEAD_MIN_WINDOW		(128*1024)	/* the first read-ahead */
+#define READ_AHEAD_SEQ_READS		2	/* sequential reads before read-ahead starts */
+
+int readWithReadAhead(char *path, int descInx, char *buf, size_t size, off_t offset);
+void stopReadAhead(int descInx);
+
+#endif	/* IQUEST_FUSE_READ_AHEAD_H */
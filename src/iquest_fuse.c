@@ -43,6 +43,11 @@
 #include "iquest_fuse.h"
 #include "iquest_fuse_operations.h"
 #include "iquest_fuse_lib.h"
+#include "iquest_fuse_cache_file.h"
+#include "iquest_fuse_read_ahead.h"
+
+extern pathCacheTable_t NonExistPathArray;
+extern pathCacheTable_t PathArray;
 
 static struct fuse_operations iquest_fuse_operations = {
   .init = iquest_fuse_init,
@@ -102,6 +107,70 @@ static struct fuse_opt iquest_fuse_opts[] = {
   IQUEST_FUSE_OPT("--show-indicator",		show_indicator,	1),
   IQUEST_FUSE_OPT("show-indicator",		show_indicator,	1),
 
+  IQUEST_FUSE_OPT("--cache-ttl=%u",		cache_ttl,	0),
+  IQUEST_FUSE_OPT("cache-ttl=%u",		cache_ttl,	0),
+
+  IQUEST_FUSE_OPT("--neg-cache-ttl=%u",		neg_cache_ttl,	0),
+  IQUEST_FUSE_OPT("neg-cache-ttl=%u",		neg_cache_ttl,	0),
+
+  IQUEST_FUSE_OPT("--cache-max-entries=%lu",	cache_max_entries,	0),
+  IQUEST_FUSE_OPT("cache-max-entries=%lu",	cache_max_entries,	0),
+
+  IQUEST_FUSE_OPT("--cache-max-bytes=%lu",	cache_max_bytes,	0),
+  IQUEST_FUSE_OPT("cache-max-bytes=%lu",	cache_max_bytes,	0),
+
+  IQUEST_FUSE_OPT("--cache-file=%s",		cache_file,	0),
+  IQUEST_FUSE_OPT("cache-file=%s",		cache_file,	0),
+
+  IQUEST_FUSE_OPT("--list-cache-ttl=%u",	list_cache_ttl,	0),
+  IQUEST_FUSE_OPT("list-cache-ttl=%u",		list_cache_ttl,	0),
+
+  IQUEST_FUSE_OPT("--list-cache-max-bytes=%lu",	list_cache_max_bytes,	0),
+  IQUEST_FUSE_OPT("list-cache-max-bytes=%lu",	list_cache_max_bytes,	0),
+
+  IQUEST_FUSE_OPT("--list-cache-rescan=%u",	list_cache_rescan,	0),
+  IQUEST_FUSE_OPT("list-cache-rescan=%u",	list_cache_rescan,	0),
+
+  IQUEST_FUSE_OPT("--query-cache-max-bytes=%lu",	query_cache_max_bytes,	0),
+  IQUEST_FUSE_OPT("query-cache-max-bytes=%lu",	query_cache_max_bytes,	0),
+
+  IQUEST_FUSE_OPT("--stat-batch-window=%u",	stat_batch_window,	0),
+  IQUEST_FUSE_OPT("stat-batch-window=%u",	stat_batch_window,	0),
+
+  IQUEST_FUSE_OPT("--conn-pool-min=%u",		conn_pool_min,	0),
+  IQUEST_FUSE_OPT("conn-pool-min=%u",		conn_pool_min,	0),
+
+  IQUEST_FUSE_OPT("--conn-pool-max=%u",		conn_pool_max,	0),
+  IQUEST_FUSE_OPT("conn-pool-max=%u",		conn_pool_max,	0),
+
+  IQUEST_FUSE_OPT("--conn-pool-warm=%u",	conn_pool_warm,	0),
+  IQUEST_FUSE_OPT("conn-pool-warm=%u",		conn_pool_warm,	0),
+
+  IQUEST_FUSE_OPT("--bulk-conn-pool-min=%u",	bulk_conn_pool_min,	0),
+  IQUEST_FUSE_OPT("bulk-conn-pool-min=%u",	bulk_conn_pool_min,	0),
+
+  IQUEST_FUSE_OPT("--bulk-conn-pool-max=%u",	bulk_conn_pool_max,	0),
+  IQUEST_FUSE_OPT("bulk-conn-pool-max=%u",	bulk_conn_pool_max,	0),
+
+  IQUEST_FUSE_OPT("--conn-wait-timeout=%u",	conn_wait_timeout,	0),
+  IQUEST_FUSE_OPT("conn-wait-timeout=%u",	conn_wait_timeout,	0),
+
+  IQUEST_FUSE_OPT("--read-ahead-max-bytes=%lu",	read_ahead_max_bytes,	0),
+  IQUEST_FUSE_OPT("read-ahead-max-bytes=%lu",	read_ahead_max_bytes,	0),
+
+  IQUEST_FUSE_OPT("--block-cache-max-bytes=%lu",	block_cache_max_bytes,	0),
+  IQUEST_FUSE_OPT("block-cache-max-bytes=%lu",	block_cache_max_bytes,	0),
+
+  /* FUSE's own names are taken here too, so that they override our defaults */
+  IQUEST_FUSE_OPT("--entry-timeout=%lf",	entry_timeout,	0),
+  IQUEST_FUSE_OPT("entry_timeout=%lf",		entry_timeout,	0),
+
+  IQUEST_FUSE_OPT("--attr-timeout=%lf",		attr_timeout,	0),
+  IQUEST_FUSE_OPT("attr_timeout=%lf",		attr_timeout,	0),
+
+  IQUEST_FUSE_OPT("--negative-timeout=%lf",	negative_timeout,	0),
+  IQUEST_FUSE_OPT("negative_timeout=%lf",	negative_timeout,	0),
+
   FUSE_OPT_KEY("--debug",        IQUEST_FUSE_CONF_KEY_DEBUG_ME), /* the --debug option is only recongnised by iquestFuse, not FUSE itself */
   FUSE_OPT_KEY("--debug-trace",  IQUEST_FUSE_CONF_KEY_TRACE_ME), 
 
@@ -141,6 +210,27 @@ void usage(char *progname) {
 	  "    -r c                 --remap-slash-char=c          remap-slash-char=c\n"
 	  "                         --require-conn                require-conn\n"
 	  "                         --show-indicator              show-indicator\n"
+	  "                         --cache-ttl=secs              cache-ttl=secs\n"
+	  "                         --neg-cache-ttl=secs          neg-cache-ttl=secs\n"
+	  "                         --cache-max-entries=n         cache-max-entries=n\n"
+	  "                         --cache-max-bytes=n           cache-max-bytes=n\n"
+	  "                         --cache-file=file             cache-file=file\n"
+	  "                         --list-cache-ttl=secs         list-cache-ttl=secs\n"
+	  "                         --list-cache-max-bytes=n      list-cache-max-bytes=n\n"
+	  "                         --list-cache-rescan=secs      list-cache-rescan=secs\n"
+	  "                         --query-cache-max-bytes=n     query-cache-max-bytes=n\n"
+	  "                         --stat-batch-window=msecs     stat-batch-window=msecs\n"
+	  "                         --conn-pool-min=n             conn-pool-min=n\n"
+	  "                         --conn-pool-max=n             conn-pool-max=n\n"
+	  "                         --conn-pool-warm=n            conn-pool-warm=n\n"
+	  "                         --bulk-conn-pool-min=n        bulk-conn-pool-min=n\n"
+	  "                         --bulk-conn-pool-max=n        bulk-conn-pool-max=n\n"
+	  "                         --conn-wait-timeout=secs      conn-wait-timeout=secs\n"
+	  "                         --read-ahead-max-bytes=n      read-ahead-max-bytes=n\n"
+	  "                         --block-cache-max-bytes=n     block-cache-max-bytes=n\n"
+	  "                         --entry-timeout=secs          entry_timeout=secs\n"
+	  "                         --attr-timeout=secs           attr_timeout=secs\n"
+	  "                         --negative-timeout=secs       negative_timeout=secs\n"
 	  "\n"
 	  , progname);
 }
@@ -184,6 +274,26 @@ int iquest_fuse_opt_proc(void *data, const char *arg, int key, struct fuse_args
 }
 
 
+/*
+ * bring the pool size options for a class of connection into range and
+ * make its pool
+ */
+static struct ConnPool *new_conn_pool(iquest_fuse_t *iqf, const char *name, const char *max_opt,
+				      unsigned int *min, unsigned int *max) {
+  if(*max < 1) {
+    *max = 1;
+  } else if(*max > IQF_CONN_POOL_CEILING) {
+    rodsLog(LOG_SYS_WARNING, "limiting %s to %d", max_opt, IQF_CONN_POOL_CEILING);
+    *max = IQF_CONN_POOL_CEILING;
+  }
+  if(*min > *max) {
+    *min = *max;
+  }
+  rodsLog(LOG_NOTICE, "keeping %u to %u iRODS %s connections", *min, *max, name);
+  return newConnPool(iqf, name, *min, *max, check_iquest_fuse_irods_conn);
+}
+
+
 int main(int argc, char **argv) {
   int status;
 
@@ -236,6 +346,29 @@ int main(int argc, char **argv) {
     strncpy(iqf->conf->slash_remap, IQF_DEFAULT_SLASH_REMAP, bufsize);
   }
   
+  /*
+   * Set defaults for numeric conf fields (may be overridden by options)
+   */
+  iqf->conf->cache_ttl = CACHE_EXPIRE_TIME;
+  iqf->conf->neg_cache_ttl = CACHE_EXPIRE_TIME;
+  iqf->conf->cache_max_entries = PATH_CACHE_DEFAULT_MAX_ENTRIES;
+  iqf->conf->cache_max_bytes = PATH_CACHE_DEFAULT_MAX_BYTES;
+  iqf->conf->list_cache_ttl = CACHE_EXPIRE_TIME;
+  iqf->conf->list_cache_max_bytes = LIST_CACHE_DEFAULT_MAX_BYTES;
+  iqf->conf->list_cache_rescan = LIST_CACHE_DEFAULT_RESCAN;
+  iqf->conf->query_cache_max_bytes = QUERY_CACHE_DEFAULT_MAX_BYTES;
+  iqf->conf->stat_batch_window = IQF_DEFAULT_STAT_BATCH_WINDOW;
+  iqf->conf->conn_pool_min = IQF_DEFAULT_CONN_POOL_MIN;
+  iqf->conf->conn_pool_max = IQF_DEFAULT_CONN_POOL_MAX;
+  iqf->conf->bulk_conn_pool_min = IQF_DEFAULT_BULK_CONN_POOL_MIN;
+  iqf->conf->bulk_conn_pool_max = IQF_DEFAULT_BULK_CONN_POOL_MAX;
+  iqf->conf->conn_wait_timeout = IQF_DEFAULT_CONN_WAIT_TIMEOUT;
+  iqf->conf->read_ahead_max_bytes = READ_AHEAD_DEFAULT_MAX_BYTES;
+  iqf->conf->block_cache_max_bytes = BLOCK_CACHE_DEFAULT_MAX_BYTES;
+  iqf->conf->entry_timeout = -1;
+  iqf->conf->attr_timeout = -1;
+  iqf->conf->negative_timeout = -1;
+
   /*
    * Set configuration in iquest_fuse_conf from command-line options and 
    * call iquest_fuse_opt_proc for other options
@@ -291,9 +424,65 @@ int main(int argc, char **argv) {
     iqf->rods_env->rodsLogLevel = iqf->conf->debug_level;
   }
   
-  initPathCache ();
+  rodsLog(LOG_NOTICE, "caching stats for %us (non-existent paths for %us), up to %lu entries and %lu bytes",
+	  iqf->conf->cache_ttl, iqf->conf->neg_cache_ttl, iqf->conf->cache_max_entries, iqf->conf->cache_max_bytes);
+  rodsLog(LOG_NOTICE, "caching directory listings for %us, up to %lu bytes (and query results up to %lu bytes)",
+	  iqf->conf->list_cache_ttl, iqf->conf->list_cache_max_bytes, iqf->conf->query_cache_max_bytes);
+  rodsLog(LOG_NOTICE, "caching file data in %d byte blocks, up to %lu bytes",
+	  BLOCK_CACHE_BLOCK_SIZE, iqf->conf->block_cache_max_bytes);
+  initPathCache (iqf->conf);
+#ifdef CACHE_FUSE_PATH
+  if(iqf->conf->cache_file != NULL) {
+    /* start warm from a previous mount (carries on without it on error) */
+    openPathCacheFile(iqf, &PathArray, &NonExistPathArray);
+  }
+#endif
   initIFuseDesc ();
+  /* connections warmed up at mount are kept warm */
+  if(iqf->conf->conn_pool_min < iqf->conf->conn_pool_warm) {
+    iqf->conf->conn_pool_min = iqf->conf->conn_pool_warm;
+  }
+  iqf->conn_pool[IQF_CONN_CATALOG] = new_conn_pool(iqf, "catalog", "conn-pool-max",
+						   &iqf->conf->conn_pool_min, &iqf->conf->conn_pool_max);
+  iqf->conn_pool[IQF_CONN_BULK] = new_conn_pool(iqf, "data", "bulk-conn-pool-max",
+						&iqf->conf->bulk_conn_pool_min, &iqf->conf->bulk_conn_pool_max);
+  if(iqf->conn_pool[IQF_CONN_CATALOG] == NULL || iqf->conn_pool[IQF_CONN_BULK] == NULL) {
+    exit(3);
+  }
+  if(iqf->conf->conn_pool_warm > iqf->conf->conn_pool_max) {
+    iqf->conf->conn_pool_warm = iqf->conf->conn_pool_max;
+  }
+  if(iqf->conf->read_ahead_max_bytes > READ_AHEAD_CEILING) {
+    rodsLog(LOG_SYS_WARNING, "limiting read-ahead-max-bytes to %d", READ_AHEAD_CEILING);
+    iqf->conf->read_ahead_max_bytes = READ_AHEAD_CEILING;
+  }
   
+  /* our inode numbers are stable (see IQF_INO), so have FUSE pass them on */
+  fuse_opt_add_arg(&args, "-ouse_ino");
+
+  /*
+   * Let the kernel cache lookups and attributes for as long as we would
+   * (up to a limit).  FUSE 2 only takes these timeouts for the whole mount;
+   * per-node timeouts would need the low-level API.
+   */
+  {
+    char kernel_opts[256];
+    unsigned int pos_ttl = iqf->conf->cache_ttl;
+    unsigned int neg_ttl = iqf->conf->neg_cache_ttl;
+
+    if(iqf->conf->list_cache_ttl < pos_ttl) pos_ttl = iqf->conf->list_cache_ttl;
+    if(pos_ttl > IQF_MAX_DERIVED_KERNEL_TIMEOUT) pos_ttl = IQF_MAX_DERIVED_KERNEL_TIMEOUT;
+    if(neg_ttl > IQF_MAX_DERIVED_KERNEL_TIMEOUT) neg_ttl = IQF_MAX_DERIVED_KERNEL_TIMEOUT;
+    if(iqf->conf->entry_timeout < 0) iqf->conf->entry_timeout = pos_ttl;
+    if(iqf->conf->attr_timeout < 0) iqf->conf->attr_timeout = pos_ttl;
+    if(iqf->conf->negative_timeout < 0) iqf->conf->negative_timeout = neg_ttl;
+
+    snprintf(kernel_opts, sizeof(kernel_opts), "-oentry_timeout=%g,attr_timeout=%g,negative_timeout=%g",
+	     iqf->conf->entry_timeout, iqf->conf->attr_timeout, iqf->conf->negative_timeout);
+    rodsLog(LOG_NOTICE, "kernel caching lookups for %gs, attributes for %gs and failed lookups for %gs",
+	    iqf->conf->entry_timeout, iqf->conf->attr_timeout, iqf->conf->negative_timeout);
+    fuse_opt_add_arg(&args, kernel_opts);
+  }
 
   /*
    * Pass control to FUSE (which will call iquest_fuse_init and then start event loop 
@@ -0,0 +1,232 @@
+/*****************************************************************************
+ * Copyright (c) 2012 Genome Research Ltd.
+ *
+ * Author: Joshua C. Randall <jcrandall@alum.mit.edu>
+ *
+ * This file is part of iquestFuse.
+ *
+ * iquestFuse is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Implementation of the iquestFuse block cache.
+ *
+ * The table is a chained hash table protected by a single mutex, which is
+ * only held to find, link or unlink a block; data is fetched into a block
+ * and copied out of it without the lock, under a reference.  Blocks being
+ * fetched are in the table (so that others find and wait for them) but not
+ * on the lru list, so they are never evicted; ready blocks are evicted in
+ * least recently used order when the table goes over its byte budget.
+ *****************************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "iquest_fuse.h"
+#include "iquest_fuse_lib.h"
+#include "iquest_fuse_block_cache.h"
+
+int initBlockCacheTable(blockCacheTable_t *table, size_t blockSize, unsigned long maxBytes) {
+  unsigned long maxBlocks;
+
+  bzero(table, sizeof(blockCacheTable_t));
+  table->blockSize = blockSize;
+  table->maxBytes = maxBytes;
+  pthread_mutex_init(&table->lock, NULL);
+  pthread_cond_init(&table->fetchDone, NULL);
+  /* the budget bounds the number of blocks, so the table never grows */
+  maxBlocks = maxBytes / blockSize;
+  table->numSlots = BLOCK_CACHE_MIN_SLOTS;
+  while (table->numSlots < 2 * maxBlocks) {
+    table->numSlots <<= 1;
+  }
+  table->slot = (cacheBlock_t **) malloc_and_zero_or_exit(table->numSlots * sizeof(cacheBlock_t *));
+  table->lru.lruNext = &table->lru;
+  table->lru.lruPrev = &table->lru;
+  return 0;
+}
+
+static uint64_t block_cache_hash(const char *key, rodsLong_t blockNum) {
+  return iquest_path_hash(key) + (uint64_t) blockNum * 0x9e3779b97f4a7c15ULL;
+}
+
+static void block_free(cacheBlock_t *block) {
+  free(block->data);
+  free(block->key);
+  free(block);
+}
+
+void releaseBlock(cacheBlock_t *block) {
+  if (block == NULL) return;
+  if (__atomic_sub_fetch(&block->refCnt, 1, __ATOMIC_ACQ_REL) == 0) {
+    block_free(block);
+  }
+}
+
+static void block_cache_lru_unlink(cacheBlock_t *block) {
+  block->lruPrev->lruNext = block->lruNext;
+  block->lruNext->lruPrev = block->lruPrev;
+  block->lruPrev = block->lruNext = NULL;
+}
+
+static void block_cache_lru_push(blockCacheTable_t *table, cacheBlock_t *block) {
+  block->lruNext = table->lru.lruNext;
+  block->lruPrev = &table->lru;
+  table->lru.lruNext->lruPrev = block;
+  table->lru.lruNext = block;
+}
+
+/* takes block out of the table, passing the table's reference to the caller */
+static cacheBlock_t *block_cache_unlink(blockCacheTable_t *table, cacheBlock_t *block) {
+  cacheBlock_t **link = &table->slot[block->hash & (table->numSlots - 1)];
+
+  while (*link != block) {
+    link = &(*link)->next;
+  }
+  *link = block->next;
+  block->next = NULL;
+  if (block->lruNext != NULL) {
+    block_cache_lru_unlink(block);
+  }
+  table->numBlocks--;
+  table->numBytes -= block->allocSize;
+  return block;
+}
+
+static cacheBlock_t *block_cache_find(blockCacheTable_t *table, const char *key, rodsLong_t blockNum, uint64_t hash) {
+  cacheBlock_t *block;
+
+  for (block = table->slot[hash & (table->numSlots - 1)]; block != NULL; block = block->next) {
+    if (block->hash == hash && block->blockNum == blockNum && strcmp(block->key, key) == 0) {
+      return block;
+    }
+  }
+  return NULL;
+}
+
+/* unlinks ready blocks, least recently used first, until the table is
+ * within its budget, and returns them chained through next */
+static cacheBlock_t *block_cache_evict(blockCacheTable_t *table) {
+  cacheBlock_t *block, *victims = NULL;
+
+  while (table->numBytes > table->maxBytes && table->lru.lruPrev != &table->lru) {
+    block = block_cache_unlink(table, table->lru.lruPrev);
+    block->next = victims;
+    victims = block;
+  }
+  return victims;
+}
+
+static void block_cache_release_list(cacheBlock_t *victims) {
+  cacheBlock_t *block;
+
+  while (victims != NULL) {
+    block = victims;
+    victims = victims->next;
+    releaseBlock(block);
+  }
+}
+
+/*
+ * Returns block blockNum of the object key with a reference held by the
+ * caller (see releaseBlock), waiting for it if someone else is fetching it.
+ * If it is not cached, an empty block is added for the caller to fetch:
+ * *out_fetch is then set and the caller must read (up to) blockSize bytes
+ * into data and call blockFetched, even on failure.  Returns NULL if
+ * caching is off or there is no memory for the block.
+ */
+cacheBlock_t *getBlockFromCache(blockCacheTable_t *table, const char *key, rodsLong_t blockNum, int *out_fetch) {
+  cacheBlock_t *block, *victims;
+  uint64_t hash;
+
+  *out_fetch = 0;
+  if (table->maxBytes == 0) {
+    return NULL;
+  }
+  hash = block_cache_hash(key, blockNum);
+
+  pthread_mutex_lock(&table->lock);
+  while ((block = block_cache_find(table, key, blockNum, hash)) != NULL &&
+	 block->state == CACHE_BLOCK_FETCHING) {
+    /* if the fetch fails the block is gone when we look again, and we
+     * fetch it ourselves */
+    pthread_cond_wait(&table->fetchDone, &table->lock);
+  }
+  if (block != NULL) {
+    block_cache_lru_unlink(block);
+    block_cache_lru_push(table, block);
+    __atomic_add_fetch(&block->refCnt, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&table->lock);
+    return block;
+  }
+
+  block = (cacheBlock_t *) calloc(1, sizeof(cacheBlock_t));
+  if (block != NULL) {
+    block->key = strdup(key);
+    block->data = (char *) malloc(table->blockSize);
+  }
+  if (block == NULL || block->key == NULL || block->data == NULL) {
+    pthread_mutex_unlock(&table->lock);
+    if (block != NULL) {
+      block_free(block);
+    }
+    rodsLog(LOG_ERROR, "getBlockFromCache: could not allocate a block");
+    return NULL;
+  }
+  block->blockNum = blockNum;
+  block->hash = hash;
+  block->state = CACHE_BLOCK_FETCHING;
+  block->refCnt = 2;		/* the table's and the caller's */
+  block->allocSize = sizeof(cacheBlock_t) + strlen(key) + 1 + table->blockSize;
+  block->next = table->slot[hash & (table->numSlots - 1)];
+  table->slot[hash & (table->numSlots - 1)] = block;
+  table->numBlocks++;
+  table->numBytes += block->allocSize;
+  victims = block_cache_evict(table);
+  pthread_mutex_unlock(&table->lock);
+
+  block_cache_release_list(victims);
+  *out_fetch = 1;
+  return block;
+}
+
+/*
+ * Completes the fetch of block (from getBlockFromCache): status is the
+ * number of bytes read into it, or negative if the fetch failed, in which
+ * case the block is dropped from the table.  The caller's reference is
+ * still held.
+ */
+void blockFetched(blockCacheTable_t *table, cacheBlock_t *block, int status) {
+  cacheBlock_t *victims = NULL;
+
+  pthread_mutex_lock(&table->lock);
+  if (status < 0) {
+    block->state = CACHE_BLOCK_FAILED;
+    victims = block_cache_unlink(table, block);
+  } else {
+    block->len = status;
+    block->state = CACHE_BLOCK_READY;
+    block_cache_lru_push(table, block);
+    victims = block_cache_evict(table);
+  }
+  pthread_cond_broadcast(&table->fetchDone);
+  pthread_mutex_unlock(&table->lock);
+
+  block_cache_release_list(victims);
+}
@@ -0,0 +1,1245 @@
+/*****************************************************************************
+ * Copyright (c) 2012 Genome Research Ltd.
+ *
+ * Author: Joshua C. Randall <jcrandall@alum.mit.edu>
+ *
+ * This file is part of iquestFuse.
+ *
+ * iquestFuse is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Implementation of the iquestFuse path (stat) cache.
+ *
+ * Paths are hashed with a 64-bit FNV-1a hash followed by a murmur3-style
+ * finalizer so that similar paths (e.g. anagrams) land far apart.  The top
+ * bits of the hash select a shard and the low bits select the home slot
+ * within that shard's open-addressing table.
+ *
+ * Lookups do not take any lock.  Writers serialize on the shard lock and
+ * publish entries and slot arrays with release stores; a refresh replaces
+ * the entry rather than rewriting its stat in place.  Anything that is
+ * unlinked from a table is retired and only freed by the cache manager once
+ * every thread that might still be reading it has left its read-side
+ * critical section (epoch-based reclamation).
+ *****************************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+
+#include "iquest_fuse.h"
+#include "iquest_fuse_lib.h"
+#include "iquest_fuse_cache.h"
+#include "iquest_fuse_cache_file.h"
+
+/* marks a slot whose entry has been removed (keeps probe chains intact) */
+static pathCache_t PathCacheTombstone;
+#define PATH_CACHE_TOMBSTONE	(&PathCacheTombstone)
+
+/* path cache maintenance thread and the tables it looks after */
+static pthread_t PathCacheManagerThr;
+static pthread_mutex_t PathCacheManagerLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t PathCacheManagerCond = PTHREAD_COND_INITIALIZER;
+static pathCacheTable_t *ManagedPathCache[MAX_MANAGED_PATH_CACHE];
+static int NumManagedPathCache = 0;
+static int PathCacheManagerStarted = 0;
+
+/*
+ * epoch-based reclamation state
+ * PathCacheEpoch is only ever advanced by the cache manager.  Entries and
+ * slot arrays retired in epoch e can be freed once the epoch reaches e+2.
+ */
+static unsigned long PathCacheEpoch = 1;
+static pathCacheReader_t *PathCacheReaders = NULL;
+static pthread_mutex_t PathCacheReaderLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t PathCacheReaderKey;
+static pthread_once_t PathCacheReaderOnce = PTHREAD_ONCE_INIT;
+static __thread pathCacheReader_t *MyPathCacheReader = NULL;
+
+static pthread_mutex_t PathCacheRetireLock = PTHREAD_MUTEX_INITIALIZER;
+static pathCache_t *RetiredPathCache = NULL;
+static pathCacheSlots_t *RetiredPathCacheSlots = NULL;
+static unsigned long NumRetiredPathCache = 0;
+
+uint64_t iquest_path_hash(const char *path) {
+  const unsigned char *p = (const unsigned char *) path;
+  uint64_t h = 0xcbf29ce484222325ULL;	/* FNV-1a offset basis */
+
+  while (*p != '\0') {
+    h ^= *p++;
+    h *= 0x100000001b3ULL;		/* FNV-1a prime */
+  }
+
+  /* murmur3 fmix64 to spread the low-entropy bits */
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+static pathCacheShard_t *path_cache_shard(pathCacheTable_t *table, uint64_t hash) {
+  return &table->shard[hash >> (64 - NUM_PATH_CACHE_SHARD_BITS)];
+}
+
+static pathCacheSlots_t *path_cache_slots_alloc(unsigned int numSlots) {
+  pathCacheSlots_t *slots;
+
+  slots = (pathCacheSlots_t *) calloc(1, sizeof(pathCacheSlots_t) + numSlots * sizeof(pathCache_t *));
+  if (slots != NULL) {
+    slots->numSlots = numSlots;
+  }
+  return slots;
+}
+
+int initPathCacheTable(pathCacheTable_t *table, const char *name, uint ttl, unsigned long maxEntries, unsigned long maxBytes) {
+  int i;
+
+  bzero(table, sizeof(pathCacheTable_t));
+  table->name = name;
+  table->ttl = ttl;
+  table->maxEntries = maxEntries;
+  table->maxBytes = maxBytes;
+  pthread_mutex_init(&table->clockLock, NULL);
+  for(i = 0; i < NUM_PATH_CACHE_SHARD; i++) {
+    pathCacheShard_t *shard = &table->shard[i];
+    pthread_mutex_init(&shard->lock, NULL);
+    shard->slots = path_cache_slots_alloc(PATH_CACHE_SHARD_INIT_SLOTS);
+    if (shard->slots == NULL) {
+      fprintf(stderr, "initPathCacheTable: could not allocate slots for %s\n", name);
+      exit(2);
+    }
+  }
+  return 0;
+}
+
+static void path_cache_reader_release(void *arg) {
+  pathCacheReader_t *reader = (pathCacheReader_t *) arg;
+
+  /* thread is exiting, its record can be reused by another thread */
+  reader->depth = 0;
+  __atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+  __atomic_store_n(&reader->inuse, 0, __ATOMIC_RELEASE);
+}
+
+static void path_cache_reader_key_create(void) {
+  pthread_key_create(&PathCacheReaderKey, path_cache_reader_release);
+}
+
+/*
+ * returns the calling thread's reader record, registering one if necessary
+ */
+static pathCacheReader_t *path_cache_reader(void) {
+  pathCacheReader_t *reader;
+
+  if (MyPathCacheReader != NULL) return MyPathCacheReader;
+
+  pthread_once(&PathCacheReaderOnce, path_cache_reader_key_create);
+  /* reuse a record left behind by a thread that has exited */
+  for (reader = __atomic_load_n(&PathCacheReaders, __ATOMIC_ACQUIRE); reader != NULL; reader = reader->next) {
+    int expected = 0;
+    if (__atomic_compare_exchange_n(&reader->inuse, &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+      break;
+    }
+  }
+  if (reader == NULL) {
+    reader = (pathCacheReader_t *) malloc_and_zero_or_exit(sizeof(pathCacheReader_t));
+    reader->inuse = 1;
+    pthread_mutex_lock(&PathCacheReaderLock);
+    reader->next = PathCacheReaders;
+    __atomic_store_n(&PathCacheReaders, reader, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&PathCacheReaderLock);
+  }
+  pthread_setspecific(PathCacheReaderKey, reader);
+  MyPathCacheReader = reader;
+  return reader;
+}
+
+/*
+ * Enter a read-side critical section.  Any pathCache_t pointer obtained
+ * from matchPathInPathCache or addPathToCache stays valid until the matching
+ * pathCacheReadUnlock.  May be nested.
+ */
+void pathCacheReadLock() {
+  pathCacheReader_t *reader = path_cache_reader();
+
+  if (reader->depth++ == 0) {
+    __atomic_store_n(&reader->epoch, __atomic_load_n(&PathCacheEpoch, __ATOMIC_ACQUIRE), __ATOMIC_RELAXED);
+    /* announce the epoch before reading any table memory */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  }
+}
+
+void pathCacheReadUnlock() {
+  pathCacheReader_t *reader = MyPathCacheReader;
+
+  if (reader == NULL || reader->depth <= 0) {
+    rodsLog(LOG_ERROR, "pathCacheReadUnlock: called without pathCacheReadLock");
+    return;
+  }
+  if (--reader->depth == 0) {
+    __atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+  }
+}
+
+/*
+ * hand an unlinked entry over to the cache manager for freeing
+ */
+static void path_cache_retire(pathCache_t *entry) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  entry->retireEpoch = __atomic_load_n(&PathCacheEpoch, __ATOMIC_ACQUIRE);
+  pthread_mutex_lock(&PathCacheRetireLock);
+  entry->next = RetiredPathCache;
+  RetiredPathCache = entry;
+  __atomic_fetch_add(&NumRetiredPathCache, 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&PathCacheRetireLock);
+}
+
+static void path_cache_retire_slots(pathCacheSlots_t *slots) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  slots->retireEpoch = __atomic_load_n(&PathCacheEpoch, __ATOMIC_ACQUIRE);
+  pthread_mutex_lock(&PathCacheRetireLock);
+  slots->next = RetiredPathCacheSlots;
+  RetiredPathCacheSlots = slots;
+  pthread_mutex_unlock(&PathCacheRetireLock);
+}
+
+int retirePathCacheList(pathCache_t *victims) {
+  pathCache_t *entry;
+  int retired = 0;
+
+  while (victims != NULL) {
+    entry = victims;
+    victims = victims->next;
+    path_cache_retire(entry);
+    retired++;
+  }
+  return retired;
+}
+
+/*
+ * advance the epoch if every thread inside a read-side critical section
+ * has already seen the current one
+ */
+static int path_cache_try_advance_epoch(void) {
+  unsigned long epoch = __atomic_load_n(&PathCacheEpoch, __ATOMIC_ACQUIRE);
+  pathCacheReader_t *reader;
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  for (reader = __atomic_load_n(&PathCacheReaders, __ATOMIC_ACQUIRE); reader != NULL; reader = reader->next) {
+    unsigned long readerEpoch = __atomic_load_n(&reader->epoch, __ATOMIC_ACQUIRE);
+    if (readerEpoch != 0 && readerEpoch != epoch) {
+      return 0;
+    }
+  }
+  __atomic_store_n(&PathCacheEpoch, epoch + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+/*
+ * free everything that was retired at least two epochs ago
+ * returns the number of entries still waiting to be freed
+ */
+static unsigned long path_cache_reclaim(void) {
+  unsigned long epoch;
+  pathCache_t *entry, **entryp, *freeEntries = NULL;
+  pathCacheSlots_t *slots, **slotsp, *freeSlots = NULL;
+  unsigned long remaining;
+
+  path_cache_try_advance_epoch();
+  epoch = __atomic_load_n(&PathCacheEpoch, __ATOMIC_ACQUIRE);
+
+  pthread_mutex_lock(&PathCacheRetireLock);
+  entryp = &RetiredPathCache;
+  while ((entry = *entryp) != NULL) {
+    if (entry->retireEpoch + 2 <= epoch) {
+      *entryp = entry->next;
+      entry->next = freeEntries;
+      freeEntries = entry;
+      __atomic_fetch_sub(&NumRetiredPathCache, 1, __ATOMIC_RELAXED);
+    } else {
+      entryp = &entry->next;
+    }
+  }
+  slotsp = &RetiredPathCacheSlots;
+  while ((slots = *slotsp) != NULL) {
+    if (slots->retireEpoch + 2 <= epoch) {
+      *slotsp = slots->next;
+      slots->next = freeSlots;
+      freeSlots = slots;
+    } else {
+      slotsp = &slots->next;
+    }
+  }
+  remaining = NumRetiredPathCache + (RetiredPathCacheSlots != NULL);
+  pthread_mutex_unlock(&PathCacheRetireLock);
+
+  /* freeing may unlink local cache files, so do it without the lock */
+  while (freeEntries != NULL) {
+    entry = freeEntries;
+    freeEntries = freeEntries->next;
+    freePathCache(entry);
+  }
+  while (freeSlots != NULL) {
+    slots = freeSlots;
+    freeSlots = freeSlots->next;
+    free(slots);
+  }
+  return remaining;
+}
+
+/*
+ * lock-free probe for in_path
+ * must be called within pathCacheReadLock
+ */
+static pathCache_t *path_cache_lookup(pathCacheTable_t *table, const char *in_path, uint64_t hash) {
+  pathCacheShard_t *shard = path_cache_shard(table, hash);
+  pathCacheSlots_t *slots = __atomic_load_n(&shard->slots, __ATOMIC_ACQUIRE);
+  unsigned int mask = slots->numSlots - 1;
+  unsigned int i = hash & mask;
+  unsigned int n;
+  pathCache_t *entry;
+
+  for (n = 0; n < slots->numSlots; n++) {
+    entry = __atomic_load_n(&slots->slot[i], __ATOMIC_ACQUIRE);
+    if (entry == NULL) break;
+    if (entry != PATH_CACHE_TOMBSTONE && entry->hash == hash &&
+	strcmp(entry->filePath, in_path) == 0) {
+      return entry;
+    }
+    i = (i + 1) & mask;
+  }
+  return NULL;
+}
+
+/*
+ * returns the slot index holding in_path, or -1 if it is not in the shard
+ * shard lock must be held
+ */
+static int path_cache_shard_find(pathCacheShard_t *shard, const char *in_path, uint64_t hash) {
+  pathCacheSlots_t *slots = shard->slots;
+  unsigned int mask = slots->numSlots - 1;
+  unsigned int i = hash & mask;
+  pathCache_t *entry;
+
+  while ((entry = slots->slot[i]) != NULL) {
+    if (entry != PATH_CACHE_TOMBSTONE && entry->hash == hash &&
+	strcmp(entry->filePath, in_path) == 0) {
+      return i;
+    }
+    i = (i + 1) & mask;
+  }
+  return -1;
+}
+
+/*
+ * rehash all live entries of the shard into a new slot array of new_slots
+ * slots (which also drops all tombstones) and retire the old one
+ * shard lock must be held
+ */
+static int path_cache_shard_resize(pathCacheShard_t *shard, unsigned int new_slots) {
+  pathCacheSlots_t *old_slots = shard->slots;
+  pathCacheSlots_t *slots;
+  unsigned int mask = new_slots - 1;
+  unsigned int i, j;
+
+  slots = path_cache_slots_alloc(new_slots);
+  if (slots == NULL) {
+    rodsLog(LOG_ERROR, "path_cache_shard_resize: could not allocate %u slots", new_slots);
+    return SYS_MALLOC_ERR;
+  }
+  for (i = 0; i < old_slots->numSlots; i++) {
+    pathCache_t *entry = old_slots->slot[i];
+    if (entry == NULL || entry == PATH_CACHE_TOMBSTONE) continue;
+    j = entry->hash & mask;
+    while (slots->slot[j] != NULL) {
+      j = (j + 1) & mask;
+    }
+    slots->slot[j] = entry;
+  }
+  __atomic_store_n(&shard->slots, slots, __ATOMIC_RELEASE);
+  shard->numDeleted = 0;
+  path_cache_retire_slots(old_slots);
+  return 0;
+}
+
+/*
+ * removes the entry in slot i from the shard and returns it
+ * (the caller must retire it rather than free it)
+ * shard lock must be held
+ */
+static pathCache_t *path_cache_shard_remove(pathCacheTable_t *table, pathCacheShard_t *shard, int i) {
+  pathCacheSlots_t *slots = shard->slots;
+  unsigned int mask = slots->numSlots - 1;
+  pathCache_t *entry = slots->slot[i];
+
+  __atomic_fetch_sub(&table->numEntries, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_sub(&table->numBytes, entry->allocSize, __ATOMIC_RELAXED);
+
+  /* if the next slot ends the probe chain, no tombstone is needed */
+  if (slots->slot[(i + 1) & mask] == NULL) {
+    __atomic_store_n(&slots->slot[i], NULL, __ATOMIC_RELEASE);
+  } else {
+    __atomic_store_n(&slots->slot[i], PATH_CACHE_TOMBSTONE, __ATOMIC_RELEASE);
+    shard->numDeleted++;
+  }
+  shard->numUsed--;
+  return entry;
+}
+
+/*
+ * allocates a new (unpublished) entry for in_path
+ */
+static pathCache_t *path_cache_entry_alloc(const char *in_path, uint64_t hash, struct stat *stbuf, uint cachedTime) {
+  pathCache_t *entry;
+  int len = strlen(in_path);
+
+  entry = (pathCache_t *) malloc(sizeof(pathCache_t) + len + 1);
+  if (entry == NULL) return NULL;
+  bzero(entry, sizeof(pathCache_t));
+  entry->filePath = (char *) (entry + 1);
+  memcpy(entry->filePath, in_path, len + 1);
+  entry->hash = hash;
+  entry->allocSize = sizeof(pathCache_t) + len + 1 +
+    2 * sizeof(pathCache_t *);	/* plus roughly its share of slots */
+  entry->cachedTime = cachedTime;
+  if (stbuf != NULL) {
+    entry->stbuf = *stbuf;
+  }
+  return entry;
+}
+
+/*
+ * hands the local cache file of old over to entry, which is about to
+ * replace it.  old keeps its own copy of the name (lock-free readers may
+ * still be copying it out) but no longer unlinks the file when freed.
+ * shard lock must be held
+ */
+static int path_cache_move_file(pathCache_t *entry, pathCache_t *old) {
+  if (old->locCachePath == NULL) return 0;
+  entry->locCachePath = strdup(old->locCachePath);
+  if (entry->locCachePath == NULL) return SYS_MALLOC_ERR;
+  entry->locCacheState = old->locCacheState;
+  __atomic_store_n(&old->locCacheState, NO_FILE_CACHE, __ATOMIC_RELAXED);
+  return 0;
+}
+
+/*
+ * puts entry (for the same path) in place of the one in slot i and returns
+ * the old one (the caller must retire it rather than free it)
+ * shard lock must be held
+ */
+static pathCache_t *path_cache_shard_swap(pathCacheShard_t *shard, int i, pathCache_t *entry) {
+  pathCache_t *old = shard->slots->slot[i];
+
+  entry->referenced = 1;
+  __atomic_store_n(&shard->slots->slot[i], entry, __ATOMIC_RELEASE);
+  return old;
+}
+
+/*
+ * Publishes entry in shard, whose lock must be held.  An entry already
+ * there for the same path is replaced (and returned in *out_old, to be
+ * retired once the lock is dropped) if replace is set, and otherwise kept.
+ * Returns 1 if entry was published, 0 if it was not (so the caller still
+ * owns it) or SYS_MALLOC_ERR.
+ */
+static int path_cache_shard_insert(pathCacheTable_t *table, pathCacheShard_t *shard, pathCache_t *entry, int replace, pathCache_t **out_old) {
+  pathCacheSlots_t *slots;
+  unsigned int mask;
+  int i;
+
+  *out_old = NULL;
+  i = path_cache_shard_find(shard, entry->filePath, entry->hash);
+  if (i >= 0) {
+    if (!replace) return 0;
+    /* already cached - replace the entry, keeping any local cache file */
+    if (path_cache_move_file(entry, shard->slots->slot[i]) < 0) {
+      return SYS_MALLOC_ERR;
+    }
+    *out_old = path_cache_shard_swap(shard, i, entry);
+    return 1;
+  }
+
+  slots = shard->slots;
+  if ((shard->numUsed + shard->numDeleted + 1) * 100 >
+      slots->numSlots * PATH_CACHE_MAX_LOAD_PCT) {
+    /* double if mostly live entries, otherwise just clear tombstones */
+    unsigned int new_slots = slots->numSlots;
+    if ((shard->numUsed + 1) * 200 > slots->numSlots * PATH_CACHE_MAX_LOAD_PCT) {
+      new_slots *= 2;
+    }
+    if (path_cache_shard_resize(shard, new_slots) < 0 &&
+	shard->numUsed + shard->numDeleted + 1 >= slots->numSlots) {
+      return SYS_MALLOC_ERR;
+    }
+    slots = shard->slots;
+  }
+
+  mask = slots->numSlots - 1;
+  i = entry->hash & mask;
+  while (slots->slot[i] != NULL && slots->slot[i] != PATH_CACHE_TOMBSTONE) {
+    i = (i + 1) & mask;
+  }
+  if (slots->slot[i] == PATH_CACHE_TOMBSTONE) shard->numDeleted--;
+  __atomic_store_n(&slots->slot[i], entry, __ATOMIC_RELEASE);
+  shard->numUsed++;
+  __atomic_fetch_add(&table->numEntries, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&table->numBytes, entry->allocSize, __ATOMIC_RELAXED);
+  return 1;
+}
+
+/*
+ * Looks up in_path without taking any lock.
+ * The returned entry must not be modified and is only guaranteed to stay
+ * valid while the caller holds pathCacheReadLock.
+ */
+int
+matchPathInPathCache (char *in_path, pathCacheTable_t *table,
+pathCache_t **out_pathCache)
+{
+    pathCache_t *tmpPathCache;
+    int status = 0;
+
+    *out_pathCache = NULL;
+    if (in_path == NULL) {
+        rodsLog (LOG_ERROR,
+          "matchPathInPathCache: input in_path is NULL");
+        return (SYS_INTERNAL_NULL_INPUT_ERR);
+    }
+
+    pathCacheReadLock ();
+    tmpPathCache = path_cache_lookup (table, in_path, iquest_path_hash (in_path));
+    /* expired entries are a miss; the cache manager will clean them up */
+    if (tmpPathCache != NULL &&
+      (uint) time (0) < tmpPathCache->cachedTime + table->ttl) {
+	if (__atomic_load_n (&tmpPathCache->referenced, __ATOMIC_RELAXED) == 0) {
+	    __atomic_store_n (&tmpPathCache->referenced, 1, __ATOMIC_RELAXED);
+	}
+	*out_pathCache = tmpPathCache;
+	status = 1;
+    }
+    pathCacheReadUnlock ();
+
+    return status;
+}
+
+/*
+ * Looks up in_path without taking any lock and copies the cached stat into
+ * stbuf (if stbuf is not NULL).
+ * Returns 1 on a hit and 0 on a miss.
+ */
+int
+getPathCacheStat (char *in_path, pathCacheTable_t *table, struct stat *stbuf)
+{
+    pathCache_t *tmpPathCache;
+    int status;
+
+    pathCacheReadLock ();
+    status = matchPathInPathCache (in_path, table, &tmpPathCache);
+    if (status == 1 && stbuf != NULL) {
+	*stbuf = tmpPathCache->stbuf;
+    }
+    pathCacheReadUnlock ();
+    return status;
+}
+
+/*
+ * As getPathCacheStat, but also copies the name of the local cache file of
+ * in_path into locCachePath (MAX_NAME_LEN bytes), or an empty string if it
+ * has none.  The file is only guaranteed to still be there while the
+ * caller holds pathCacheReadLock.
+ */
+int
+getPathCacheFile (char *in_path, pathCacheTable_t *table, struct stat *stbuf,
+char *locCachePath)
+{
+    pathCache_t *tmpPathCache;
+    int status;
+
+    locCachePath[0] = '\0';
+    pathCacheReadLock ();
+    status = matchPathInPathCache (in_path, table, &tmpPathCache);
+    if (status == 1) {
+	if (stbuf != NULL) *stbuf = tmpPathCache->stbuf;
+	if (tmpPathCache->locCachePath != NULL) {
+	    rstrcpy (locCachePath, tmpPathCache->locCachePath, MAX_NAME_LEN);
+	}
+    }
+    pathCacheReadUnlock ();
+    return status;
+}
+
+/*
+ * Adds (or replaces) the cached stat for in_path, writing the addition to
+ * the cache file if logIt is set.  The record is appended under the shard
+ * lock so that the file sees changes to a path in the order the table did.
+ */
+static int
+path_cache_add (char *in_path, pathCacheTable_t *table,
+struct stat *stbuf, uint cachedTime, pathCache_t **out_pathCache, int logIt)
+{
+    pathCacheShard_t *shard;
+    pathCache_t *tmpPathCache;
+    pathCache_t *oldPathCache = NULL;
+    uint64_t hash;
+    int status;
+
+    if (out_pathCache != NULL) *out_pathCache = NULL;
+    if (table == NULL || in_path == NULL) {
+        rodsLog (LOG_ERROR,
+          "_addPathToCache: input table or in_path is NULL");
+        return (SYS_INTERNAL_NULL_INPUT_ERR);
+    }
+
+    hash = iquest_path_hash (in_path);
+    shard = path_cache_shard (table, hash);
+    tmpPathCache = path_cache_entry_alloc (in_path, hash, stbuf, cachedTime);
+    if (tmpPathCache == NULL) {
+	return (SYS_MALLOC_ERR);
+    }
+
+    pthread_mutex_lock (&shard->lock);
+    status = path_cache_shard_insert (table, shard, tmpPathCache, 1,
+      &oldPathCache);
+    if (status > 0) {
+	if (logIt) logPathCacheAdd (table, in_path, stbuf, cachedTime);
+	if (out_pathCache != NULL) *out_pathCache = tmpPathCache;
+    }
+    pthread_mutex_unlock (&shard->lock);
+    if (status < 0) {
+	free (tmpPathCache);
+	return (status);
+    }
+
+    if (oldPathCache != NULL) {
+	path_cache_retire (oldPathCache);
+    } else if (pathCacheOverBudget (table)) {
+	signalPathCacheManager ();
+    }
+
+    return (0);
+}
+
+/*
+ * Adds (or replaces) the cached stat for in_path.
+ * If out_pathCache is not NULL, the new entry is returned in it; as for
+ * matchPathInPathCache it is only safe to use under pathCacheReadLock.
+ */
+int
+addPathToCache (char *in_path, pathCacheTable_t *table,
+struct stat *stbuf, pathCache_t **out_pathCache)
+{
+    return (path_cache_add (in_path, table, stbuf, time (0), out_pathCache,
+      table != NULL && table->persistId != PATH_CACHE_FILE_NONE));
+}
+
+/*
+ * Adds (or replaces) the cached stat for in_path as of cachedTime,
+ * without writing it to the cache file.
+ */
+int
+_addPathToCache (char *in_path, pathCacheTable_t *table,
+struct stat *stbuf, uint cachedTime, pathCache_t **out_pathCache)
+{
+    return (path_cache_add (in_path, table, stbuf, cachedTime, out_pathCache,
+      0));
+}
+
+/*
+ * As _addPathToCache, but the new entry gets (a copy of) locCachePath as
+ * its local cache file instead of inheriting the one of the entry it
+ * replaces; a NULL locCachePath publishes it without one.  If the entry
+ * being replaced has a local cache file of its own, that file is dropped
+ * (and unlinked once the entry is freed) when replaceFile is set, and
+ * otherwise nothing is published.
+ * Returns 1 if the entry was published and 0 if it was not.
+ */
+int
+_addPathToCacheWithFile (char *in_path, pathCacheTable_t *table,
+struct stat *stbuf, uint cachedTime, char *locCachePath,
+readCacheState_t locCacheState, int replaceFile)
+{
+    pathCacheShard_t *shard;
+    pathCache_t *tmpPathCache;
+    pathCache_t *oldPathCache = NULL;
+    uint64_t hash;
+    int status;
+    int i;
+
+    if (table == NULL || in_path == NULL) {
+        rodsLog (LOG_ERROR,
+          "_addPathToCacheWithFile: input table or in_path is NULL");
+        return (SYS_INTERNAL_NULL_INPUT_ERR);
+    }
+
+    hash = iquest_path_hash (in_path);
+    shard = path_cache_shard (table, hash);
+    tmpPathCache = path_cache_entry_alloc (in_path, hash, stbuf, cachedTime);
+    if (tmpPathCache == NULL) {
+	return (SYS_MALLOC_ERR);
+    }
+    if (locCachePath != NULL) {
+	tmpPathCache->locCachePath = strdup (locCachePath);
+	if (tmpPathCache->locCachePath == NULL) {
+	    free (tmpPathCache);
+	    return (SYS_MALLOC_ERR);
+	}
+	tmpPathCache->locCacheState = locCacheState;
+    }
+
+    pthread_mutex_lock (&shard->lock);
+    i = path_cache_shard_find (shard, in_path, hash);
+    if (i < 0) {
+	status = path_cache_shard_insert (table, shard, tmpPathCache, 0,
+	  &oldPathCache);
+    } else if (shard->slots->slot[i]->locCachePath == NULL || replaceFile) {
+	oldPathCache = path_cache_shard_swap (shard, i, tmpPathCache);
+	status = 1;
+    } else {
+	status = 0;
+    }
+    pthread_mutex_unlock (&shard->lock);
+    if (status <= 0) {
+	/* never published, so nothing else has seen its local cache file */
+	free (tmpPathCache->locCachePath);
+	free (tmpPathCache);
+	return (status);
+    }
+
+    if (oldPathCache != NULL) {
+	path_cache_retire (oldPathCache);
+    } else if (pathCacheOverBudget (table)) {
+	signalPathCacheManager ();
+    }
+
+    return (1);
+}
+
+/*
+ * Replaces the entry for in_path with one whose cached size is size,
+ * keeping its local cache file.  Nothing is done if in_path is not cached
+ * or already has that size.
+ * Returns 1 if the entry was replaced and 0 if not.
+ */
+int
+setPathCacheSize (char *in_path, pathCacheTable_t *table, off_t size)
+{
+    pathCacheShard_t *shard;
+    pathCache_t *tmpPathCache = NULL;
+    pathCache_t *oldPathCache = NULL;
+    uint64_t hash;
+    int status = 0;
+    int i;
+
+    if (in_path == NULL) return 0;
+    hash = iquest_path_hash (in_path);
+    shard = path_cache_shard (table, hash);
+
+    pthread_mutex_lock (&shard->lock);
+    i = path_cache_shard_find (shard, in_path, hash);
+    if (i >= 0 && shard->slots->slot[i]->stbuf.st_size != size) {
+	oldPathCache = shard->slots->slot[i];
+	tmpPathCache = path_cache_entry_alloc (in_path, hash,
+	  &oldPathCache->stbuf, oldPathCache->cachedTime);
+	if (tmpPathCache == NULL ||
+	  path_cache_move_file (tmpPathCache, oldPathCache) < 0) {
+	    free (tmpPathCache);
+	    status = SYS_MALLOC_ERR;
+	} else {
+	    tmpPathCache->stbuf.st_size = size;
+	    path_cache_shard_swap (shard, i, tmpPathCache);
+	    status = 1;
+	}
+    }
+    pthread_mutex_unlock (&shard->lock);
+
+    if (status > 0) path_cache_retire (oldPathCache);
+    return (status);
+}
+
+/*
+ * Replaces the entry for in_path with one that has no local cache file
+ * and hands the file it had over to the caller, with its name in
+ * *out_locCachePath (which the caller must free).
+ * Returns 1 if a file was taken and 0 if in_path had none.
+ */
+int
+takePathCacheFile (char *in_path, pathCacheTable_t *table,
+char **out_locCachePath)
+{
+    pathCacheShard_t *shard;
+    pathCache_t *tmpPathCache = NULL;
+    pathCache_t *oldPathCache = NULL;
+    uint64_t hash;
+    int status = 0;
+    int i;
+
+    *out_locCachePath = NULL;
+    if (in_path == NULL) return 0;
+    hash = iquest_path_hash (in_path);
+    shard = path_cache_shard (table, hash);
+
+    pthread_mutex_lock (&shard->lock);
+    i = path_cache_shard_find (shard, in_path, hash);
+    if (i >= 0 && shard->slots->slot[i]->locCachePath != NULL) {
+	oldPathCache = shard->slots->slot[i];
+	tmpPathCache = path_cache_entry_alloc (in_path, hash,
+	  &oldPathCache->stbuf, oldPathCache->cachedTime);
+	if (tmpPathCache != NULL) {
+	    *out_locCachePath = strdup (oldPathCache->locCachePath);
+	}
+	if (*out_locCachePath == NULL) {
+	    free (tmpPathCache);
+	    status = SYS_MALLOC_ERR;
+	} else {
+	    __atomic_store_n (&oldPathCache->locCacheState, NO_FILE_CACHE,
+	      __ATOMIC_RELAXED);
+	    path_cache_shard_swap (shard, i, tmpPathCache);
+	    status = 1;
+	}
+    }
+    pthread_mutex_unlock (&shard->lock);
+
+    if (status > 0) path_cache_retire (oldPathCache);
+    return (status);
+}
+
+/*
+ * Adds the stats of numNames entries of the directory parent (names[i]
+ * with stbufs[i]) in one pass, as for the listing of a collection.  The
+ * entries are grouped by shard so that each shard lock is taken at most
+ * once.  Entries that are already cached are kept unless replace is set.
+ * Returns the number of entries added or replaced.
+ */
+int addChildPathsToCache(pathCacheTable_t *table, const char *parent, unsigned int numNames, char **names, struct stat *stbufs, int replace) {
+  unsigned int shardStart[NUM_PATH_CACHE_SHARD + 1];
+  pathCache_t **entries;
+  unsigned int *order;
+  uint cachedTime = time(0);
+  int numAdded = 0;
+  unsigned int i;
+  int s;
+
+  if (table == NULL || parent == NULL || numNames == 0) {
+    return 0;
+  }
+  entries = (pathCache_t **) calloc(numNames, sizeof(pathCache_t *));
+  order = (unsigned int *) malloc(numNames * sizeof(unsigned int));
+  if (entries == NULL || order == NULL) {
+    free(entries);
+    free(order);
+    return SYS_MALLOC_ERR;
+  }
+
+  /* allocate everything before taking any lock, then sort by shard */
+  bzero(shardStart, sizeof(shardStart));
+  pathCacheReadLock();
+  for (i = 0; i < numNames; i++) {
+    char childPath[MAX_NAME_LEN];
+    uint64_t hash;
+
+    if (strcmp(parent, IQF_PATH_SEP) == 0) {
+      snprintf(childPath, MAX_NAME_LEN, "/%s", names[i]);
+    } else {
+      snprintf(childPath, MAX_NAME_LEN, "%s/%s", parent, names[i]);
+    }
+    hash = iquest_path_hash(childPath);
+    if (!replace && path_cache_lookup(table, childPath, hash) != NULL) {
+      /* would be kept anyway, so do not bother allocating */
+      continue;
+    }
+    entries[i] = path_cache_entry_alloc(childPath, hash, &stbufs[i], cachedTime);
+    if (entries[i] != NULL) {
+      shardStart[(hash >> (64 - NUM_PATH_CACHE_SHARD_BITS)) + 1]++;
+    }
+  }
+  for (s = 0; s < NUM_PATH_CACHE_SHARD; s++) {
+    shardStart[s + 1] += shardStart[s];
+  }
+  {
+    unsigned int next[NUM_PATH_CACHE_SHARD];
+    memcpy(next, shardStart, sizeof(next));
+    for (i = 0; i < numNames; i++) {
+      if (entries[i] != NULL) {
+	order[next[entries[i]->hash >> (64 - NUM_PATH_CACHE_SHARD_BITS)]++] = i;
+      }
+    }
+  }
+
+  /* the new entries are logged after they are published */
+  for (s = 0; s < NUM_PATH_CACHE_SHARD; s++) {
+    pathCacheShard_t *shard = &table->shard[s];
+    unsigned int j;
+
+    if (shardStart[s] == shardStart[s + 1]) continue;
+    pthread_mutex_lock(&shard->lock);
+    for (j = shardStart[s]; j < shardStart[s + 1]; j++) {
+      pathCache_t *old = NULL;
+      pathCache_t *entry = entries[order[j]];
+      if (path_cache_shard_insert(table, shard, entry, replace, &old) > 0) {
+	/* keep the published entry, and hand back the one it replaced */
+	entries[order[j]] = old;
+	numAdded++;
+	if (table->persistId != PATH_CACHE_FILE_NONE) {
+	  logPathCacheAdd(table, entry->filePath, &entry->stbuf, cachedTime);
+	}
+      } else {
+	free(entry);
+	entries[order[j]] = NULL;
+      }
+    }
+    pthread_mutex_unlock(&shard->lock);
+  }
+  pathCacheReadUnlock();
+
+  for (i = 0; i < numNames; i++) {
+    if (entries[i] != NULL) {
+      path_cache_retire(entries[i]);
+    }
+  }
+  free(entries);
+  free(order);
+
+  if (pathCacheOverBudget(table)) {
+    signalPathCacheManager();
+  }
+  return numAdded;
+}
+
+/*
+ * Calls func for every unexpired entry in the table, without blocking
+ * writers.  Entries added or removed during the walk may or may not be
+ * seen.  Stops early (and returns that value) if func returns <0.
+ */
+int walkPathCache(pathCacheTable_t *table, int (*func)(pathCache_t *entry, void *arg), void *arg) {
+  uint curTime = time(0);
+  int status = 0;
+  int i;
+  unsigned int j;
+
+  pathCacheReadLock();
+  for (i = 0; i < NUM_PATH_CACHE_SHARD && status >= 0; i++) {
+    pathCacheSlots_t *slots = __atomic_load_n(&table->shard[i].slots, __ATOMIC_ACQUIRE);
+    for (j = 0; j < slots->numSlots && status >= 0; j++) {
+      pathCache_t *entry = __atomic_load_n(&slots->slot[j], __ATOMIC_ACQUIRE);
+      if (entry == NULL || entry == PATH_CACHE_TOMBSTONE) continue;
+      if (curTime >= entry->cachedTime + table->ttl) continue;
+      status = func(entry, arg);
+    }
+  }
+  pathCacheReadUnlock();
+  return status < 0 ? status : 0;
+}
+
+/*
+ * returns >0 if the table holds more than pct percent of its entry or
+ * byte budget
+ */
+static int path_cache_over(pathCacheTable_t *table, int pct) {
+  unsigned long numEntries = __atomic_load_n(&table->numEntries, __ATOMIC_RELAXED);
+  unsigned long numBytes = __atomic_load_n(&table->numBytes, __ATOMIC_RELAXED);
+
+  if (table->maxEntries > 0 && numEntries * 100 > table->maxEntries * pct) {
+    return 1;
+  }
+  if (table->maxBytes > 0 && numBytes * 100 > table->maxBytes * pct) {
+    return 1;
+  }
+  return 0;
+}
+
+int pathCacheOverBudget(pathCacheTable_t *table) {
+  return path_cache_over(table, 100);
+}
+
+/*
+ * Evicts entries from the table until it is below PATH_CACHE_LOW_WATER_PCT
+ * of its budget.  The CLOCK hand sweeps all shards in turn: expired entries
+ * are always evicted, entries that were hit since the last sweep get a second
+ * chance, and everything else is evicted.
+ * Evicted entries are pushed on to *victims for the caller to retire.
+ * Returns the number of entries evicted.
+ */
+int evictPathCache(pathCacheTable_t *table, pathCache_t **victims) {
+  pathCache_t *entry;
+  uint curTime = time(0);
+  int visited = 0;
+  int evicted = 0;
+
+  pthread_mutex_lock(&table->clockLock);
+  /* two full sweeps are enough to clear every reference bit once */
+  while (path_cache_over(table, PATH_CACHE_LOW_WATER_PCT) &&
+	 visited < 2 * NUM_PATH_CACHE_SHARD) {
+    pathCacheShard_t *shard = &table->shard[table->clockShard];
+    pathCacheSlots_t *slots;
+    unsigned int i;
+
+    pthread_mutex_lock(&shard->lock);
+    slots = shard->slots;
+    i = table->clockSlot < slots->numSlots ? table->clockSlot : 0;
+    for (; i < slots->numSlots; i++) {
+      entry = slots->slot[i];
+      if (entry == NULL || entry == PATH_CACHE_TOMBSTONE) continue;
+      if (__atomic_load_n(&entry->referenced, __ATOMIC_RELAXED) &&
+	  curTime < entry->cachedTime + table->ttl) {
+	__atomic_store_n(&entry->referenced, 0, __ATOMIC_RELAXED);
+	continue;
+      }
+      entry = path_cache_shard_remove(table, shard, i);
+      entry->next = *victims;
+      *victims = entry;
+      evicted++;
+      if (!path_cache_over(table, PATH_CACHE_LOW_WATER_PCT)) {
+	i++;
+	break;
+      }
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    if (i >= slots->numSlots) {
+      /* finished this shard, move the hand on to the next one */
+      table->clockShard = (table->clockShard + 1) % NUM_PATH_CACHE_SHARD;
+      table->clockSlot = 0;
+      visited++;
+    } else {
+      table->clockSlot = i;
+    }
+  }
+  pthread_mutex_unlock(&table->clockLock);
+
+  if (evicted > 0) {
+    rodsLog(LOG_DEBUG, "evictPathCache: evicted %d entries from %s (%lu entries, %lu bytes remain)",
+	    evicted, table->name, __atomic_load_n(&table->numEntries, __ATOMIC_RELAXED),
+	    __atomic_load_n(&table->numBytes, __ATOMIC_RELAXED));
+  }
+  return evicted;
+}
+
+/*
+ * Removes all expired entries from the table, a few hundred slots at a time
+ * so that lookups in the same shard are not held up for long.
+ * Expired entries are pushed on to *victims for the caller to retire.
+ * Returns the number of entries expired.
+ */
+int expirePathCache(pathCacheTable_t *table, pathCache_t **victims) {
+  uint curTime = time(0);
+  int expired = 0;
+  int s;
+
+  for (s = 0; s < NUM_PATH_CACHE_SHARD; s++) {
+    pathCacheShard_t *shard = &table->shard[s];
+    unsigned int i = 0;
+
+    do {
+      unsigned int end;
+      pthread_mutex_lock(&shard->lock);
+      /* the shard may have been resized since we last held the lock */
+      end = i + PATH_CACHE_EXPIRE_BATCH < shard->slots->numSlots ? i + PATH_CACHE_EXPIRE_BATCH : shard->slots->numSlots;
+      for (; i < end; i++) {
+	pathCache_t *entry = shard->slots->slot[i];
+	if (entry == NULL || entry == PATH_CACHE_TOMBSTONE) continue;
+	if (curTime >= entry->cachedTime + table->ttl) {
+	  entry = path_cache_shard_remove(table, shard, i);
+	  entry->next = *victims;
+	  *victims = entry;
+	  expired++;
+	}
+      }
+      end = shard->slots->numSlots;
+      pthread_mutex_unlock(&shard->lock);
+      if (i >= end) break;
+    } while (1);
+  }
+
+  if (expired > 0) {
+    rodsLog(LOG_DEBUG, "expirePathCache: expired %d entries from %s", expired, table->name);
+  }
+  return expired;
+}
+
+/*
+ * Registers a table to be looked after by the path cache manager thread
+ */
+int managePathCache(pathCacheTable_t *table) {
+  pthread_mutex_lock(&PathCacheManagerLock);
+  if (NumManagedPathCache >= MAX_MANAGED_PATH_CACHE) {
+    pthread_mutex_unlock(&PathCacheManagerLock);
+    rodsLog(LOG_ERROR, "managePathCache: cannot manage more than %d tables", MAX_MANAGED_PATH_CACHE);
+    return SYS_INTERNAL_NULL_INPUT_ERR;
+  }
+  ManagedPathCache[NumManagedPathCache++] = table;
+  pthread_mutex_unlock(&PathCacheManagerLock);
+  return 0;
+}
+
+/*
+ * Wakes up the path cache manager early (e.g. because a table went over
+ * its budget)
+ */
+int signalPathCacheManager() {
+  pthread_mutex_lock(&PathCacheManagerLock);
+  pthread_cond_signal(&PathCacheManagerCond);
+  pthread_mutex_unlock(&PathCacheManagerLock);
+  return 0;
+}
+
+/*
+ * Path cache maintenance thread: expires, evicts and frees cache entries
+ * (including the unlink of local cache files) so that none of that has to
+ * happen on the request path.
+ */
+static void *path_cache_manager(void *arg) {
+  struct timespec timeout;
+  uint lastExpire = 0;
+  unsigned long pending;
+  int i;
+
+  (void) arg;
+  while (1) {
+    pathCache_t *victims = NULL;
+    uint curTime = time(0);
+    int numTables;
+
+    pthread_mutex_lock(&PathCacheManagerLock);
+    numTables = NumManagedPathCache;
+    pthread_mutex_unlock(&PathCacheManagerLock);
+
+    for (i = 0; i < numTables; i++) {
+      pathCacheTable_t *table = ManagedPathCache[i];
+      if (curTime >= lastExpire + PATH_CACHE_MANAGER_SLEEP_TIME) {
+	expirePathCache(table, &victims);
+      }
+      if (pathCacheOverBudget(table)) {
+	evictPathCache(table, &victims);
+      }
+    }
+    if (curTime >= lastExpire + PATH_CACHE_MANAGER_SLEEP_TIME) {
+      lastExpire = curTime;
+    }
+    retirePathCacheList(victims);
+    pending = path_cache_reclaim();
+    syncPathCacheFile();
+
+    bzero(&timeout, sizeof(timeout));
+    /* come back soon if there is retired memory waiting for readers */
+    timeout.tv_sec = time(0) + (pending > 0 ? 1 : PATH_CACHE_MANAGER_SLEEP_TIME);
+    pthread_mutex_lock(&PathCacheManagerLock);
+    pthread_cond_timedwait(&PathCacheManagerCond, &PathCacheManagerLock, &timeout);
+    pthread_mutex_unlock(&PathCacheManagerLock);
+  }
+  return NULL;
+}
+
+/*
+ * Starts the path cache manager thread.  Must be called after FUSE has
+ * daemonized (i.e. from iquest_fuse_init), otherwise the thread is lost
+ * in the fork.
+ */
+int startPathCacheManager() {
+  int status;
+
+  if (PathCacheManagerStarted) return 0;
+  status = pthread_create(&PathCacheManagerThr, NULL, path_cache_manager, NULL);
+  if (status != 0) {
+    rodsLog(LOG_ERROR, "startPathCacheManager: pthread_create failure, status = %d", status);
+    return SYS_INTERNAL_NULL_INPUT_ERR;
+  }
+  PathCacheManagerStarted = 1;
+  return 0;
+}
+
+/*
+ * Removes in_path, writing the removal to the cache file (under the shard
+ * lock, as for path_cache_add) if logIt is set.
+ * Returns 1 if it was cached and 0 if not.
+ */
+static int
+path_cache_rm (char *in_path, pathCacheTable_t *table, int logIt)
+{
+    pathCacheShard_t *shard;
+    pathCache_t *tmpPathCache = NULL;
+    uint64_t hash;
+    int i;
+
+    if (in_path == NULL) return 0;
+    hash = iquest_path_hash (in_path);
+    shard = path_cache_shard (table, hash);
+
+    pthread_mutex_lock (&shard->lock);
+    i = path_cache_shard_find (shard, in_path, hash);
+    if (i >= 0) {
+	tmpPathCache = path_cache_shard_remove (table, shard, i);
+	if (logIt) logPathCacheRm (table, in_path);
+    }
+    pthread_mutex_unlock (&shard->lock);
+
+    if (tmpPathCache == NULL) return 0;
+    path_cache_retire (tmpPathCache);
+    if (__atomic_load_n (&NumRetiredPathCache, __ATOMIC_RELAXED) > PATH_CACHE_RETIRE_HIGH_WATER) {
+	signalPathCacheManager ();
+    }
+    return 1;
+}
+
+int
+rmPathFromCache (char *in_path, pathCacheTable_t *table)
+{
+    return (path_cache_rm (in_path, table,
+      table->persistId != PATH_CACHE_FILE_NONE));
+}
+
+/*
+ * Removes in_path without writing the removal to the cache file.
+ * Returns 1 if it was cached and 0 if not.
+ */
+int
+_rmPathFromCache (char *in_path, pathCacheTable_t *table)
+{
+    return (path_cache_rm (in_path, table, 0));
+}
+
+int
+freePathCache (pathCache_t *tmpPathCache)
+{
+    if (tmpPathCache == NULL) return 0;
+    if (tmpPathCache->locCachePath != NULL) {
+	if (tmpPathCache->locCacheState != NO_FILE_CACHE) {
+	    freeFileCache (tmpPathCache);
+	} else {
+	    /* the file itself was handed over to a newer entry */
+	    free (tmpPathCache->locCachePath);
+	}
+    }
+    /* filePath shares the allocation of the entry */
+    free (tmpPathCache);
+    return (0);
+}
+
+int
+freeFileCache (pathCache_t *tmpPathCache)
+{
+    unlink (tmpPathCache->locCachePath);
+    free (tmpPathCache->locCachePath);
+    tmpPathCache->locCachePath = NULL;
+    tmpPathCache->locCacheState = NO_FILE_CACHE;
+    return 0;
+}
@@ -0,0 +1,504 @@
+/*****************************************************************************
+ * Copyright (c) 2012 Genome Research Ltd.
+ *
+ * Author: Joshua C. Randall <jcrandall@alum.mit.edu>
+ *
+ * This file is part of iquestFuse.
+ *
+ * iquestFuse is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Implementation of the persistent path cache file.
+ *
+ * Request threads only ever append records to an in-memory buffer; all
+ * file I/O after startup is done by the path cache manager thread.  A
+ * record that is lost (crash, full buffer) only costs a cache miss after
+ * the next remount, and a torn record at the end of the file is detected
+ * by its check value and discarded.
+ *****************************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+
+#include "iquest_fuse.h"
+#include "iquest_fuse_lib.h"
+#include "iquest_fuse_cache.h"
+#include "iquest_fuse_cache_file.h"
+
+#define PATH_CACHE_FILE_MAX_RECORD	(sizeof(pathCacheFileRecord_t) + MAX_NAME_LEN + 8)
+#define PATH_CACHE_FILE_WRITE_BUF	(1024*1024)
+
+static pthread_mutex_t PathCacheFileLock = PTHREAD_MUTEX_INITIALIZER;	/* pending records */
+static pthread_mutex_t PathCacheFileIoLock = PTHREAD_MUTEX_INITIALIZER;	/* the file itself */
+static int PathCacheFileEnabled = 0;
+static char *PathCacheFilePath = NULL;
+static int PathCacheFileFd = -1;
+static uint64_t PathCacheFileConfHash = 0;
+static off_t PathCacheFileSize = 0;
+static off_t PathCacheFileCompactedSize = 0;
+static pathCacheTable_t *PathCacheFileTable[3];	/* indexed by persistId */
+
+static char *PathCacheFilePending = NULL;
+static size_t PathCacheFilePendingLen = 0;
+static size_t PathCacheFilePendingSize = 0;
+static int PathCacheFileOverflow = 0;
+
+typedef struct PathCacheFileWriter {
+  int fd;
+  char *buf;
+  size_t len;
+  off_t size;
+  int table;	/* persistId of the table being written */
+  int status;
+} pathCacheFileWriter_t;
+
+static uint32_t path_cache_file_check(const void *data, size_t len) {
+  const unsigned char *p = (const unsigned char *) data;
+  uint32_t h = 2166136261U;
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    h ^= p[i];
+    h *= 16777619U;
+  }
+  return h;
+}
+
+static int path_cache_file_write_all(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return -errno;
+    }
+    buf += n;
+    len -= n;
+  }
+  return 0;
+}
+
+/*
+ * identifies what the cached paths mean: the same path can be a different
+ * object under a different server, zone, user or query configuration
+ */
+static uint64_t path_cache_file_conf_hash(iquest_fuse_t *iqf) {
+  char buf[MAX_NAME_LEN * 4];
+
+  snprintf(buf, sizeof(buf), "%s\n%d\n%s\n%s\n%s\n%s\n%s\n%s\n%d",
+	   iqf->rods_env->rodsHost, iqf->rods_env->rodsPort,
+	   iqf->rods_env->rodsZone, iqf->rods_env->rodsUserName,
+	   iqf->conf->base_query != NULL ? iqf->conf->base_query : "",
+	   iqf->conf->irods_cwd != NULL ? iqf->conf->irods_cwd : "",
+	   iqf->conf->indicator, iqf->conf->slash_remap,
+	   iqf->conf->show_indicator);
+  return iquest_path_hash(buf);
+}
+
+/*
+ * encodes one record into buf (which must hold PATH_CACHE_FILE_MAX_RECORD
+ * bytes) and returns its size, or 0 if the path is too long
+ */
+static size_t path_cache_file_record(char *buf, int op, int table, const char *path, struct stat *stbuf, uint cachedTime) {
+  pathCacheFileRecord_t *rec = (pathCacheFileRecord_t *) buf;
+  size_t pathLen = strlen(path);
+  size_t recSize = (sizeof(pathCacheFileRecord_t) + pathLen + 1 + 7) & ~(size_t) 7;
+
+  if (pathLen >= MAX_NAME_LEN) return 0;
+  bzero(buf, recSize);
+  rec->recSize = recSize;
+  rec->op = op;
+  rec->table = table;
+  rec->pathLen = pathLen;
+  rec->cachedTime = cachedTime;
+  if (stbuf != NULL) {
+    rec->ino = stbuf->st_ino;
+    rec->size = stbuf->st_size;
+    rec->mode = stbuf->st_mode;
+    rec->nlink = stbuf->st_nlink;
+    rec->atime = stbuf->st_atime;
+    rec->mtime = stbuf->st_mtime;
+    rec->ctime = stbuf->st_ctime;
+  }
+  memcpy(rec + 1, path, pathLen);
+  rec->check = path_cache_file_check(buf, recSize);
+  return recSize;
+}
+
+static void path_cache_file_stat(pathCacheFileRecord_t *rec, struct stat *stbuf) {
+  bzero(stbuf, sizeof(struct stat));
+  if (rec->mode == 0) return;	/* negative entry */
+  stbuf->st_mode = rec->mode;
+  stbuf->st_size = rec->size;
+  stbuf->st_nlink = rec->nlink;
+  stbuf->st_ino = rec->ino;
+  stbuf->st_atime = rec->atime;
+  stbuf->st_mtime = rec->mtime;
+  stbuf->st_ctime = rec->ctime;
+  if (S_ISREG(stbuf->st_mode)) {
+    stbuf->st_blksize = IQF_FILE_BLOCK_SIZE;
+    stbuf->st_blocks = (stbuf->st_size / IQF_FILE_BLOCK_SIZE) + 1;
+  }
+  stbuf->st_uid = getuid();
+  stbuf->st_gid = getgid();
+}
+
+/*
+ * returns the record at offset off of a mapped file of size len, or NULL
+ * if there is no complete, intact record there
+ */
+static pathCacheFileRecord_t *path_cache_file_next(char *map, size_t len, size_t off) {
+  pathCacheFileRecord_t *rec = (pathCacheFileRecord_t *) (map + off);
+  uint32_t check;
+
+  if (off + sizeof(pathCacheFileRecord_t) > len) return NULL;
+  if (rec->recSize < sizeof(pathCacheFileRecord_t) + rec->pathLen + 1 ||
+      (rec->recSize & 7) != 0 || rec->recSize > len - off ||
+      rec->pathLen >= MAX_NAME_LEN) {
+    return NULL;
+  }
+  check = rec->check;
+  rec->check = 0;	/* private mapping, so this does not touch the file */
+  if (path_cache_file_check(rec, rec->recSize) != check) return NULL;
+  rec->check = check;
+  if (((char *) (rec + 1))[rec->pathLen] != '\0') return NULL;
+  return rec;
+}
+
+/*
+ * replays a mapped cache file into the tables
+ * returns the number of paths restored
+ */
+static int path_cache_file_replay(char *map, size_t len) {
+  pathCacheFileHeader_t *header = (pathCacheFileHeader_t *) map;
+  pathCacheFileRecord_t *rec;
+  uint curTime = time(0);
+  size_t off;
+  int restored = 0;
+
+  if (len < sizeof(pathCacheFileHeader_t) ||
+      memcmp(header->magic, PATH_CACHE_FILE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != PATH_CACHE_FILE_VERSION ||
+      header->headerSize != sizeof(pathCacheFileHeader_t)) {
+    rodsLog(LOG_NOTICE, "path_cache_file_replay: %s is not a version %d path cache file, ignoring it",
+	    PathCacheFilePath, PATH_CACHE_FILE_VERSION);
+    return 0;
+  }
+  if (header->confHash != PathCacheFileConfHash) {
+    rodsLog(LOG_NOTICE, "path_cache_file_replay: %s was written for a different iRODS environment or query, ignoring it",
+	    PathCacheFilePath);
+    return 0;
+  }
+
+  for (off = sizeof(pathCacheFileHeader_t); (rec = path_cache_file_next(map, len, off)) != NULL; off += rec->recSize) {
+    pathCacheTable_t *table;
+    char *path = (char *) (rec + 1);
+    struct stat stbuf;
+
+    if (rec->table != PATH_CACHE_FILE_STAT && rec->table != PATH_CACHE_FILE_NONEXIST) continue;
+    table = PathCacheFileTable[rec->table];
+    if (rec->op == PATH_CACHE_REC_RM) {
+      restored -= _rmPathFromCache(path, table);
+    } else if (rec->op == PATH_CACHE_REC_ADD) {
+      /* keep the original cache time so that the ttl is not extended */
+      if (curTime >= rec->cachedTime + table->ttl ||
+	  rec->cachedTime > curTime + PATH_CACHE_FILE_MAX_SKEW) {
+	continue;
+      }
+      path_cache_file_stat(rec, &stbuf);
+      if (_addPathToCache(path, table, &stbuf, rec->cachedTime, NULL) == 0) {
+	restored++;
+      }
+    }
+  }
+  if (off < len) {
+    rodsLog(LOG_NOTICE, "path_cache_file_replay: ignoring %lu bytes of incomplete records at the end of %s",
+	    (unsigned long) (len - off), PathCacheFilePath);
+  }
+  return restored;
+}
+
+static void path_cache_file_writer_flush(pathCacheFileWriter_t *writer) {
+  if (writer->status == 0 && writer->len > 0) {
+    writer->status = path_cache_file_write_all(writer->fd, writer->buf, writer->len);
+  }
+  writer->size += writer->len;
+  writer->len = 0;
+}
+
+static int path_cache_file_snapshot_entry(pathCache_t *entry, void *arg) {
+  pathCacheFileWriter_t *writer = (pathCacheFileWriter_t *) arg;
+  size_t recSize;
+
+  if (writer->len + PATH_CACHE_FILE_MAX_RECORD > PATH_CACHE_FILE_WRITE_BUF) {
+    path_cache_file_writer_flush(writer);
+    if (writer->status < 0) return writer->status;
+  }
+  recSize = path_cache_file_record(writer->buf + writer->len, PATH_CACHE_REC_ADD,
+				   writer->table, entry->filePath, &entry->stbuf, entry->cachedTime);
+  writer->len += recSize;
+  return 0;
+}
+
+/*
+ * Rewrites the cache file from the current contents of the tables (which
+ * drops expired, evicted and superseded records) and swaps it into place.
+ * PathCacheFileIoLock must be held.
+ */
+static int path_cache_file_compact(void) {
+  pathCacheFileWriter_t writer;
+  pathCacheFileHeader_t *header;
+  char tmpPath[MAX_NAME_LEN];
+  int id;
+
+  snprintf(tmpPath, sizeof(tmpPath), "%s.%d", PathCacheFilePath, (int) getpid());
+  bzero(&writer, sizeof(writer));
+  writer.fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (writer.fd < 0) {
+    rodsLog(LOG_ERROR, "path_cache_file_compact: could not create %s, errno = %d", tmpPath, errno);
+    return -errno;
+  }
+  /* keep other mounts out of the new file as well */
+  flock(writer.fd, LOCK_EX | LOCK_NB);
+  writer.buf = (char *) malloc_and_zero_or_exit(PATH_CACHE_FILE_WRITE_BUF);
+
+  header = (pathCacheFileHeader_t *) writer.buf;
+  memcpy(header->magic, PATH_CACHE_FILE_MAGIC, sizeof(header->magic));
+  header->version = PATH_CACHE_FILE_VERSION;
+  header->headerSize = sizeof(pathCacheFileHeader_t);
+  header->confHash = PathCacheFileConfHash;
+  header->createdTime = time(0);
+  writer.len = sizeof(pathCacheFileHeader_t);
+
+  for (id = PATH_CACHE_FILE_STAT; id <= PATH_CACHE_FILE_NONEXIST && writer.status == 0; id++) {
+    writer.table = id;
+    walkPathCache(PathCacheFileTable[id], path_cache_file_snapshot_entry, &writer);
+  }
+  path_cache_file_writer_flush(&writer);
+  free(writer.buf);
+
+  if (writer.status < 0 || rename(tmpPath, PathCacheFilePath) < 0) {
+    rodsLog(LOG_ERROR, "path_cache_file_compact: could not write %s, status = %d, errno = %d",
+	    tmpPath, writer.status, errno);
+    close(writer.fd);
+    unlink(tmpPath);
+    return writer.status < 0 ? writer.status : -errno;
+  }
+  close(PathCacheFileFd);
+  PathCacheFileFd = writer.fd;
+  PathCacheFileSize = writer.size;
+  PathCacheFileCompactedSize = writer.size;
+  rodsLog(LOG_DEBUG, "path_cache_file_compact: rewrote %s (%lu bytes)",
+	  PathCacheFilePath, (unsigned long) writer.size);
+  return 0;
+}
+
+/*
+ * Opens (creating if necessary) the cache file named by the cache-file
+ * option, loads every still valid path from it into the tables and
+ * starts recording changes to them.  Called from main before fuse_main.
+ * Returns the number of paths loaded, or <0 if the cache file cannot be
+ * used (in which case the mount carries on without it).
+ */
+int openPathCacheFile(iquest_fuse_t *iqf, pathCacheTable_t *statTable, pathCacheTable_t *nonExistTable) {
+  char path[MAX_NAME_LEN];
+  char cwd[MAX_NAME_LEN];
+  struct stat st;
+  char *map;
+  uint maxTtl;
+  int restored = 0;
+  int fd;
+
+  if (iqf->conf->cache_file == NULL) return 0;
+
+  /* fuse_main will chdir to / when it daemonizes */
+  if (iqf->conf->cache_file[0] == '/' || getcwd(cwd, sizeof(cwd)) == NULL) {
+    rstrcpy(path, iqf->conf->cache_file, sizeof(path));
+  } else {
+    snprintf(path, sizeof(path), "%s/%s", cwd, iqf->conf->cache_file);
+  }
+
+  fd = open(path, O_RDWR | O_CREAT, 0600);
+  if (fd < 0) {
+    rodsLog(LOG_ERROR, "openPathCacheFile: could not open %s, errno = %d", path, errno);
+    return -errno;
+  }
+  if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+    rodsLog(LOG_ERROR, "openPathCacheFile: %s is in use by another mount, not using it", path);
+    close(fd);
+    return -EBUSY;
+  }
+  PathCacheFilePath = strdup(path);
+  PathCacheFileFd = fd;
+  PathCacheFileConfHash = path_cache_file_conf_hash(iqf);
+  PathCacheFileTable[PATH_CACHE_FILE_STAT] = statTable;
+  PathCacheFileTable[PATH_CACHE_FILE_NONEXIST] = nonExistTable;
+
+  maxTtl = statTable->ttl > nonExistTable->ttl ? statTable->ttl : nonExistTable->ttl;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    if ((uint) st.st_mtime + maxTtl <= (uint) time(0)) {
+      /* nothing written since everything in it expired */
+      rodsLog(LOG_NOTICE, "openPathCacheFile: %s has expired", path);
+    } else {
+      map = (char *) mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+      if (map == MAP_FAILED) {
+	rodsLog(LOG_ERROR, "openPathCacheFile: could not mmap %s, errno = %d", path, errno);
+      } else {
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	restored = path_cache_file_replay(map, st.st_size);
+	munmap(map, st.st_size);
+      }
+    }
+  }
+
+  /* write out a clean copy, then record changes from here on */
+  pthread_mutex_lock(&PathCacheFileIoLock);
+  if (path_cache_file_compact() < 0) {
+    pthread_mutex_unlock(&PathCacheFileIoLock);
+    close(PathCacheFileFd);
+    PathCacheFileFd = -1;
+    return SYS_INTERNAL_NULL_INPUT_ERR;
+  }
+  pthread_mutex_unlock(&PathCacheFileIoLock);
+  statTable->persistId = PATH_CACHE_FILE_STAT;
+  nonExistTable->persistId = PATH_CACHE_FILE_NONEXIST;
+  __atomic_store_n(&PathCacheFileEnabled, 1, __ATOMIC_RELEASE);
+
+  rodsLog(LOG_NOTICE, "loaded %d cached paths from %s", restored, path);
+  return restored;
+}
+
+static int path_cache_file_append(const char *rec, size_t len) {
+  int wake = 0;
+
+  if (len == 0) return 0;
+  pthread_mutex_lock(&PathCacheFileLock);
+  if (PathCacheFileOverflow) {
+    /* the file will be rewritten from the tables anyway */
+    pthread_mutex_unlock(&PathCacheFileLock);
+    return 0;
+  }
+  if (PathCacheFilePendingLen + len > PATH_CACHE_FILE_MAX_PENDING) {
+    PathCacheFileOverflow = 1;
+    pthread_mutex_unlock(&PathCacheFileLock);
+    signalPathCacheManager();
+    return 0;
+  }
+  if (PathCacheFilePendingLen + len > PathCacheFilePendingSize) {
+    size_t newSize = PathCacheFilePendingSize > 0 ? PathCacheFilePendingSize * 2 : 64 * 1024;
+    char *pending;
+    while (newSize < PathCacheFilePendingLen + len) newSize *= 2;
+    pending = (char *) realloc(PathCacheFilePending, newSize);
+    if (pending == NULL) {
+      PathCacheFileOverflow = 1;
+      pthread_mutex_unlock(&PathCacheFileLock);
+      return SYS_MALLOC_ERR;
+    }
+    PathCacheFilePending = pending;
+    PathCacheFilePendingSize = newSize;
+  }
+  memcpy(PathCacheFilePending + PathCacheFilePendingLen, rec, len);
+  if (PathCacheFilePendingLen < PATH_CACHE_FILE_SIGNAL_PENDING &&
+      PathCacheFilePendingLen + len >= PATH_CACHE_FILE_SIGNAL_PENDING) {
+    wake = 1;
+  }
+  PathCacheFilePendingLen += len;
+  pthread_mutex_unlock(&PathCacheFileLock);
+
+  if (wake) signalPathCacheManager();
+  return 0;
+}
+
+int logPathCacheAdd(pathCacheTable_t *table, const char *path, struct stat *stbuf, uint cachedTime) {
+  char rec[PATH_CACHE_FILE_MAX_RECORD];
+
+  if (!__atomic_load_n(&PathCacheFileEnabled, __ATOMIC_ACQUIRE)) return 0;
+  return path_cache_file_append(rec, path_cache_file_record(rec, PATH_CACHE_REC_ADD, table->persistId, path, stbuf, cachedTime));
+}
+
+int logPathCacheRm(pathCacheTable_t *table, const char *path) {
+  char rec[PATH_CACHE_FILE_MAX_RECORD];
+
+  if (!__atomic_load_n(&PathCacheFileEnabled, __ATOMIC_ACQUIRE)) return 0;
+  return path_cache_file_append(rec, path_cache_file_record(rec, PATH_CACHE_REC_RM, table->persistId, path, NULL, 0));
+}
+
+/*
+ * Appends pending records to the cache file, compacting it if it has grown
+ * too big or records had to be dropped.  Called by the path cache manager.
+ */
+int syncPathCacheFile() {
+  char *pending;
+  size_t pendingLen;
+  int overflow;
+  int status = 0;
+
+  if (!__atomic_load_n(&PathCacheFileEnabled, __ATOMIC_ACQUIRE)) return 0;
+
+  pthread_mutex_lock(&PathCacheFileIoLock);
+  pthread_mutex_lock(&PathCacheFileLock);
+  pending = PathCacheFilePending;
+  pendingLen = PathCacheFilePendingLen;
+  overflow = PathCacheFileOverflow;
+  PathCacheFilePending = NULL;
+  PathCacheFilePendingLen = 0;
+  PathCacheFilePendingSize = 0;
+  PathCacheFileOverflow = 0;
+  pthread_mutex_unlock(&PathCacheFileLock);
+
+  if (!overflow && pendingLen > 0) {
+    status = path_cache_file_write_all(PathCacheFileFd, pending, pendingLen);
+    if (status == 0) PathCacheFileSize += pendingLen;
+  }
+  free(pending);
+
+  if (status == 0 &&
+      (overflow || PathCacheFileSize > 2 * PathCacheFileCompactedSize + PATH_CACHE_FILE_COMPACT_SLACK)) {
+    status = path_cache_file_compact();
+  }
+  if (status < 0) {
+    rodsLog(LOG_ERROR, "syncPathCacheFile: could not update %s, no longer using it, status = %d",
+	    PathCacheFilePath, status);
+    __atomic_store_n(&PathCacheFileEnabled, 0, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&PathCacheFileIoLock);
+  return status;
+}
+
+/*
+ * Writes out anything pending and closes the cache file (at unmount)
+ */
+int closePathCacheFile() {
+  int status;
+
+  status = syncPathCacheFile();
+  __atomic_store_n(&PathCacheFileEnabled, 0, __ATOMIC_RELEASE);
+  pthread_mutex_lock(&PathCacheFileIoLock);
+  if (PathCacheFileFd >= 0) {
+    close(PathCacheFileFd);
+    PathCacheFileFd = -1;
+  }
+  pthread_mutex_unlock(&PathCacheFileIoLock);
+  return status;
+}
@@ -0,0 +1,534 @@
+/*****************************************************************************
+ * Copyright (c) 2012 Genome Research Ltd.
+ *
+ * Author: Joshua C. Randall <jcrandall@alum.mit.edu>
+ *
+ * This file is part of iquestFuse.
+ *
+ * iquestFuse is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Implementation of the iquestFuse iRODS connection pool.
+ *
+ * A caller takes an idle connection if there is one, otherwise an empty
+ * slot to connect (if the limit allows), otherwise shares a connection that an open descriptor
+ * keeps but nobody is using at the moment; failing all three it queues.
+ * Whatever is given back while anyone is queued is handed straight to the
+ * longest waiting, so connections go out in order of asking and none sits
+ * unused while someone waits.  Only queueing takes a lock, and only
+ * releases that find someone queued take it to hand over.
+ *
+ * The conn manager calls manageConnPool every IQF_CONN_MANAGER_SLEEP_TIME
+ * to adjust the limit, disconnect what is no longer needed and probe what
+ * may have broken.
+ *****************************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "iquest_fuse.h"
+#include "iquest_fuse_lib.h"
+#include "iquest_fuse_conn_pool.h"
+
+static void conn_stack_push(connPool_t *pool, uint64_t *top, iquest_fuse_irods_conn_t *conn) {
+  uint64_t old = __atomic_load_n(top, __ATOMIC_ACQUIRE);
+  uint64_t new;
+
+  do {
+    __atomic_store_n(&conn->nextFree, CONN_POOL_TOP_SLOT(old), __ATOMIC_RELAXED);
+    new = ((old >> 32) + 1) << 32 | (uint64_t) (conn->slot + 1);
+  } while (!__atomic_compare_exchange_n(top, &old, new, 1, __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE));
+}
+
+static iquest_fuse_irods_conn_t *conn_stack_pop(connPool_t *pool, uint64_t *top) {
+  uint64_t old = __atomic_load_n(top, __ATOMIC_ACQUIRE);
+  uint64_t new;
+  iquest_fuse_irods_conn_t *conn;
+
+  do {
+    if (CONN_POOL_TOP_SLOT(old) == 0) {
+      return NULL;
+    }
+    /* nextFree may be stale if someone else popped it meanwhile, but then
+     * the tag has moved on and the swap fails */
+    conn = &pool->conn[CONN_POOL_TOP_SLOT(old) - 1];
+    new = ((old >> 32) + 1) << 32 | __atomic_load_n(&conn->nextFree, __ATOMIC_RELAXED);
+  } while (!__atomic_compare_exchange_n(top, &old, new, 1, __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE));
+  return conn;
+}
+
+connPool_t *newConnPool(iquest_fuse_t *iqf, const char *name, int minConns, int capacity, int (*checkConn)(iquest_fuse_irods_conn_t *conn)) {
+  connPool_t *pool;
+  int i;
+
+  pool = (connPool_t *) calloc(1, sizeof(connPool_t));
+  if (pool != NULL) {
+    pool->conn = (iquest_fuse_irods_conn_t *) calloc(capacity, sizeof(iquest_fuse_irods_conn_t));
+    pool->reap = (iquest_fuse_irods_conn_t **) calloc(capacity, sizeof(iquest_fuse_irods_conn_t *));
+    pool->probe = (iquest_fuse_irods_conn_t **) calloc(capacity, sizeof(iquest_fuse_irods_conn_t *));
+  }
+  if (pool == NULL || pool->conn == NULL || pool->reap == NULL || pool->probe == NULL) {
+    rodsLog(LOG_ERROR, "newConnPool: could not allocate %d connection slots for %s", capacity, name);
+    if (pool != NULL) {
+      free(pool->conn);
+      free(pool->reap);
+      free(pool->probe);
+      free(pool);
+    }
+    return NULL;
+  }
+  pool->iqf = iqf;
+  pool->name = name;
+  pool->capacity = capacity;
+  pool->minConns = minConns;
+  pool->checkConn = checkConn;
+  /* start half way, and let demand take it from there */
+  pool->limit = (capacity + 1) / 2;
+  if (pool->limit < minConns) {
+    pool->limit = minConns;
+  }
+  pthread_mutex_init(&pool->waitLock, NULL);
+  /* push in reverse so that slot 0 is used first */
+  for (i = capacity - 1; i >= 0; i--) {
+    pool->conn[i].slot = i;
+    pool->conn[i].pool = pool;
+    pool->conn[i].iqf = iqf;
+    pool->conn[i].state = CONN_POOL_IDLE;
+    pthread_mutex_init(&pool->conn[i].lock, NULL);
+    conn_stack_push(pool, &pool->emptyTop, &pool->conn[i]);
+  }
+  return pool;
+}
+
+/* an idle connection, or an empty slot if the limit allows */
+static iquest_fuse_irods_conn_t *conn_pool_try_take(connPool_t *pool) {
+  iquest_fuse_irods_conn_t *conn;
+  int numConns;
+
+  conn = conn_stack_pop(pool, &pool->idleTop);
+  if (conn != NULL) {
+    __atomic_store_n(&conn->state, 1, __ATOMIC_RELEASE);
+    return conn;
+  }
+
+  /* count it in before taking the slot, so the limit holds */
+  numConns = __atomic_load_n(&pool->numConns, __ATOMIC_RELAXED);
+  while (numConns < __atomic_load_n(&pool->limit, __ATOMIC_RELAXED)) {
+    if (__atomic_compare_exchange_n(&pool->numConns, &numConns, numConns + 1, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+      conn = conn_stack_pop(pool, &pool->emptyTop);
+      if (conn != NULL) {
+	__atomic_store_n(&conn->state, 1, __ATOMIC_RELEASE);
+	return conn;
+      }
+      /* one being given back has been counted out but not pushed yet */
+      __atomic_sub_fetch(&pool->numConns, 1, __ATOMIC_RELAXED);
+      break;
+    }
+  }
+  return NULL;
+}
+
+static iquest_fuse_irods_conn_t *conn_pool_try_acquire(connPool_t *pool) {
+  iquest_fuse_irods_conn_t *conn;
+  int old;
+  int i;
+
+  conn = conn_pool_try_take(pool);
+  if (conn != NULL) {
+    return conn;
+  }
+
+  /* as many as allowed are connected and in use: share one that an open descriptor
+   * keeps but that nobody is using right now */
+  for (i = 0; i < pool->capacity; i++) {
+    conn = &pool->conn[i];
+    old = __atomic_load_n(&conn->state, __ATOMIC_ACQUIRE);
+    if ((old & CONN_POOL_IDLE) == 0 && (old & CONN_POOL_DESC_MASK) != 0 &&
+	(old & CONN_POOL_BUSY_MASK) == 0 &&
+	__atomic_compare_exchange_n(&conn->state, &old, old + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      return conn;
+    }
+  }
+  return NULL;
+}
+
+/* hands whatever can be had to the longest waiting; waitLock must be held */
+static void conn_pool_dispatch(connPool_t *pool) {
+  connWaiter_t *waiter;
+  iquest_fuse_irods_conn_t *conn;
+
+  while ((waiter = pool->waitHead) != NULL && (conn = conn_pool_try_acquire(pool)) != NULL) {
+    pool->waitHead = waiter->next;
+    if (pool->waitHead == NULL) {
+      pool->waitTail = NULL;
+    }
+    __atomic_sub_fetch(&pool->numWaiting, 1, __ATOMIC_SEQ_CST);
+    waiter->conn = conn;
+    pthread_cond_signal(&waiter->cond);
+  }
+}
+
+/* called after putting something back (or raising the limit); pairs with
+ * the increment of numWaiting in acquireConn: either the new waiter finds
+ * what was just put back or we find the waiter */
+static void conn_pool_wake(connPool_t *pool) {
+  if (__atomic_load_n(&pool->numWaiting, __ATOMIC_SEQ_CST) > 0) {
+    pthread_mutex_lock(&pool->waitLock);
+    conn_pool_dispatch(pool);
+    pthread_mutex_unlock(&pool->waitLock);
+  }
+}
+
+/*
+ * Takes a connection for the caller, waiting up to timeout seconds (or for
+ * ever if 0) for one if the pool is exhausted.  The caller must lock
+ * conn->lock before using it and call releaseConn (after unlocking) when
+ * done.  conn->conn is NULL if the slot has not been connected yet (or its
+ * connection was lost).  Returns NULL if the time ran out.
+ */
+iquest_fuse_irods_conn_t *acquireConn(connPool_t *pool, unsigned int timeout) {
+  iquest_fuse_irods_conn_t *conn;
+  connWaiter_t waiter, *before, *other;
+  pthread_condattr_t condAttr;
+  struct timespec start, end, deadline;
+
+  /* not in front of anyone already waiting */
+  if (__atomic_load_n(&pool->numWaiting, __ATOMIC_SEQ_CST) == 0) {
+    conn = conn_pool_try_acquire(pool);
+    if (conn != NULL) {
+      return conn;
+    }
+  }
+
+  rodsLog(LOG_DEBUG, "acquireConn: all %d %s connections in use, waiting", connPoolLimit(pool), pool->name);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  deadline = start;
+  deadline.tv_sec += timeout;
+  pthread_condattr_init(&condAttr);
+  pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+  pthread_cond_init(&waiter.cond, &condAttr);
+  pthread_condattr_destroy(&condAttr);
+  waiter.conn = NULL;
+  waiter.next = NULL;
+
+  pthread_mutex_lock(&pool->waitLock);
+  if (pool->waitTail != NULL) {
+    pool->waitTail->next = &waiter;
+  } else {
+    pool->waitHead = &waiter;
+  }
+  pool->waitTail = &waiter;
+  __atomic_add_fetch(&pool->numWaiting, 1, __ATOMIC_SEQ_CST);
+  /* in case something was put back before we were counted */
+  conn_pool_dispatch(pool);
+  while (waiter.conn == NULL) {
+    if (timeout == 0) {
+      pthread_cond_wait(&waiter.cond, &pool->waitLock);
+    } else if (pthread_cond_timedwait(&waiter.cond, &pool->waitLock, &deadline) == ETIMEDOUT &&
+	       waiter.conn == NULL) {
+      /* give up our place */
+      for (before = NULL, other = pool->waitHead; other != &waiter; other = other->next) {
+	before = other;
+      }
+      if (before == NULL) {
+	pool->waitHead = waiter.next;
+      } else {
+	before->next = waiter.next;
+      }
+      if (pool->waitTail == &waiter) {
+	pool->waitTail = before;
+      }
+      __atomic_sub_fetch(&pool->numWaiting, 1, __ATOMIC_SEQ_CST);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&pool->waitLock);
+  pthread_cond_destroy(&waiter.cond);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  __atomic_add_fetch(&pool->numWaits, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&pool->waitUsecs, (end.tv_sec - start.tv_sec) * 1000000 +
+		     (end.tv_nsec - start.tv_nsec) / 1000, __ATOMIC_RELAXED);
+  if (waiter.conn == NULL) {
+    rodsLog(LOG_ERROR, "acquireConn: no %s connection free after %u secs", pool->name, timeout);
+  }
+  return waiter.conn;
+}
+
+/*
+ * Takes a connection that nobody else is using, without waiting: an idle
+ * one or an empty slot within the limit, and only if nobody is queued.
+ * Never shares one that an open descriptor keeps.  For work that can do
+ * without (read-ahead); used and given back as for acquireConn.
+ */
+iquest_fuse_irods_conn_t *tryAcquireSpareConn(connPool_t *pool) {
+  if (__atomic_load_n(&pool->numWaiting, __ATOMIC_SEQ_CST) > 0) {
+    return NULL;
+  }
+  return conn_pool_try_take(pool);
+}
+
+/* callers queued for a connection */
+int connPoolWaiting(connPool_t *pool) {
+  return __atomic_load_n(&pool->numWaiting, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * Takes another use of a connection that the caller knows to be alive,
+ * i.e. one bound to an open descriptor.
+ */
+void holdConn(iquest_fuse_irods_conn_t *conn) {
+  __atomic_add_fetch(&conn->state, 1, __ATOMIC_ACQ_REL);
+}
+
+void bindConnDesc(iquest_fuse_irods_conn_t *conn) {
+  __atomic_add_fetch(&conn->state, CONN_POOL_DESC_ONE, __ATOMIC_ACQ_REL);
+}
+
+/* puts an unused connection back on the right stack */
+static void conn_pool_put(connPool_t *pool, iquest_fuse_irods_conn_t *conn) {
+  if (conn->conn == NULL) {
+    __atomic_sub_fetch(&pool->numConns, 1, __ATOMIC_RELAXED);
+    conn_stack_push(pool, &pool->emptyTop, conn);
+  } else {
+    conn_stack_push(pool, &pool->idleTop, conn);
+  }
+  conn_pool_wake(pool);
+}
+
+/*
+ * Drops delta from the state word, putting the connection back on a stack
+ * if that leaves it unused.  Returns 1 if it did so.
+ */
+static int conn_state_drop(iquest_fuse_irods_conn_t *conn, int delta) {
+  connPool_t *pool = conn->pool;
+  int old = __atomic_load_n(&conn->state, __ATOMIC_ACQUIRE);
+  int new;
+
+  do {
+    new = old - delta;
+    if (new == 0) {
+      new = CONN_POOL_IDLE;
+    }
+  } while (!__atomic_compare_exchange_n(&conn->state, &old, new, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+  if (new != CONN_POOL_IDLE) {
+    if ((new & CONN_POOL_BUSY_MASK) == 0) {
+      /* a descriptor still keeps it, but it can be shared now */
+      conn_pool_wake(pool);
+    }
+    return 0;
+  }
+  /* nobody else can reach it until it is popped again */
+  conn_pool_put(pool, conn);
+  return 1;
+}
+
+/* gives back a use of conn taken by acquireConn or holdConn */
+int releaseConn(iquest_fuse_irods_conn_t *conn) {
+  __atomic_store_n(&conn->actTime, time(NULL), __ATOMIC_RELAXED);
+  return conn_state_drop(conn, 1);
+}
+
+/* unbinds conn from a descriptor being freed */
+int unbindConnDesc(iquest_fuse_irods_conn_t *conn) {
+  __atomic_store_n(&conn->actTime, time(NULL), __ATOMIC_RELAXED);
+  return conn_state_drop(conn, CONN_POOL_DESC_ONE);
+}
+
+/* the number of slots with a connection (or being connected) */
+int countConnPool(connPool_t *pool) {
+  return __atomic_load_n(&pool->numConns, __ATOMIC_RELAXED);
+}
+
+/* the number of connections allowed at the moment */
+int connPoolLimit(connPool_t *pool) {
+  return __atomic_load_n(&pool->limit, __ATOMIC_RELAXED);
+}
+
+/*
+ * Adjusts the limit to demand, then disconnects idle connections beyond
+ * it (least recently used first) and, down to the pool's minimum, those
+ * that have not been used for idleTimeout seconds.  The rest are probed if
+ * they have not been known to work for a while (or may have broken).  Must
+ * only be called from one thread at a time.  Returns the number
+ * disconnected.
+ */
+int manageConnPool(connPool_t *pool, time_t idleTimeout) {
+  iquest_fuse_irods_conn_t *conn;
+  time_t curTime = time(NULL);
+  unsigned long waitUsecs;
+  int limit = pool->limit;
+  int numIdle = 0;
+  int numReaped = 0;
+  int numProbe = 0;
+  int numConns;
+  int probeAll;
+  int waited;
+  int i;
+
+  waitUsecs = __atomic_load_n(&pool->waitUsecs, __ATOMIC_RELAXED) - pool->lastWaitUsecs;
+  pool->lastWaitUsecs += waitUsecs;
+  waited = waitUsecs > CONN_POOL_GROW_WAIT_USECS ||
+    __atomic_load_n(&pool->numWaiting, __ATOMIC_SEQ_CST) > 0;
+  if (waited && limit < pool->capacity) {
+    limit = limit * 2 < pool->capacity ? limit * 2 : pool->capacity;
+    rodsLog(LOG_DEBUG, "manageConnPool: callers waited %lu usecs for a %s connection, raising limit to %d",
+	    waitUsecs, pool->name, limit);
+    __atomic_store_n(&pool->limit, limit, __ATOMIC_RELAXED);
+    pool->idleSince = 0;
+    /* they can connect now */
+    conn_pool_wake(pool);
+  }
+
+  probeAll = __atomic_exchange_n(&pool->suspect, 0, __ATOMIC_ACQ_REL);
+
+  /* take them all off the stack, most recently used first */
+  while ((conn = conn_stack_pop(pool, &pool->idleTop)) != NULL) {
+    pool->reap[numIdle++] = conn;
+  }
+  numConns = countConnPool(pool);
+
+  if (numIdle == 0 || waited) {
+    pool->idleSince = 0;
+  } else if (pool->idleSince == 0) {
+    pool->idleSince = curTime;
+  } else if (curTime - pool->idleSince >= CONN_POOL_SHRINK_DELAY && limit > pool->minConns) {
+    /* a limit above what has been connected means nothing */
+    limit = (numConns < limit ? numConns : limit) - 1;
+    if (limit < pool->minConns) {
+      limit = pool->minConns;
+    }
+    rodsLog(LOG_DEBUG, "manageConnPool: %d %s connections idle, lowering limit to %d", numIdle, pool->name, limit);
+    __atomic_store_n(&pool->limit, limit, __ATOMIC_RELAXED);
+    pool->idleSince = curTime;
+  }
+
+  for (i = numIdle - 1; i >= 0; i--) {
+    conn = pool->reap[i];
+    if (numConns - numReaped > limit ||
+	(numConns - numReaped > pool->minConns &&
+	 curTime - __atomic_load_n(&conn->actTime, __ATOMIC_RELAXED) > idleTimeout)) {
+      numReaped++;
+    } else if (pool->checkConn != NULL &&
+	       (probeAll ||
+		(curTime - conn->checkTime >= CONN_POOL_PROBE_INTERVAL &&
+		 curTime - __atomic_load_n(&conn->actTime, __ATOMIC_RELAXED) >= CONN_POOL_PROBE_INTERVAL))) {
+      /* (one in use lately has worked, as far as we know) */
+      pool->probe[numProbe++] = conn;
+      pool->reap[i] = NULL;
+    } else {
+      /* put the rest back as they were */
+      conn_stack_push(pool, &pool->idleTop, conn);
+      pool->reap[i] = NULL;
+    }
+  }
+  /* disconnect after putting the others back, so they are not missed
+   * for long */
+  for (i = 0; i < numIdle; i++) {
+    conn = pool->reap[i];
+    if (conn == NULL) continue;
+    if (conn->conn != NULL) {
+      rcDisconnect(conn->conn);
+      conn->conn = NULL;
+    }
+    __atomic_sub_fetch(&pool->numConns, 1, __ATOMIC_RELAXED);
+    conn_stack_push(pool, &pool->emptyTop, conn);
+  }
+  if (numReaped > 0) {
+    rodsLog(LOG_DEBUG, "manageConnPool: disconnected %d idle %s connections", numReaped, pool->name);
+    conn_pool_wake(pool);
+  }
+
+  /* one at a time, so the others can be had meanwhile */
+  for (i = 0; i < numProbe; i++) {
+    conn = pool->probe[i];
+    if (pool->checkConn(conn) == 0) {
+      conn->checkTime = time(NULL);
+    }
+    conn_pool_put(pool, conn);
+  }
+  return numReaped;
+}
+
+/* a connection was found broken, so the idle ones may be too */
+void suspectConnPool(connPool_t *pool) {
+  __atomic_store_n(&pool->suspect, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Whether to attempt a connection now.  While connections have been
+ * failing, only one caller gets to try each time the backoff runs out;
+ * everyone else is told not to bother.
+ */
+int mayConnect(connPool_t *pool) {
+  time_t retryTime = __atomic_load_n(&pool->retryTime, __ATOMIC_ACQUIRE);
+  time_t curTime;
+
+  if (retryTime == 0) {
+    return 1;
+  }
+  curTime = time(NULL);
+  if (curTime < retryTime) {
+    return 0;
+  }
+  /* keep the others out until this attempt has had its chance */
+  return __atomic_compare_exchange_n(&pool->retryTime, &retryTime, curTime + CONN_POOL_MAX_BACKOFF, 0,
+				     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+/* records whether an attempt to connect succeeded */
+void connectDone(connPool_t *pool, int ok) {
+  int backoff;
+
+  if (ok) {
+    if (__atomic_exchange_n(&pool->retryTime, 0, __ATOMIC_ACQ_REL) != 0) {
+      rodsLog(LOG_NOTICE, "connectDone: %s connections to iRODS working again", pool->name);
+    }
+    __atomic_store_n(&pool->backoff, 0, __ATOMIC_RELAXED);
+    return;
+  }
+  backoff = __atomic_load_n(&pool->backoff, __ATOMIC_RELAXED) * 2;
+  if (backoff < CONN_POOL_MIN_BACKOFF) {
+    backoff = CONN_POOL_MIN_BACKOFF;
+  } else if (backoff > CONN_POOL_MAX_BACKOFF) {
+    backoff = CONN_POOL_MAX_BACKOFF;
+  }
+  __atomic_store_n(&pool->backoff, backoff, __ATOMIC_RELAXED);
+  /* somewhere in the second half of the backoff, so that several mounts
+   * do not come back at once */
+  __atomic_store_n(&pool->retryTime, time(NULL) + (backoff + 1) / 2 + random() % (backoff / 2 + 1),
+		   __ATOMIC_RELEASE);
+  rodsLog(LOG_NOTICE, "connectDone: could not make a %s connection to iRODS, trying again in %d secs or so",
+	  pool->name, backoff);
+}
+
+/* at exit: disconnects every connection, whether in use or not */
+int disconnectConnPool(connPool_t *pool) {
+  int i;
+
+  for (i = 0; i < pool->capacity; i++) {
+    if (pool->conn[i].conn != NULL) {
+      rcDisconnect(pool->conn[i].conn);
+      pool->conn[i].conn = NULL;
+    }
+  }
+  return 0;
+}
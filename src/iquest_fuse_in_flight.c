@@ -0,0 +1,147 @@
+/*****************************************************************************
+ * Copyright (c) 2012 Genome Research Ltd.
+ *
+ * Author: Joshua C. Randall <jcrandall@alum.mit.edu>
+ *
+ * This file is part of iquestFuse.
+ *
+ * iquestFuse is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Implementation of the iquestFuse in-flight request table.
+ *
+ * The first caller to join under a key leads: it makes the request and
+ * hands the result to finishInFlight, which takes the entry out of the
+ * table and wakes everyone who joined in the meantime.  Each of them copies
+ * the result out, and the last to do so frees the entry.
+ *****************************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "iquest_fuse.h"
+#include "iquest_fuse_lib.h"
+#include "iquest_fuse_in_flight.h"
+
+int initInFlightTable(inFlightTable_t *table, const char *name) {
+  bzero(table, sizeof(inFlightTable_t));
+  table->name = name;
+  pthread_mutex_init(&table->lock, NULL);
+  pthread_cond_init(&table->cond, NULL);
+  return 0;
+}
+
+/*
+ * Joins the request for key.
+ * Returns 1 if there was none in flight, in which case the caller must make
+ * the request and pass the result to finishInFlight(*out_flight).
+ * Otherwise waits for it to finish and returns 0 with its result in
+ * *out_status, *out_stbuf and *out_list (any of which may be NULL if not
+ * wanted); a list returned in *out_list must be released by the caller.
+ * Returns <0 (and the caller should just make the request) if out of memory.
+ */
+int joinInFlight(inFlightTable_t *table, const char *key, inFlight_t **out_flight, int *out_status, struct stat *out_stbuf, nameList_t **out_list) {
+  uint64_t hash = iquest_path_hash(key);
+  inFlight_t **slot = &table->slot[hash & (IN_FLIGHT_SLOTS - 1)];
+  inFlight_t *flight;
+
+  *out_flight = NULL;
+  pthread_mutex_lock(&table->lock);
+  for (flight = *slot; flight != NULL; flight = flight->next) {
+    if (flight->hash == hash && strcmp(flight->key, key) == 0) {
+      break;
+    }
+  }
+  if (flight != NULL) {
+    rodsLog(LOG_DEBUG, "joinInFlight: waiting for %s request [%s]", table->name, key);
+    flight->numWaiters++;
+    while (!flight->done) {
+      pthread_cond_wait(&table->cond, &table->lock);
+    }
+    if (out_status != NULL) *out_status = flight->status;
+    if (out_stbuf != NULL) *out_stbuf = flight->stbuf;
+    if (out_list != NULL) {
+      *out_list = flight->list;
+    } else {
+      releaseNameList(flight->list);
+    }
+    if (--flight->numWaiters > 0) {
+      flight = NULL;
+    }
+    pthread_mutex_unlock(&table->lock);
+    if (flight != NULL) {
+      /* the last one out frees it */
+      free(flight->key);
+      free(flight);
+    }
+    return 0;
+  }
+
+  flight = (inFlight_t *) calloc(1, sizeof(inFlight_t));
+  if (flight != NULL) {
+    flight->key = strdup(key);
+  }
+  if (flight == NULL || flight->key == NULL) {
+    pthread_mutex_unlock(&table->lock);
+    rodsLog(LOG_ERROR, "joinInFlight: could not allocate %s request [%s]", table->name, key);
+    free(flight);
+    return SYS_MALLOC_ERR;
+  }
+  flight->hash = hash;
+  flight->next = *slot;
+  *slot = flight;
+  pthread_mutex_unlock(&table->lock);
+  *out_flight = flight;
+  return 1;
+}
+
+/*
+ * Publishes the leader's result and wakes the waiters.  stbuf and list may
+ * be NULL; each waiter gets its own reference to list, and the leader keeps
+ * its own.
+ */
+void finishInFlight(inFlightTable_t *table, inFlight_t *flight, int status, struct stat *stbuf, nameList_t *list) {
+  inFlight_t **fp;
+  int i;
+
+  pthread_mutex_lock(&table->lock);
+  for (fp = &table->slot[flight->hash & (IN_FLIGHT_SLOTS - 1)]; *fp != flight; fp = &(*fp)->next);
+  *fp = flight->next;
+
+  flight->status = status;
+  if (stbuf != NULL) {
+    flight->stbuf = *stbuf;
+  }
+  if (list != NULL) {
+    flight->list = list;
+    for (i = 0; i < flight->numWaiters; i++) {
+      holdNameList(list);
+    }
+  }
+  flight->done = 1;
+  if (flight->numWaiters == 0) {
+    pthread_mutex_unlock(&table->lock);
+    free(flight->key);
+    free(flight);
+    return;
+  }
+  pthread_cond_broadcast(&table->cond);
+  pthread_mutex_unlock(&table->lock);
+}
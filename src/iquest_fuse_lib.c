@@ -48,13 +48,18 @@
 #include "iquest_fuse.h"
 #include "iquest_fuse_operations.h"
 #include "iquest_fuse_lib.h"
+#include "iquest_fuse_read_ahead.h"
 
 #include "miscUtil.h"
 
 //extern iquest_fuse_irods_conn_t *ConnHead;
-extern iFuseDesc_t IFuseDesc[];
-extern pathCacheQue_t NonExistPathArray[];
-extern pathCacheQue_t PathArray[];
+extern pathCacheTable_t NonExistPathArray;
+extern pathCacheTable_t PathArray;
+extern listCacheTable_t CollListCache;
+extern listCacheTable_t AttrListCache;
+extern listCacheTable_t ValueListCache;
+extern listCacheTable_t QueryResultCache;
+extern inFlightTable_t InFlightRequests;
 
 typedef struct {
    int columnId;
@@ -66,8 +71,12 @@ extern columnName_t columnNames[];
 
 #include <pthread.h>
 static pthread_mutex_t DescLock;
-static pthread_mutex_t ConnLock;
-static pthread_mutex_t PathCacheLock;
+/* 
+ * open descriptors by localPath, as chains of descInx through pathNext.
+ * lookups only take the read lock, so they don't serialize on DescLock 
+ */
+static pthread_rwlock_t DescPathLock = PTHREAD_RWLOCK_INITIALIZER;
+static int DescPathIndex[DESC_PATH_INDEX_SLOTS];
 static pthread_mutex_t NewlyCreatedOprLock;
 pthread_t ConnManagerThr;
 pthread_mutex_t ConnManagerLock;
@@ -76,15 +85,26 @@ pthread_cond_t ConnManagerCond;
 char FuseCacheDir[MAX_NAME_LEN];
 
 /* some global variables */
-iFuseDesc_t IFuseDesc[MAX_IFUSE_DESC];
+/* 
+ * chunks are allocated as the table grows and never freed, so a descriptor
+ * stays put once allocated. descInx below NumIFuseDesc have a chunk
+ */
+iFuseDesc_t *IFuseDescChunk[NUM_IFUSE_DESC_CHUNKS];
+static int NumIFuseDesc = 3;	/* 0-2 are never used */
+static int IFuseDescFreeHead = 0;	/* freed descriptors, by nextFree */
 int IFuseDescInuseCnt = 0;
 //iquest_fuse_irods_conn_t *ConnHead = NULL;
-connReqWait_t *ConnReqWaitQue = NULL;
 
 static int ConnManagerStarted = 0;
 
-pathCacheQue_t NonExistPathArray[NUM_PATH_HASH_SLOT];
-pathCacheQue_t PathArray[NUM_PATH_HASH_SLOT];
+pathCacheTable_t NonExistPathArray;
+pathCacheTable_t PathArray;
+listCacheTable_t CollListCache;
+listCacheTable_t AttrListCache;
+listCacheTable_t ValueListCache;
+listCacheTable_t QueryResultCache;
+inFlightTable_t InFlightRequests;
+blockCacheTable_t ObjBlockCache;
 newlyCreatedFile_t NewlyCreatedFile[NUM_NEWLY_CREATED_SLOT];
 char *ReadCacheDir = NULL;
 
@@ -137,25 +157,46 @@ void iquest_fuse_conf_t_destroy(iquest_fuse_conf_t *conf) {
     rodsLog(LOG_DEBUG, "iquest_fuse_conf_t_destroy: calling free(conf->slash_remap)");
     free(conf->slash_remap);
   }
+  if(conf->cache_file != NULL) {
+    rodsLog(LOG_DEBUG, "iquest_fuse_conf_t_destroy: calling free(conf->cache_file)");
+    free(conf->cache_file);
+  }
 }
 
 int get_conn_count(iquest_fuse_t *iqf) {
-    iquest_fuse_irods_conn_t *tmp_irods_conn;
     int connCnt = 0;
-    tmp_irods_conn = iqf->irods_conn_head;
-    while (tmp_irods_conn != NULL) {
-	connCnt++;
-	tmp_irods_conn = tmp_irods_conn->next;
+    int i;
+    for (i = 0; i < IQF_NUM_CONN_CLASSES; i++) {
+	connCnt += countConnPool (iqf->conn_pool[i]);
     }
     return connCnt;
 }
 
 
 int
-initPathCache ()
+initPathCache (iquest_fuse_conf_t *conf)
 {
-    bzero (NonExistPathArray, sizeof (NonExistPathArray));
-    bzero (PathArray, sizeof (PathArray));
+    /* non-existent paths are cheap to look up again, so give them less room */
+    initPathCacheTable (&NonExistPathArray, "NonExistPathArray",
+      conf->neg_cache_ttl, conf->cache_max_entries / 4,
+      conf->cache_max_bytes / 4);
+    initPathCacheTable (&PathArray, "PathArray", conf->cache_ttl,
+      conf->cache_max_entries, conf->cache_max_bytes);
+    managePathCache (&NonExistPathArray);
+    managePathCache (&PathArray);
+    /* collection listings get half of the listing budget, Q/ attribute
+     * listings an eighth and Q/<attr> value listings the rest */
+    initListCacheTable (&CollListCache, "CollListCache", conf->list_cache_ttl,
+      conf->list_cache_max_bytes / 2);
+    initListCacheTable (&AttrListCache, "AttrListCache", conf->list_cache_ttl,
+      conf->list_cache_max_bytes / 8);
+    initListCacheTable (&ValueListCache, "ValueListCache", conf->list_cache_ttl,
+      conf->list_cache_max_bytes / 8 * 3);
+    initListCacheTable (&QueryResultCache, "QueryResultCache", conf->list_cache_ttl,
+      conf->query_cache_max_bytes);
+    initInFlightTable (&InFlightRequests, "InFlightRequests");
+    initBlockCacheTable (&ObjBlockCache, BLOCK_CACHE_BLOCK_SIZE,
+      conf->block_cache_max_bytes);
     bzero (NewlyCreatedFile, sizeof (NewlyCreatedFile));
     return (0);
 }
@@ -184,261 +225,123 @@ isSpecialPath (char *in_path)
 }
 
 int
-matchPathInPathCache (char *in_path, pathCacheQue_t *pathQueArray,
-pathCache_t **out_pathCache)
+initIFuseDesc ()
 {
-    int status;
-    pthread_mutex_lock (&PathCacheLock);
-    status = _matchPathInPathCache (in_path, pathQueArray, out_pathCache);
-    pthread_mutex_unlock (&PathCacheLock);
-    return status;
+    pthread_mutex_init (&DescLock, NULL);
+    pthread_mutex_init (&NewlyCreatedOprLock, NULL);
+    pthread_mutex_init (&ConnManagerLock, NULL);
+    pthread_cond_init (&ConnManagerCond, NULL);
+    return (0);
 }
 
-int
-_matchPathInPathCache (char *in_path, pathCacheQue_t *pathQueArray,
-pathCache_t **out_pathCache)
+static void
+desc_path_link (int descInx)
 {
-    int mysum, myslot;
-    int status;
-    pathCacheQue_t *myque;
-
-    if (in_path == NULL) {
-        rodsLog (LOG_ERROR,
-          "matchPathInPathCache: input in_path is NULL");
-        return (SYS_INTERNAL_NULL_INPUT_ERR);
-    }
-
-    mysum = pathSum (in_path);
-    myslot = getHashSlot (mysum, NUM_PATH_HASH_SLOT);
-    myque = &pathQueArray[myslot];
-
-    chkCacheExpire (myque);
-    status = matchPathInPathSlot (myque, in_path, out_pathCache);
+    iFuseDesc_t *desc = &IFUSE_DESC(descInx);
+    int slot;
 
-    return status;
+    desc->pathHash = iquest_path_hash (desc->localPath);
+    slot = desc->pathHash & (DESC_PATH_INDEX_SLOTS - 1);
+    pthread_rwlock_wrlock (&DescPathLock);
+    desc->pathNext = DescPathIndex[slot];
+    DescPathIndex[slot] = descInx;
+    desc->pathLinked = 1;
+    pthread_rwlock_unlock (&DescPathLock);
 }
 
-int
-addPathToCache (char *in_path, pathCacheQue_t *pathQueArray,
-struct stat *stbuf, pathCache_t **out_pathCache)
+static void
+desc_path_unlink (int descInx)
 {
-    int status;
+    iFuseDesc_t *desc = &IFUSE_DESC(descInx);
+    int *link;
 
-    pthread_mutex_lock (&PathCacheLock);
-    status = _addPathToCache (in_path, pathQueArray, stbuf, out_pathCache);
-    pthread_mutex_unlock (&PathCacheLock);
-    return status;
+    pthread_rwlock_wrlock (&DescPathLock);
+    if (desc->pathLinked) {
+	link = &DescPathIndex[desc->pathHash & (DESC_PATH_INDEX_SLOTS - 1)];
+	while (*link != descInx)
+	    link = &IFUSE_DESC(*link).pathNext;
+	*link = desc->pathNext;
+	desc->pathNext = 0;
+	desc->pathLinked = 0;
+    }
+    pthread_rwlock_unlock (&DescPathLock);
 }
 
-int
-_addPathToCache (char *in_path, pathCacheQue_t *pathQueArray,
-struct stat *stbuf, pathCache_t **out_pathCache)
+/* a descInx that may name an allocated descriptor */
+static int
+desc_inx_in_range (int descInx)
 {
-    pathCacheQue_t *pathCacheQue;
-    int mysum, myslot;
-    int status;
-
-    /* XXXX if (isSpecialPath ((char *) in_path) != 1) return 0; */
-    mysum = pathSum (in_path);
-    myslot = getHashSlot (mysum, NUM_PATH_HASH_SLOT);
-    pathCacheQue = &pathQueArray[myslot];
-    status = addToCacheSlot (in_path, pathCacheQue, stbuf, out_pathCache);
-
-    return (status);
+    return descInx >= 3 && 
+      descInx < __atomic_load_n (&NumIFuseDesc, __ATOMIC_ACQUIRE);
 }
 
 int
-rmPathFromCache (char *in_path, pathCacheQue_t *pathQueArray)
+allocIFuseDesc ()
 {
-    int status;
-    pthread_mutex_lock (&PathCacheLock);
-    status = _rmPathFromCache (in_path, pathQueArray);
-    pthread_mutex_unlock (&PathCacheLock);
-    return status;
-}
+    int i;
+    iFuseDesc_t **chunk;
 
-int
-_rmPathFromCache (char *in_path, pathCacheQue_t *pathQueArray)
-{
-    pathCacheQue_t *pathCacheQue;
-    int mysum, myslot;
-    pathCache_t *tmpPathCache;
-
-    /* XXXX if (isSpecialPath ((char *) in_path) != 1) return 0; */
-    mysum = pathSum (in_path);
-    myslot = getHashSlot (mysum, NUM_PATH_HASH_SLOT);
-    pathCacheQue = &pathQueArray[myslot];
-
-    tmpPathCache = pathCacheQue->top;
-    while (tmpPathCache != NULL) {
-        if (strcmp (tmpPathCache->filePath, in_path) == 0) {
-            if (tmpPathCache->prev == NULL) {
-                /* top */
-                pathCacheQue->top = tmpPathCache->next;
-            } else {
-                tmpPathCache->prev->next = tmpPathCache->next;
-            }
-            if (tmpPathCache->next == NULL) {
-		/* bottom */
-		pathCacheQue->bottom = tmpPathCache->prev;
-	    } else {
-		tmpPathCache->next->prev = tmpPathCache->prev;
+    pthread_mutex_lock (&DescLock);
+    if (IFuseDescFreeHead != 0) {
+	i = IFuseDescFreeHead;
+	IFuseDescFreeHead = IFUSE_DESC(i).nextFree;
+	IFUSE_DESC(i).nextFree = 0;
+    } else if (NumIFuseDesc < MAX_IFUSE_DESC) {
+	i = NumIFuseDesc;
+	chunk = &IFuseDescChunk[i >> IFUSE_DESC_CHUNK_BITS];
+	if (*chunk == NULL) {
+	    *chunk = (iFuseDesc_t *) calloc (IFUSE_DESC_CHUNK_SIZE, 
+	      sizeof (iFuseDesc_t));
+	    if (*chunk == NULL) {
+		pthread_mutex_unlock (&DescLock);
+		rodsLog (LOG_ERROR, 
+		  "allocIFuseDesc: could not grow the table past %d", i);
+		return (SYS_MALLOC_ERR);
 	    }
-	    freePathCache (tmpPathCache);
-	    return 1;
 	}
-        tmpPathCache = tmpPathCache->next;
-    }
-    return 0;
-}
-
-int
-getHashSlot (int value, int numHashSlot)
-{
-    int mySlot = value % numHashSlot;
-
-    return (mySlot);
+	/* publishes the chunk to desc_inx_in_range */
+	__atomic_store_n (&NumIFuseDesc, i + 1, __ATOMIC_RELEASE);
+    } else {
+	pthread_mutex_unlock (&DescLock);
+	rodsLog (LOG_ERROR, 
+	  "allocIFuseDesc: Out of iFuseDesc");
+	return (SYS_OUT_OF_FILE_DESC);
+    }
+    pthread_mutex_init (&IFUSE_DESC(i).lock, NULL);
+    pthread_cond_init (&IFUSE_DESC(i).raCond, NULL);
+    IFUSE_DESC(i).inuseFlag = IRODS_INUSE;
+    IFuseDescInuseCnt++;
+    pthread_mutex_unlock (&DescLock);
+    return (i);
 }
 
-int
-matchPathInPathSlot (pathCacheQue_t *pathCacheQue, char *in_path, 
-pathCache_t **out_pathCache)
+/* 
+ * getIFuseDescHandle - the fuse file handle for descInx, which
+ * getIFuseDescInx turns back into descInx as long as it is not freed
+ */
+uint64_t
+getIFuseDescHandle (int descInx)
 {
-    pathCache_t *tmpPathCache;
-
-    *out_pathCache = NULL;
-    if (pathCacheQue == NULL) {
-        rodsLog (LOG_ERROR,
-          "matchPathInPathSlot: input pathCacheQue is NULL");
-        return (SYS_INTERNAL_NULL_INPUT_ERR);
-    }
-    tmpPathCache = pathCacheQue->top;
-    while (tmpPathCache != NULL) {
-	if (strcmp (tmpPathCache->filePath, in_path) == 0) {
-	    *out_pathCache = tmpPathCache;
-	    return 1;
-	}
-	tmpPathCache = tmpPathCache->next;
-    }
-    return (0);
+    return ((uint64_t) IFUSE_DESC(descInx).gen << 32) | (uint32_t) descInx;
 }
 
 int
-chkCacheExpire (pathCacheQue_t *pathCacheQue)
+getIFuseDescInx (uint64_t fh)
 {
-    pathCache_t *tmpPathCache;
+    int descInx = (int) (fh & 0xffffffff);
 
-    uint curTime = time (0);
-    if (pathCacheQue == NULL) {
-        rodsLog (LOG_ERROR,
-          "chkCacheExpire: input pathCacheQue is NULL");
-        return (SYS_INTERNAL_NULL_INPUT_ERR);
-    }
-    tmpPathCache = pathCacheQue->top;
-    while (tmpPathCache != NULL) {
-	if (curTime >= tmpPathCache->cachedTime + CACHE_EXPIRE_TIME) {
-	    /* cache expired */
-	    pathCacheQue->top = tmpPathCache->next;
-	    freePathCache (tmpPathCache);
-	    tmpPathCache = pathCacheQue->top;
-            if (tmpPathCache != NULL) {
-                tmpPathCache->prev = NULL;
-            } else {
-		pathCacheQue->bottom = NULL;
-		return (0);
-	    }
-	} else {
-	    /* not expired */
-	    return (0);
-	}
-    }
-    return (0);
-}
-	     
-int
-addToCacheSlot (char *in_path, pathCacheQue_t *pathCacheQue, 
-struct stat *stbuf, pathCache_t **out_pathCache)
-{
-    pathCache_t *tmpPathCache;
-    
-    if (pathCacheQue == NULL || in_path == NULL) {
+    if (!desc_inx_in_range (descInx)) {
         rodsLog (LOG_ERROR,
-          "addToCacheSlot: input pathCacheQue or in_path is NULL");
-        return (SYS_INTERNAL_NULL_INPUT_ERR);
-    }
-    tmpPathCache = (pathCache_t *) malloc (sizeof (pathCache_t));
-    if (out_pathCache != NULL) *out_pathCache = tmpPathCache;
-    bzero (tmpPathCache, sizeof (pathCache_t));
-    tmpPathCache->filePath = strdup (in_path);
-    tmpPathCache->cachedTime = time (0);
-    tmpPathCache->pathCacheQue = pathCacheQue;
-    if (stbuf != NULL) {
-	tmpPathCache->stbuf = *stbuf;
-    }
-    /* queue it to the bottom */
-    if (pathCacheQue->top == NULL) {
-	pathCacheQue->top = pathCacheQue->bottom = tmpPathCache;
-    } else {
-	pathCacheQue->bottom->next = tmpPathCache;
-	tmpPathCache->prev = pathCacheQue->bottom;
-	pathCacheQue->bottom = tmpPathCache;
+         "getIFuseDescInx: descInx %d out of range", descInx);
+        return (SYS_FILE_DESC_OUT_OF_RANGE);
     }
-    return (0);
-}
-
-int
-pathSum (char *in_path)
-{
-    int len, i;
-    int mysum = 0;
-
-    if (in_path == NULL) {
+    if (IFUSE_DESC(descInx).gen != (unsigned int) (fh >> 32) ||
+      IFUSE_DESC(descInx).inuseFlag != IRODS_INUSE) {
         rodsLog (LOG_ERROR,
-          "pathSum: input in_path is NULL");
-        return (SYS_INTERNAL_NULL_INPUT_ERR);
-    }
-    len = strlen (in_path);
-
-    for (i = 0; i < len; i++) {
-	mysum += in_path[i];
-    }
-
-    return mysum; 
-}
-
-int
-initIFuseDesc ()
-{
-    pthread_mutex_init (&DescLock, NULL);
-    pthread_mutex_init (&ConnLock, NULL);
-    pthread_mutex_init (&NewlyCreatedOprLock, NULL);
-    pthread_mutex_init (&PathCacheLock, NULL);
-    pthread_mutex_init (&ConnManagerLock, NULL);
-    pthread_cond_init (&ConnManagerCond, NULL);
-    // JMC - overwrites objects construction? -  memset (IFuseDesc, 0, sizeof (iFuseDesc_t) * MAX_IFUSE_DESC);
-    return (0);
-}
-
-int
-allocIFuseDesc ()
-{
-    int i;
-
-    pthread_mutex_lock (&DescLock);
-    for (i = 3; i < MAX_IFUSE_DESC; i++) {
-        if (IFuseDesc[i].inuseFlag <= IRODS_FREE) {
-	    pthread_mutex_init (&IFuseDesc[i].lock, NULL);
-            IFuseDesc[i].inuseFlag = IRODS_INUSE;
-	    IFuseDescInuseCnt++;
-            pthread_mutex_unlock (&DescLock);
-            return (i);
-        };
+         "getIFuseDescInx: stale handle for descInx %d", descInx);
+        return (SYS_BAD_FILE_DESCRIPTOR);
     }
-    pthread_mutex_unlock (&DescLock);
-    rodsLog (LOG_ERROR, 
-      "allocIFuseDesc: Out of iFuseDesc");
-
-    return (SYS_OUT_OF_FILE_DESC);
+    return (descInx);
 }
 
 int 
@@ -446,12 +349,12 @@ lockDesc (int descInx)
 {
     int status;
 
-    if (descInx < 3 || descInx >= MAX_IFUSE_DESC) {
+    if (!desc_inx_in_range (descInx)) {
         rodsLog (LOG_ERROR,
          "lockDesc: descInx %d out of range", descInx);
         return (SYS_FILE_DESC_OUT_OF_RANGE);
     }
-    status = pthread_mutex_lock (&IFuseDesc[descInx].lock);
+    status = pthread_mutex_lock (&IFUSE_DESC(descInx).lock);
     return status;
 }
 
@@ -460,94 +363,66 @@ unlockDesc (int descInx)
 {
     int status;
 
-    if (descInx < 3 || descInx >= MAX_IFUSE_DESC) {
+    if (!desc_inx_in_range (descInx)) {
         rodsLog (LOG_ERROR,
          "unlockDesc: descInx %d out of range", descInx);
         return (SYS_FILE_DESC_OUT_OF_RANGE);
     }
-    status = pthread_mutex_unlock (&IFuseDesc[descInx].lock);
+    status = pthread_mutex_unlock (&IFUSE_DESC(descInx).lock);
     return status;
 }
 
-int
-irods_connInuse (iquest_fuse_irods_conn_t *irods_conn)
-{
-    int i;
-    int inuseCnt = 0;
-
-    if (irods_conn == NULL) return 0;
-    pthread_mutex_lock (&DescLock);
-    for (i = 3; i < MAX_IFUSE_DESC; i++) {
-	if (inuseCnt >= IFuseDescInuseCnt) break;
-        if (IFuseDesc[i].inuseFlag == IRODS_INUSE) {
-	    inuseCnt++;
-	    if (IFuseDesc[i].irods_conn != NULL && 
-	      IFuseDesc[i].irods_conn == irods_conn) {
-                pthread_mutex_unlock (&DescLock);
-                return 1;
-	    }
-	}
-    }
-    pthread_mutex_unlock (&DescLock);
-    return (0);
-}
-
-int
-freePathCache (pathCache_t *tmpPathCache)
-{
-    if (tmpPathCache == NULL) return 0;
-    if (tmpPathCache->filePath != NULL) free (tmpPathCache->filePath);
-    if (tmpPathCache->locCacheState != NO_FILE_CACHE &&
-      tmpPathCache->locCachePath != NULL) {
-	freeFileCache (tmpPathCache);
-    }
-    free (tmpPathCache);
-    return (0);
-}
-
-int
-freeFileCache (pathCache_t *tmpPathCache)
-{
-    unlink (tmpPathCache->locCachePath);
-    free (tmpPathCache->locCachePath);
-    tmpPathCache->locCachePath = NULL;
-    tmpPathCache->locCacheState = NO_FILE_CACHE;
-    return 0;
-}
-
 int
 freeIFuseDesc (int descInx)
 {
     int i;
+    unsigned int gen;
     iquest_fuse_irods_conn_t *tmp_irods_conn = NULL;
 
-    if (descInx < 3 || descInx >= MAX_IFUSE_DESC) {
+    if (!desc_inx_in_range (descInx)) {
         rodsLog (LOG_ERROR,
          "freeIFuseDesc: descInx %d out of range", descInx);
         return (SYS_FILE_DESC_OUT_OF_RANGE);
     }
 
+    /* before localPath goes, so lookups never see it freed */
+    desc_path_unlink (descInx);
     pthread_mutex_lock (&DescLock);
+    if (IFUSE_DESC(descInx).inuseFlag != IRODS_INUSE) {
+	/* freeing it twice would put it on the free list twice */
+	pthread_mutex_unlock (&DescLock);
+        rodsLog (LOG_ERROR,
+         "freeIFuseDesc: descInx %d is not inuse", descInx);
+        return (SYS_BAD_FILE_DESCRIPTOR);
+    }
     for (i = 0; i < MAX_BUF_CACHE; i++) {
-        if (IFuseDesc[descInx].bufCache[i].buf != NULL) {
-	    free (IFuseDesc[descInx].bufCache[i].buf);
+        if (IFUSE_DESC(descInx).bufCache[i].buf != NULL) {
+	    free (IFUSE_DESC(descInx).bufCache[i].buf);
 	}
     }
-    if (IFuseDesc[descInx].objPath != NULL)
-	free (IFuseDesc[descInx].objPath);
+    if (IFUSE_DESC(descInx).objPath != NULL)
+	free (IFUSE_DESC(descInx).objPath);
 
-    if (IFuseDesc[descInx].localPath != NULL)
-	free (IFuseDesc[descInx].localPath);
-    pthread_mutex_destroy (&IFuseDesc[descInx].lock);
-    tmp_irods_conn = IFuseDesc[descInx].irods_conn;
+    if (IFUSE_DESC(descInx).localPath != NULL)
+	free (IFUSE_DESC(descInx).localPath);
+    if (IFUSE_DESC(descInx).blockKey != NULL)
+	free (IFUSE_DESC(descInx).blockKey);
+    pthread_mutex_destroy (&IFUSE_DESC(descInx).lock);
+    pthread_cond_destroy (&IFUSE_DESC(descInx).raCond);
+    tmp_irods_conn = IFUSE_DESC(descInx).irods_conn;
     if (tmp_irods_conn != NULL) {
-	IFuseDesc[descInx].irods_conn = NULL;
-    }
-    memset (&IFuseDesc[descInx], 0, sizeof (iFuseDesc_t));
+	IFUSE_DESC(descInx).irods_conn = NULL;
+    }
+    gen = IFUSE_DESC(descInx).gen;
+    memset (&IFUSE_DESC(descInx), 0, sizeof (iFuseDesc_t));
+    /* invalidates outstanding handles */
+    IFUSE_DESC(descInx).gen = gen + 1;
+    IFUSE_DESC(descInx).nextFree = IFuseDescFreeHead;
+    IFuseDescFreeHead = descInx;
     IFuseDescInuseCnt--;
 
     pthread_mutex_unlock (&DescLock);
-    /* have to do it outside the lock bacause _relIFuseConn lock it */
+    /* may wake the conn manager or a waiter, so do it outside the lock */
     if (tmp_irods_conn != NULL)
 	_relIFuseConn (tmp_irods_conn);
 
@@ -557,21 +432,21 @@ freeIFuseDesc (int descInx)
 int 
 checkFuseDesc (int descInx)
 {
-    if (descInx < 3 || descInx >= MAX_IFUSE_DESC) {
+    if (!desc_inx_in_range (descInx)) {
         rodsLog (LOG_ERROR,
          "checkFuseDesc: descInx %d out of range", descInx);
         return (SYS_FILE_DESC_OUT_OF_RANGE);
     }
 
-    if (IFuseDesc[descInx].inuseFlag != IRODS_INUSE) {
+    if (IFUSE_DESC(descInx).inuseFlag != IRODS_INUSE) {
         rodsLog (LOG_ERROR,
          "checkFuseDesc: descInx %d is not inuse", descInx);
         return (SYS_BAD_FILE_DESCRIPTOR);
     }
-    if (IFuseDesc[descInx].iFd <= 0) {
+    if (IFUSE_DESC(descInx).iFd <= 0) {
         rodsLog (LOG_ERROR,
          "checkFuseDesc:  iFd %d of descInx %d <= 0", 
-	  IFuseDesc[descInx].iFd, descInx);
+	  IFUSE_DESC(descInx).iFd, descInx);
         return (SYS_BAD_FILE_DESCRIPTOR);
     }
 
@@ -582,15 +457,20 @@ int
 fillIFuseDesc (int descInx, iquest_fuse_irods_conn_t *irods_conn, int iFd, char *objPath,
 char *localPath)
 { 
-    IFuseDesc[descInx].irods_conn = irods_conn;
-    IFuseDesc[descInx].iFd = iFd;
+    /* the descriptor keeps irods_conn until freeIFuseDesc */
+    if (irods_conn != NULL)
+	bindConnDesc (irods_conn);
+    IFUSE_DESC(descInx).irods_conn = irods_conn;
+    IFUSE_DESC(descInx).iFd = iFd;
     if (objPath != NULL) {
-        /* rstrcpy (IFuseDesc[descInx].objPath, objPath, MAX_NAME_LEN); */
-        IFuseDesc[descInx].objPath = strdup (objPath);
+        /* rstrcpy (IFUSE_DESC(descInx).objPath, objPath, MAX_NAME_LEN); */
+        IFUSE_DESC(descInx).objPath = strdup (objPath);
     }
     if (localPath != NULL) {
-        /* rstrcpy (IFuseDesc[descInx].localPath, localPath, MAX_NAME_LEN); */
-        IFuseDesc[descInx].localPath = strdup (localPath);
+        /* rstrcpy (IFUSE_DESC(descInx).localPath, localPath, MAX_NAME_LEN); */
+        IFUSE_DESC(descInx).localPath = strdup (localPath);
+	if (IFUSE_DESC(descInx).localPath != NULL)
+	    desc_path_link (descInx);
     }
     return (0);
 }
@@ -601,16 +481,18 @@ ifuseClose (char *path, int descInx)
     int lockFlag;
     int status;
 
-    if (IFuseDesc[descInx].irods_conn != NULL &&
-      IFuseDesc[descInx].irods_conn->conn != NULL) {
-        useIFuseConn (IFuseDesc[descInx].irods_conn);
+    /* read-ahead uses the descriptor's objPath on a connection of its own */
+    stopReadAhead (descInx);
+    if (IFUSE_DESC(descInx).irods_conn != NULL &&
+      IFUSE_DESC(descInx).irods_conn->conn != NULL) {
+        useIFuseConn (IFUSE_DESC(descInx).irods_conn);
 	lockFlag = 1;
     } else {
 	lockFlag = 0;
     }
     status = _ifuseClose (path, descInx);
     if (lockFlag == 1) {
-	unuseIFuseConn (IFuseDesc[descInx].irods_conn);
+	unuseIFuseConn (IFUSE_DESC(descInx).irods_conn);
     }
     return status;
 }
@@ -622,31 +504,34 @@ _ifuseClose (char *path, int descInx)
     int savedStatus = 0;
     int goodStat = 0;
 
-    if (IFuseDesc[descInx].locCacheState == NO_FILE_CACHE) {
-	status = closeIrodsFd (IFuseDesc[descInx].irods_conn, 
-	  IFuseDesc[descInx].iFd);
+    if (IFUSE_DESC(descInx).locCacheState == NO_FILE_CACHE) {
+	status = closeIrodsFd (IFUSE_DESC(descInx).irods_conn, 
+	  IFUSE_DESC(descInx).iFd);
     } else {	/* cached */
-        if (IFuseDesc[descInx].newFlag > 0 || 
-	  IFuseDesc[descInx].locCacheState == HAVE_NEWLY_CREATED_CACHE) {
-            pathCache_t *tmpPathCache;
+        if (IFUSE_DESC(descInx).newFlag > 0 || 
+	  IFUSE_DESC(descInx).locCacheState == HAVE_NEWLY_CREATED_CACHE) {
+            char locCachePath[MAX_NAME_LEN];
+            struct stat stbuf;
             /* newly created. Just update the size */
-            if (matchPathInPathCache ((char *) path, PathArray,
-             &tmpPathCache) == 1 && tmpPathCache->locCachePath != NULL) {
-                status = updatePathCacheStat (tmpPathCache);
+            if (getPathCacheFile ((char *) path, &PathArray, &stbuf,
+             locCachePath) == 1 && locCachePath[0] != '\0') {
+                status = updatePathCacheStat ((char *) path, locCachePath,
+                  &stbuf);
                 if (status >= 0) goodStat = 1;
-		status = ifusePut (IFuseDesc[descInx].irods_conn, 
-		  path, tmpPathCache->locCachePath,
-		  IFuseDesc[descInx].createMode, 
-		  tmpPathCache->stbuf.st_size);
+		status = ifusePut (IFUSE_DESC(descInx).irods_conn, 
+		  path, locCachePath,
+		  IFUSE_DESC(descInx).createMode, 
+		  stbuf.st_size);
                 if (status < 0) {
                     rodsLog (LOG_ERROR,
                       "ifuseClose: ifusePut of %s error, status = %d",
                        path, status);
                     savedStatus = -EBADF;
                 }
-		if (tmpPathCache->stbuf.st_size > MAX_READ_CACHE_SIZE) {
-		    /* too big to keep */
-		    freeFileCache (tmpPathCache);
+		if (stbuf.st_size > MAX_READ_CACHE_SIZE) {
+		    /* too big to keep - unlinked once the old entry is freed */
+		    _addPathToCacheWithFile ((char *) path, &PathArray, &stbuf,
+		      time (0), NULL, NO_FILE_CACHE, 1);
 		}	
             } else {
                 /* should not be here. but cache may be removed that we
@@ -657,7 +542,7 @@ _ifuseClose (char *path, int descInx)
 		savedStatus = -EBADF;
 	    }
 	}
-	status = close (IFuseDesc[descInx].iFd);
+	status = close (IFUSE_DESC(descInx).iFd);
 	if (status < 0) {
 	    status = (errno ? (-1 * errno) : -1);
 	} else {
@@ -665,8 +550,10 @@ _ifuseClose (char *path, int descInx)
 	}
     }
 
-    if (IFuseDesc[descInx].bytesWritten > 0 && goodStat == 0) 
-        rmPathFromCache ((char *) path, PathArray);
+    if (IFUSE_DESC(descInx).bytesWritten > 0 && goodStat == 0) 
+        rmPathFromCache ((char *) path, &PathArray);
+    if (IFUSE_DESC(descInx).bytesWritten > 0 || IFUSE_DESC(descInx).newFlag > 0)
+        rmParentListFromCache (path);
     return (status);
 }
 
@@ -710,18 +597,18 @@ off_t offset)
 
 
     bzero (&dataObjWriteInp, sizeof (dataObjWriteInp));
-    if (IFuseDesc[descInx].locCacheState == NO_FILE_CACHE) {
+    if (IFUSE_DESC(descInx).locCacheState == NO_FILE_CACHE) {
         dataObjWriteInpBBuf.buf = (void *) buf;
         dataObjWriteInpBBuf.len = size;
-        dataObjWriteInp.l1descInx = IFuseDesc[descInx].iFd;
+        dataObjWriteInp.l1descInx = IFUSE_DESC(descInx).iFd;
         dataObjWriteInp.len = size;
 
-        if (IFuseDesc[descInx].irods_conn != NULL && 
-	  IFuseDesc[descInx].irods_conn->conn != NULL) {
-	    useIFuseConn (IFuseDesc[descInx].irods_conn);
-            status = rcDataObjWrite (IFuseDesc[descInx].irods_conn->conn, 
+        if (IFUSE_DESC(descInx).irods_conn != NULL && 
+	  IFUSE_DESC(descInx).irods_conn->conn != NULL) {
+	    useIFuseConn (IFUSE_DESC(descInx).irods_conn);
+            status = rcDataObjWrite (IFUSE_DESC(descInx).irods_conn->conn, 
 	      &dataObjWriteInp, &dataObjWriteInpBBuf);
-	    unuseIFuseConn (IFuseDesc[descInx].irods_conn);
+	    unuseIFuseConn (IFUSE_DESC(descInx).irods_conn);
             if (status < 0) {
                 if ((myError = getErrno (status)) > 0) {
                     return (-myError);
@@ -730,21 +617,21 @@ off_t offset)
                 }
             } else if (status != (int) size) {
                 rodsLog (LOG_ERROR,
-		  "ifuseWrite: IFuseDesc[descInx].conn for %s is NULL", path);
+		  "ifuseWrite: IFUSE_DESC(descInx).conn for %s is NULL", path);
                 return -ENOENT;
 	    }
 	} else {
             rodsLog (LOG_ERROR,
-              "ifuseWrite: IFuseDesc[descInx].conn for %s is NULL", path);
+              "ifuseWrite: IFUSE_DESC(descInx).conn for %s is NULL", path);
             return -ENOENT;
         }
-        IFuseDesc[descInx].offset += status;
+        IFUSE_DESC(descInx).offset += status;
     } else {
-        status = write (IFuseDesc[descInx].iFd, buf, size);
+        status = write (IFUSE_DESC(descInx).iFd, buf, size);
 
         if (status < 0) return (errno ? (-1 * errno) : -1);
-        IFuseDesc[descInx].offset += status;
-	if (IFuseDesc[descInx].offset >= MAX_NEWLY_CREATED_CACHE_SIZE) {
+        IFUSE_DESC(descInx).offset += status;
+	if (IFUSE_DESC(descInx).offset >= MAX_NEWLY_CREATED_CACHE_SIZE) {
 	    int irodsFd; 
 	    int status1;
 	    struct stat stbuf;
@@ -752,44 +639,44 @@ off_t offset)
 	    rodsLong_t myoffset;
 
 	    /* need to write it to iRODS */
-	    if (IFuseDesc[descInx].irods_conn != NULL &&
-	      IFuseDesc[descInx].irods_conn->conn != NULL) {
-		useIFuseConn (IFuseDesc[descInx].irods_conn);
+	    if (IFUSE_DESC(descInx).irods_conn != NULL &&
+	      IFUSE_DESC(descInx).irods_conn->conn != NULL) {
+		useIFuseConn (IFUSE_DESC(descInx).irods_conn);
 	        irodsFd = dataObjCreateByFusePath (
-		  IFuseDesc[descInx].irods_conn,
-		  path, IFuseDesc[descInx].createMode, irodsPath);
-		unuseIFuseConn (IFuseDesc[descInx].irods_conn);
+		  IFUSE_DESC(descInx).irods_conn,
+		  path, IFUSE_DESC(descInx).createMode, irodsPath);
+		unuseIFuseConn (IFUSE_DESC(descInx).irods_conn);
 	    } else {
                 rodsLog (LOG_ERROR,
-                  "ifuseWrite: IFuseDesc[descInx].conn for %s is NULL", path);
+                  "ifuseWrite: IFUSE_DESC(descInx).conn for %s is NULL", path);
 		irodsFd = -ENOENT;
 	    }
 	    if (irodsFd < 0) {
                 rodsLog (LOG_ERROR,
                   "ifuseWrite: dataObjCreateByFusePath of %s error, stat=%d",
                  path, irodsFd);
-		close (IFuseDesc[descInx].iFd);
-		rmPathFromCache ((char *) path, PathArray);
+		close (IFUSE_DESC(descInx).iFd);
+		rmPathFromCache ((char *) path, &PathArray);
                 return -ENOENT;
 	    }
-	    status1 = fstat (IFuseDesc[descInx].iFd, &stbuf);
+	    status1 = fstat (IFUSE_DESC(descInx).iFd, &stbuf);
             if (status1 < 0) {
                 rodsLog (LOG_ERROR,
                   "ifuseWrite: fstat of %s error, errno=%d",
                  path, errno);
-		close (IFuseDesc[descInx].iFd);
-		rmPathFromCache ((char *) path, PathArray);
+		close (IFUSE_DESC(descInx).iFd);
+		rmPathFromCache ((char *) path, &PathArray);
 		return (errno ? (-1 * errno) : -1);
 	    }
 	    mybuf = (char *) malloc (stbuf.st_size);
-	    lseek (IFuseDesc[descInx].iFd, 0, SEEK_SET);
-	    status1 = read (IFuseDesc[descInx].iFd, mybuf, stbuf.st_size);
+	    lseek (IFUSE_DESC(descInx).iFd, 0, SEEK_SET);
+	    status1 = read (IFUSE_DESC(descInx).iFd, mybuf, stbuf.st_size);
             if (status1 < 0) {
                 rodsLog (LOG_ERROR,
                   "ifuseWrite: read of %s error, errno=%d",
                  path, errno);
-		close (IFuseDesc[descInx].iFd);
-                rmPathFromCache ((char *) path, PathArray);
+		close (IFUSE_DESC(descInx).iFd);
+                rmPathFromCache ((char *) path, &PathArray);
                 free(mybuf);	// cppcheck - Memory leak: mybuf
                 return (errno ? (-1 * errno) : -1);
             }
@@ -798,20 +685,20 @@ off_t offset)
             dataObjWriteInp.l1descInx = irodsFd;
             dataObjWriteInp.len = stbuf.st_size;
 
-	    if (IFuseDesc[descInx].irods_conn != NULL &&
-	      IFuseDesc[descInx].irods_conn->conn != NULL) {
-		useIFuseConn (IFuseDesc[descInx].irods_conn);
-                status1 = rcDataObjWrite (IFuseDesc[descInx].irods_conn->conn, 
+	    if (IFUSE_DESC(descInx).irods_conn != NULL &&
+	      IFUSE_DESC(descInx).irods_conn->conn != NULL) {
+		useIFuseConn (IFUSE_DESC(descInx).irods_conn);
+                status1 = rcDataObjWrite (IFUSE_DESC(descInx).irods_conn->conn, 
 		  &dataObjWriteInp, &dataObjWriteInpBBuf);
-		unuseIFuseConn (IFuseDesc[descInx].irods_conn);
+		unuseIFuseConn (IFUSE_DESC(descInx).irods_conn);
 	    } else {
                 rodsLog (LOG_ERROR,
-                 "ifuseWrite: IFuseDesc[descInx].conn for %s is NULL", path);
+                 "ifuseWrite: IFUSE_DESC(descInx).conn for %s is NULL", path);
                 status1 = -ENOENT;
             }
 	    free (mybuf);
-            close (IFuseDesc[descInx].iFd);
-            rmPathFromCache ((char *) path, PathArray);
+            close (IFUSE_DESC(descInx).iFd);
+            rmPathFromCache ((char *) path, &PathArray);
 
             if (status1 < 0) {
                 rodsLog (LOG_ERROR,
@@ -822,16 +709,16 @@ off_t offset)
                 } else {
                     status1 = -ENOENT;
                 }
-		IFuseDesc[descInx].iFd = 0;
+		IFUSE_DESC(descInx).iFd = 0;
                 return (status1);
 	    } else {
-		IFuseDesc[descInx].iFd = irodsFd;
-		IFuseDesc[descInx].locCacheState = NO_FILE_CACHE;
-		IFuseDesc[descInx].newFlag = 0;
+		IFUSE_DESC(descInx).iFd = irodsFd;
+		IFUSE_DESC(descInx).locCacheState = NO_FILE_CACHE;
+		IFUSE_DESC(descInx).newFlag = 0;
 	    }
 	    /* one last thing - seek to the right offset */
-            myoffset = IFuseDesc[descInx].offset;
-	    IFuseDesc[descInx].offset = 0;
+            myoffset = IFUSE_DESC(descInx).offset;
+	    IFUSE_DESC(descInx).offset = 0;
             if ((status1 = ifuseLseek ((char *) path, descInx, myoffset)) 
 	      < 0) {
                 rodsLog (LOG_ERROR,
@@ -845,18 +732,129 @@ off_t offset)
 	    }
 	}
     }
-    IFuseDesc[descInx].bytesWritten += status;
+    IFUSE_DESC(descInx).bytesWritten += status;
+
+    return status;
+}
+
+/* 
+ * setIFuseDescBlockKey - have reads of descInx (opened read-only) go 
+ * through ObjBlockCache, if the object's stat is cached to tell one 
+ * version of it from another 
+ */
+int
+setIFuseDescBlockKey (int descInx, char *path)
+{
+    struct stat stbuf;
+
+    if (ObjBlockCache.maxBytes == 0 || IFUSE_DESC(descInx).objPath == NULL)
+	return 0;
+    if (getPathCacheStat (path, &PathArray, &stbuf) != 1)
+	return 0;
+    if (asprintf (&IFUSE_DESC(descInx).blockKey, "%s\n%lld\n%ld",
+      IFUSE_DESC(descInx).objPath, (long long) stbuf.st_size,
+      (long) stbuf.st_mtime) < 0) {
+	IFUSE_DESC(descInx).blockKey = NULL;
+	return SYS_MALLOC_ERR;
+    }
+    IFUSE_DESC(descInx).objSize = stbuf.st_size;
+    return 0;
+}
+
+/* reads blockNum of descInx into block, at most blockSize bytes */
+static int iquest_fetch_block(char *path, int descInx, cacheBlock_t *block, size_t blockSize) {
+  rodsLong_t blockOffset = block->blockNum * (rodsLong_t) blockSize;
+  size_t want = blockSize;
+  size_t done = 0;
+  int status, myError;
 
+  if (blockOffset + (rodsLong_t) want > IFUSE_DESC(descInx).objSize) {
+    want = IFUSE_DESC(descInx).objSize - blockOffset;
+  }
+  if ((status = ifuseLseek(path, descInx, blockOffset)) < 0) {
+    if ((myError = getErrno(status)) > 0) {
+      return -myError;
+    } else {
+      return -ENOENT;
+    }
+  }
+  while (done < want) {
+    status = _ifuseRead(path, descInx, block->data + done, want - done, blockOffset + done);
+    if (status <= 0) break;
+    done += status;
+  }
+  if (status < 0) {
     return status;
+  }
+  return done;
+}
+
+/* ifuseRead through ObjBlockCache: the blocks the read covers are fetched
+ * whole unless cached, once however many read them at the same time */
+static int iquest_read_blocks(char *path, int descInx, char *buf, size_t size, off_t offset) {
+  size_t blockSize = ObjBlockCache.blockSize;
+  size_t done = 0;
+  size_t n;
+  rodsLong_t pos, blockOffset;
+  cacheBlock_t *block;
+  int fetch, status;
+
+  while (done < size && offset + (rodsLong_t) done < IFUSE_DESC(descInx).objSize) {
+    pos = offset + done;
+    block = getBlockFromCache(&ObjBlockCache, IFUSE_DESC(descInx).blockKey, pos / blockSize, &fetch);
+    if (block == NULL) {
+      /* no memory for it: read around the cache */
+      status = ifuseLseek(path, descInx, pos);
+      if (status >= 0) {
+	status = _ifuseRead(path, descInx, buf + done, size - done, pos);
+      }
+      if (status < 0) {
+	return (done > 0) ? (int) done : status;
+      }
+      return done + status;
+    }
+    if (fetch) {
+      status = iquest_fetch_block(path, descInx, block, blockSize);
+      blockFetched(&ObjBlockCache, block, status);
+      if (status < 0) {
+	releaseBlock(block);
+	return (done > 0) ? (int) done : status;
+      }
+    }
+    blockOffset = block->blockNum * (rodsLong_t) blockSize;
+    if (pos >= blockOffset + (rodsLong_t) block->len) {
+      /* the object is shorter than it was said to be */
+      releaseBlock(block);
+      break;
+    }
+    n = blockOffset + block->len - pos;
+    if (n > size - done) {
+      n = size - done;
+    }
+    memcpy(buf + done, block->data + (pos - blockOffset), n);
+    releaseBlock(block);
+    done += n;
+  }
+  return done;
 }
 
 int
 ifuseRead (char *path, int descInx, char *buf, size_t size, 
 off_t offset)
+{
+    if (IFUSE_DESC(descInx).locCacheState == NO_FILE_CACHE &&
+      IFUSE_DESC(descInx).blockKey != NULL) 
+	return iquest_read_blocks (path, descInx, buf, size, offset);
+    return _ifuseRead (path, descInx, buf, size, offset);
+}
+
+int
+_ifuseRead (char *path, int descInx, char *buf, size_t size, 
+off_t offset)
 {
     int status;
 
-    if (IFuseDesc[descInx].locCacheState == NO_FILE_CACHE) {
+    if (IFUSE_DESC(descInx).locCacheState == NO_FILE_CACHE) {
         openedDataObjInp_t dataObjReadInp;
 	bytesBuf_t dataObjReadOutBBuf;
 	int myError;
@@ -864,15 +862,15 @@ off_t offset)
         bzero (&dataObjReadInp, sizeof (dataObjReadInp));
         dataObjReadOutBBuf.buf = buf;
         dataObjReadOutBBuf.len = size;
-        dataObjReadInp.l1descInx = IFuseDesc[descInx].iFd;
+        dataObjReadInp.l1descInx = IFUSE_DESC(descInx).iFd;
         dataObjReadInp.len = size;
 
-	if (IFuseDesc[descInx].irods_conn != NULL &&
-	  IFuseDesc[descInx].irods_conn->conn != NULL) {
-	    useIFuseConn (IFuseDesc[descInx].irods_conn);
-            status = rcDataObjRead (IFuseDesc[descInx].irods_conn->conn, 
+	if (IFUSE_DESC(descInx).irods_conn != NULL &&
+	  IFUSE_DESC(descInx).irods_conn->conn != NULL) {
+	    useIFuseConn (IFUSE_DESC(descInx).irods_conn);
+            status = rcDataObjRead (IFUSE_DESC(descInx).irods_conn->conn, 
 	      &dataObjReadInp, &dataObjReadOutBBuf);
-	    unuseIFuseConn (IFuseDesc[descInx].irods_conn);
+	    unuseIFuseConn (IFUSE_DESC(descInx).irods_conn);
             if (status < 0) {
                 if ((myError = getErrno (status)) > 0) {
                     return (-myError);
@@ -882,15 +880,15 @@ off_t offset)
             }
 	} else {
             rodsLog (LOG_ERROR,
-              "ifusRead: IFuseDesc[descInx].conn for %s is NULL", path);
+              "ifusRead: IFUSE_DESC(descInx).conn for %s is NULL", path);
             status = -ENOENT;
         }
     } else {
-	status = read (IFuseDesc[descInx].iFd, buf, size);
+	status = read (IFUSE_DESC(descInx).iFd, buf, size);
 
 	if (status < 0) return (errno ? (-1 * errno) : -1);
     }
-    IFuseDesc[descInx].offset += status;
+    IFUSE_DESC(descInx).offset += status;
 
     return status;
 }
@@ -900,31 +898,31 @@ ifuseLseek (char *path, int descInx, off_t offset)
 {
     int status;
 
-    if (IFuseDesc[descInx].offset != offset) {
-	if (IFuseDesc[descInx].locCacheState == NO_FILE_CACHE) {
+    if (IFUSE_DESC(descInx).offset != offset) {
+	if (IFUSE_DESC(descInx).locCacheState == NO_FILE_CACHE) {
             openedDataObjInp_t dataObjLseekInp;
             fileLseekOut_t *dataObjLseekOut = NULL;
 
 	    bzero (&dataObjLseekInp, sizeof (dataObjLseekInp));
-            dataObjLseekInp.l1descInx = IFuseDesc[descInx].iFd;
+            dataObjLseekInp.l1descInx = IFUSE_DESC(descInx).iFd;
             dataObjLseekInp.offset = offset;
             dataObjLseekInp.whence = SEEK_SET;
 
-	    if (IFuseDesc[descInx].irods_conn != NULL &&
-	      IFuseDesc[descInx].irods_conn->conn != NULL) {
-		useIFuseConn (IFuseDesc[descInx].irods_conn);
-                status = rcDataObjLseek (IFuseDesc[descInx].irods_conn->conn, 
+	    if (IFUSE_DESC(descInx).irods_conn != NULL &&
+	      IFUSE_DESC(descInx).irods_conn->conn != NULL) {
+		useIFuseConn (IFUSE_DESC(descInx).irods_conn);
+                status = rcDataObjLseek (IFUSE_DESC(descInx).irods_conn->conn, 
 		  &dataObjLseekInp, &dataObjLseekOut);
-		unuseIFuseConn (IFuseDesc[descInx].irods_conn);
+		unuseIFuseConn (IFUSE_DESC(descInx).irods_conn);
                 if (dataObjLseekOut != NULL) free (dataObjLseekOut);
 	    } else {
                 rodsLog (LOG_ERROR,
-                  "ifuseLseek: IFuseDesc[descInx].conn for %s is NULL", path);
+                  "ifuseLseek: IFUSE_DESC(descInx).conn for %s is NULL", path);
                 status = -ENOENT;
             }
 	} else {
 	    rodsLong_t lstatus;
-	    lstatus = lseek (IFuseDesc[descInx].iFd, offset, SEEK_SET);
+	    lstatus = lseek (IFUSE_DESC(descInx).iFd, offset, SEEK_SET);
 	    if (lstatus >= 0) {
 		status = 0;
 	    } else {
@@ -937,7 +935,7 @@ ifuseLseek (char *path, int descInx, off_t offset)
               "ifuseLseek: lseek of %s error", path);
             return status;
         } else {
-            IFuseDesc[descInx].offset = offset;
+            IFUSE_DESC(descInx).offset = offset;
         }
 
     }
@@ -950,201 +948,109 @@ ifuseLseek (char *path, int descInx, off_t offset)
  */
 int get_iquest_fuse_irods_conn_by_path(iquest_fuse_irods_conn_t **irods_conn, iquest_fuse_t *iqf, char *localPath) {
   int i, status;
-  int inuseCnt = 0;
+  uint64_t hash;
   rodsLog(LOG_DEBUG, "get_iquest_fuse_irods_conn_by_path: getting connection for localPath=%s", localPath);
-  pthread_mutex_lock (&DescLock);
-  for (i = 3; i < MAX_IFUSE_DESC; i++) {
-    if (inuseCnt >= IFuseDescInuseCnt) break;
-    if (IFuseDesc[i].inuseFlag == IRODS_INUSE) {
-      inuseCnt++;
-      if (IFuseDesc[i].irods_conn != NULL &&
-	  IFuseDesc[i].irods_conn->conn != NULL &&
-	  strcmp (localPath, IFuseDesc[i].localPath) == 0) {
-	*irods_conn = IFuseDesc[i].irods_conn;
-	pthread_mutex_lock (&ConnLock);
-	pthread_mutex_unlock (&DescLock);
-	_useIFuseConn (*irods_conn);
-	return 0;
-      }
+  hash = iquest_path_hash(localPath);
+  pthread_rwlock_rdlock(&DescPathLock);
+  for (i = DescPathIndex[hash & (DESC_PATH_INDEX_SLOTS - 1)]; i != 0; i = IFUSE_DESC(i).pathNext) {
+    if (IFUSE_DESC(i).pathHash == hash &&
+	IFUSE_DESC(i).irods_conn != NULL &&
+	IFUSE_DESC(i).irods_conn->conn != NULL &&
+	strcmp (localPath, IFUSE_DESC(i).localPath) == 0) {
+      *irods_conn = IFUSE_DESC(i).irods_conn;
+      /* take it while the descriptor still keeps it alive */
+      holdConn (*irods_conn);
+      pthread_rwlock_unlock(&DescPathLock);
+      pthread_mutex_lock (&(*irods_conn)->lock);
+      return 0;
     }
   }
   /* no match. just assign one */
-  pthread_mutex_unlock (&DescLock);
-  status = get_iquest_fuse_irods_conn(irods_conn, iqf);
+  pthread_rwlock_unlock(&DescPathLock);
+  status = get_iquest_fuse_irods_bulk_conn(irods_conn, iqf);
   
   return status;
 }
 
 /*
- * get a connection, creating one if necessary. 
+ * get a connection for catalog requests (stats, listings and queries),
+ * creating one if necessary. 
  * modifies its first argument
  */
 int get_iquest_fuse_irods_conn(iquest_fuse_irods_conn_t **irods_conn, iquest_fuse_t *iqf) {
+    return _get_iquest_fuse_irods_conn(irods_conn, iqf, IQF_CONN_CATALOG);
+}
+
+/*
+ * get a connection for reading or writing data objects, from a separate
+ * pool so that transfers cannot hold up catalog requests
+ */
+int get_iquest_fuse_irods_bulk_conn(iquest_fuse_irods_conn_t **irods_conn, iquest_fuse_t *iqf) {
+    return _get_iquest_fuse_irods_conn(irods_conn, iqf, IQF_CONN_BULK);
+}
+
+int _get_iquest_fuse_irods_conn(iquest_fuse_irods_conn_t **irods_conn, iquest_fuse_t *iqf, int connClass) {
     int status;
     iquest_fuse_irods_conn_t *tmp_irods_conn;
-    int inuseCnt;
 
     *irods_conn = NULL;
 
-    while (*irods_conn == NULL) {
-        pthread_mutex_lock (&ConnLock);
-        /* get a free IFuseConn */
-
-	inuseCnt = 0;
-        tmp_irods_conn = iqf->irods_conn_head;
-        while (tmp_irods_conn != NULL) {
-	    if (tmp_irods_conn->status == IRODS_FREE && 
-	      tmp_irods_conn->conn != NULL) {
-	        useFreeIFuseConn (tmp_irods_conn);
-	        *irods_conn = tmp_irods_conn;
-		return 0;;
-	    }
-	    inuseCnt++;
-	    tmp_irods_conn = tmp_irods_conn->next;
-        }
-        if (inuseCnt >= MAX_NUM_CONN) {
-	    connReqWait_t myConnReqWait, *tmpConnReqWait;
-	    /* find one that is not in use */
-            tmp_irods_conn = iqf->irods_conn_head;
-            while (tmp_irods_conn != NULL) {
-                if (tmp_irods_conn->inuseCnt == 0 && 
-	          tmp_irods_conn->pendingCnt == 0 && tmp_irods_conn->conn != NULL) {
-                    _useIFuseConn (tmp_irods_conn);
-                    *irods_conn = tmp_irods_conn;
-                    return 0;
-                }
-                tmp_irods_conn = tmp_irods_conn->next;
-            }
-	    /* have to wait */
-            struct timespec timeout;
-	    bzero (&myConnReqWait, sizeof (myConnReqWait));
-            pthread_mutex_init (&myConnReqWait.mutex, NULL);
-            pthread_cond_init (&myConnReqWait.cond, NULL);
-	    /* queue it to the bottom */
-	    if (ConnReqWaitQue == NULL) {
-	        ConnReqWaitQue = &myConnReqWait;
-	    } else {
-	        tmpConnReqWait = ConnReqWaitQue;
-	        while (tmpConnReqWait->next != NULL) {
-		    tmpConnReqWait = tmpConnReqWait->next;
-	        }
-	        tmpConnReqWait->next = &myConnReqWait;
-	    }
-	    while (myConnReqWait.state == 0) {
-	      bzero (&timeout, sizeof (timeout));
-                timeout.tv_sec = time (0) + IQF_CONN_REQ_SLEEP_TIME;
-                pthread_mutex_unlock (&ConnLock);
-                pthread_mutex_lock (&myConnReqWait.mutex);
-                pthread_cond_timedwait (&myConnReqWait.cond, 
-		  &myConnReqWait.mutex, &timeout);
-                pthread_mutex_unlock (&myConnReqWait.mutex);
-	    }
-	    pthread_mutex_destroy (&myConnReqWait.mutex);
-	    /* start from begining */
-	    continue;
-        }
-
-        pthread_mutex_unlock (&ConnLock);
-        /* 
-	 * get here when nothing free. make a new connection. 
-	 */
-        tmp_irods_conn = (iquest_fuse_irods_conn_t *) malloc (sizeof (iquest_fuse_irods_conn_t));
-        if (tmp_irods_conn == NULL) {
-            return SYS_MALLOC_ERR;
-        }
-        bzero (tmp_irods_conn, sizeof (iquest_fuse_irods_conn_t));
-	tmp_irods_conn->iqf = iqf;
-	
-        pthread_mutex_init (&tmp_irods_conn->lock, NULL);
-
+    tmp_irods_conn = acquireConn (iqf->conn_pool[connClass], iqf->conf->conn_wait_timeout);
+    if (tmp_irods_conn == NULL) {
+	return -ETIMEDOUT;
+    }
+    pthread_mutex_lock (&tmp_irods_conn->lock);
+    if (tmp_irods_conn->conn == NULL) {
+	/* a fresh slot (or a shared connection that was lost) */
         status = ifuseConnect (tmp_irods_conn);
+        if (status == CONN_POOL_BACKING_OFF) {
+	  /* iRODS has been unreachable; not a login failure */
+	  relIFuseConn (tmp_irods_conn);
+	  return -EAGAIN;
+	}
         if (status < 0) {
 	  rodsLogError ( LOG_ERROR, status, "connection error");
+	  relIFuseConn (tmp_irods_conn);
 	  if (status == KRB_ERROR_ACQUIRING_CREDS) {
 	    return -ENOKEY;
 	  }
 	  return -EPERM;
 	}
+    }
+    tmp_irods_conn->actTime = time (NULL);
+    *irods_conn = tmp_irods_conn;
 
-        useIFuseConn (tmp_irods_conn);
-
-        *irods_conn = tmp_irods_conn;
-        pthread_mutex_lock (&ConnLock);
-        /* queue it on top */
-        tmp_irods_conn->next = iqf->irods_conn_head;
-        iqf->irods_conn_head = tmp_irods_conn;
-
-        pthread_mutex_unlock (&ConnLock);
-	break;
-    }	/* while *irods_conn */
-
-    if (ConnManagerStarted < HIGH_NUM_CONN && 
-      ++ConnManagerStarted == HIGH_NUM_CONN) {
-	/* don't do it the first time */
-
+    if (__atomic_load_n (&ConnManagerStarted, __ATOMIC_RELAXED) == 0 &&
+      __atomic_exchange_n (&ConnManagerStarted, 1, __ATOMIC_ACQ_REL) == 0) {
         status = pthread_create (&ConnManagerThr, pthread_attr_default,(void *(*)(void *)) conn_manager, iqf);
-        if (status < 0) {
+        if (status != 0) {
             rodsLog (LOG_ERROR, "pthread_create failure, status = %d", status);
-	    ConnManagerStarted --;	/* try again */
+	    __atomic_store_n (&ConnManagerStarted, 0, __ATOMIC_RELEASE);	/* try again */
 	}
     }
     return 0;
 }
 
+/* use a connection kept by an open descriptor */
 int
 useIFuseConn (iquest_fuse_irods_conn_t *irods_conn)
 {
-    int status;
-    if (irods_conn == NULL || irods_conn->conn == NULL)
+    if (irods_conn == NULL)
         return USER__NULL_INPUT_ERR;
-    pthread_mutex_lock (&ConnLock);
-    status = _useIFuseConn (irods_conn);
-    return status;
-}
-
-/* queIFuseConn - lock ConnLock before calling */ 
-int
-_useIFuseConn (iquest_fuse_irods_conn_t *irods_conn)
-{
-    if (irods_conn == NULL || irods_conn->conn == NULL) 
-	return USER__NULL_INPUT_ERR;
-    irods_conn->actTime = time (NULL);
-    irods_conn->status = IRODS_INUSE;
-    irods_conn->pendingCnt++;
-
-    pthread_mutex_unlock (&ConnLock);
+    holdConn (irods_conn);
     pthread_mutex_lock (&irods_conn->lock);
-    pthread_mutex_lock (&ConnLock);
-
-    irods_conn->inuseCnt++;
-    irods_conn->pendingCnt--;
-
-    pthread_mutex_unlock (&ConnLock);
-    return 0;
-}
-
-int
-useFreeIFuseConn (iquest_fuse_irods_conn_t *irods_conn)
-{
-    if (irods_conn == NULL) return USER__NULL_INPUT_ERR;
     irods_conn->actTime = time (NULL);
-    irods_conn->status = IRODS_INUSE;
-    irods_conn->inuseCnt++;
-    pthread_mutex_unlock (&ConnLock);
-    pthread_mutex_lock (&irods_conn->lock);
     return 0;
 }
 
 int
 unuseIFuseConn (iquest_fuse_irods_conn_t *irods_conn)
 {
-    if (irods_conn == NULL || irods_conn->conn == NULL)
+    if (irods_conn == NULL)
         return USER__NULL_INPUT_ERR;
-    pthread_mutex_lock (&ConnLock);
-    irods_conn->actTime = time (NULL);
-    irods_conn->inuseCnt--;
-    pthread_mutex_unlock (&ConnLock);
     pthread_mutex_unlock (&irods_conn->lock);
+    if (releaseConn (irods_conn) > 0)
+	signal_conn_manager (irods_conn->iqf);
     return 0;
 }
 
@@ -1158,6 +1064,12 @@ int ifuseConnect (iquest_fuse_irods_conn_t *irods_conn) {
     rodsEnv *myRodsEnv;
     myRodsEnv = irods_conn->iqf->rods_env;
 
+    if (!mayConnect (irods_conn->pool)) {
+	/* someone else is finding out whether the server is back */
+        rodsLog (LOG_DEBUG, "ifuseConnect: backing off after failed connections");
+	return (CONN_POOL_BACKING_OFF);
+    }
+
     irods_conn->conn = rcConnect (myRodsEnv->rodsHost, myRodsEnv->rodsPort,
       myRodsEnv->rodsUserName, myRodsEnv->rodsZone, NO_RECONN, &errMsg);
 
@@ -1166,6 +1078,7 @@ int ifuseConnect (iquest_fuse_irods_conn_t *irods_conn) {
         irods_conn->conn = rcConnect (myRodsEnv->rodsHost, myRodsEnv->rodsPort,
           myRodsEnv->rodsUserName, myRodsEnv->rodsZone, NO_RECONN, &errMsg);
 	if (irods_conn->conn == NULL) {
+            connectDone (irods_conn->pool, 0);
             rodsLogError (LOG_ERROR, errMsg.status,
               "ifuseConnect: rcConnect failure %s", errMsg.msg);
             if (errMsg.status < 0) {
@@ -1176,6 +1089,9 @@ int ifuseConnect (iquest_fuse_irods_conn_t *irods_conn) {
         }
     }
 
+    connectDone (irods_conn->pool, 1);
+    irods_conn->checkTime = time (NULL);
+
     status = clientLogin (irods_conn->conn);
     if (status != 0) {
 #ifdef KRB_AUTH
@@ -1195,162 +1111,114 @@ int ifuseConnect (iquest_fuse_irods_conn_t *irods_conn) {
 int
 relIFuseConn (iquest_fuse_irods_conn_t *irods_conn)
 {
-    int status;
-
     if (irods_conn == NULL) return USER__NULL_INPUT_ERR;
-    unuseIFuseConn (irods_conn);
-    status = _relIFuseConn (irods_conn);
-    return status;
+    return unuseIFuseConn (irods_conn);
 }
  
-/* _relIFuseConn - call when calling from freeIFuseDesc where unuseIFuseConn
- * is not called */
+/* _relIFuseConn - call from freeIFuseDesc to drop the descriptor's hold on
+ * the connection */
 int
 _relIFuseConn (iquest_fuse_irods_conn_t *irods_conn)
 {
     if (irods_conn == NULL) return USER__NULL_INPUT_ERR;
-    pthread_mutex_lock (&ConnLock);
-    irods_conn->actTime = time (NULL);
-    if (irods_conn->conn == NULL) {
-        /* unlock it before calling irods_connInuse which locks DescLock */
-        pthread_mutex_unlock (&ConnLock);
-        if (irods_connInuse (irods_conn) == 0) {
-            pthread_mutex_lock (&ConnLock);
-            irods_conn->status = IRODS_FREE;
-            pthread_mutex_unlock (&ConnLock);
-        }
-    } else if (irods_conn->pendingCnt + irods_conn->inuseCnt <= 0) {
-        /* unlock it before calling irods_connInuse which locks DescLock */
-        pthread_mutex_unlock (&ConnLock);
-        if (irods_connInuse (irods_conn) == 0) {
-            pthread_mutex_lock (&ConnLock);
-            irods_conn->status = IRODS_FREE;
-            pthread_mutex_unlock (&ConnLock);
-	}
-    } else {
-        pthread_mutex_unlock (&ConnLock);
-    }
-    signal_conn_manager(irods_conn->iqf);
+    if (unbindConnDesc (irods_conn) > 0)
+	signal_conn_manager (irods_conn->iqf);
     return 0;
 }
 
-int signal_conn_manager(iquest_fuse_t *iqf) {
-    int connCnt;
-    pthread_mutex_lock (&ConnLock);
-    connCnt = get_conn_count(iqf);
-    pthread_mutex_unlock (&ConnLock);
-    if (connCnt > HIGH_NUM_CONN) {
-        pthread_mutex_lock (&ConnManagerLock);
-	pthread_cond_signal (&ConnManagerCond);
-        pthread_mutex_unlock (&ConnManagerLock);
-    }
-    return 0;
+static void wake_conn_manager () {
+    pthread_mutex_lock (&ConnManagerLock);
+    pthread_cond_signal (&ConnManagerCond);
+    pthread_mutex_unlock (&ConnManagerLock);
 }
 
-int disconnect_all (iquest_fuse_t *iqf) {
-    iquest_fuse_irods_conn_t *tmp_irods_conn;
-    pthread_mutex_lock (&ConnLock);
-    tmp_irods_conn = iqf->irods_conn_head;
-    while (tmp_irods_conn != NULL) {
-	if (tmp_irods_conn->conn != NULL) {
-	    rcDisconnect (tmp_irods_conn->conn);
-	    tmp_irods_conn->conn=NULL;
+int signal_conn_manager(iquest_fuse_t *iqf) {
+    int i;
+    for (i = 0; i < IQF_NUM_CONN_CLASSES; i++) {
+	if (countConnPool (iqf->conn_pool[i]) > connPoolLimit (iqf->conn_pool[i])) {
+	    wake_conn_manager ();
+	    break;
 	}
-	tmp_irods_conn = tmp_irods_conn->next;
     }
     return 0;
 }
 
-void conn_manager (iquest_fuse_t *iqf) {
-    time_t curTime;
-    iquest_fuse_irods_conn_t *tmp_irods_conn, *savedIFuseConn;
-    iquest_fuse_irods_conn_t *prevIquestFuseConn;
-    struct timespec timeout;
-    int freeCnt = 0;
+typedef struct iquest_conn_warmer {
+    iquest_fuse_t *iqf;
+    iquest_fuse_irods_conn_t *irods_conn;
+    int status;
+    pthread_t thr;
+    int started;
+} iquest_conn_warmer_t;
 
-    while (1) {
-	int connCnt;
-        curTime = time(NULL);
-
-        pthread_mutex_lock(&ConnLock);
-
-        tmp_irods_conn = iqf->irods_conn_head;
-	connCnt = 0;
-	prevIquestFuseConn = NULL;
-        while (tmp_irods_conn != NULL) {
-	    if (tmp_irods_conn->status == IRODS_FREE) freeCnt ++;
-	    if (curTime - tmp_irods_conn->actTime > IQF_CONN_TIMEOUT) {
-		if (tmp_irods_conn->status == IRODS_FREE) {
-		    /* can be disconnected */
-		    if (tmp_irods_conn->conn != NULL) {
-		        rcDisconnect (tmp_irods_conn->conn);
-			tmp_irods_conn->conn=NULL;
-		    }
-		    pthread_mutex_unlock (&tmp_irods_conn->lock);
-		    pthread_mutex_destroy (&tmp_irods_conn->lock);
-		    if (prevIquestFuseConn == NULL) {
-			/* top */
-			iqf->irods_conn_head = tmp_irods_conn->next;
-		    } else {
-			prevIquestFuseConn->next = tmp_irods_conn->next;
-		    }
-		    savedIFuseConn = tmp_irods_conn;
-		    tmp_irods_conn = tmp_irods_conn->next;
-		    free (savedIFuseConn);
-		    continue;
-		} 
-	    }
-	    connCnt++;
-	    prevIquestFuseConn = tmp_irods_conn;
-	    tmp_irods_conn = tmp_irods_conn->next;
-	}
-	if (MAX_NUM_CONN - connCnt > freeCnt) 
-            freeCnt = MAX_NUM_CONN - connCnt;
-
-	/* exceed high water mark for number of connection ? */
-	if (connCnt > HIGH_NUM_CONN) {
-            tmp_irods_conn = iqf->irods_conn_head;
-            prevIquestFuseConn = NULL;
-            while (tmp_irods_conn != NULL && connCnt > HIGH_NUM_CONN) {
-		if (tmp_irods_conn->status == IRODS_FREE) {
-                    /* can be disconnected */
-                    if (tmp_irods_conn->conn != NULL) {
-                        rcDisconnect (tmp_irods_conn->conn);
-	    		tmp_irods_conn->conn=NULL;
-                    }
-                    pthread_mutex_unlock (&tmp_irods_conn->lock);
-                    pthread_mutex_destroy (&tmp_irods_conn->lock);
-                    if (prevIquestFuseConn == NULL) {
-                        /* top */
-                        iqf->irods_conn_head = tmp_irods_conn->next;
-                    } else {
-                        prevIquestFuseConn->next = tmp_irods_conn->next;
-                    }
-                    savedIFuseConn = tmp_irods_conn;
-                    tmp_irods_conn = tmp_irods_conn->next;
-                    free (savedIFuseConn);
-		    connCnt--;
-                    continue;
-                }
-                prevIquestFuseConn = tmp_irods_conn;
-                tmp_irods_conn = tmp_irods_conn->next;
-            }
-	}
-	/* wake up the ConnReqWaitQue if freeCnt > 0 */
-        while (freeCnt > 0  && ConnReqWaitQue != NULL) {
-            /* signal one in the wait queue */
-            connReqWait_t *myConnReqWait;
-            myConnReqWait = ConnReqWaitQue;
-	    myConnReqWait->state = 1;
-            ConnReqWaitQue = myConnReqWait->next;
-            pthread_mutex_unlock (&ConnLock);
-            pthread_mutex_lock (&myConnReqWait->mutex);
-            pthread_cond_signal (& myConnReqWait->cond);
-            pthread_mutex_unlock (&myConnReqWait->mutex);
-            pthread_mutex_lock (&ConnLock);
-            freeCnt--;
+static void *iquest_warm_conn (void *arg) {
+    iquest_conn_warmer_t *warmer = (iquest_conn_warmer_t *) arg;
+
+    warmer->status = get_iquest_fuse_irods_conn (&warmer->irods_conn, warmer->iqf);
+    return NULL;
+}
+
+/*
+ * Opens (and logs in) numConns connections in parallel, so that the first
+ * requests after mounting do not wait for them.  Each is held until all
+ * are open, so that each thread gets a connection of its own.  Returns
+ * the number opened.
+ */
+int warm_iquest_fuse_irods_conns (iquest_fuse_t *iqf, int numConns) {
+    iquest_conn_warmer_t *warmer;
+    int numWarm = 0;
+    int i;
+
+    if (numConns <= 0) return 0;
+    warmer = (iquest_conn_warmer_t *) calloc (numConns, sizeof (iquest_conn_warmer_t));
+    if (warmer == NULL) {
+        return SYS_MALLOC_ERR;
+    }
+    for (i = 0; i < numConns; i++) {
+        warmer[i].iqf = iqf;
+        if (pthread_create (&warmer[i].thr, NULL, iquest_warm_conn, &warmer[i]) == 0) {
+            warmer[i].started = 1;
+        } else {
+            /* do it here instead */
+            iquest_warm_conn (&warmer[i]);
+        }
+    }
+    for (i = 0; i < numConns; i++) {
+        if (warmer[i].started) pthread_join (warmer[i].thr, NULL);
+    }
+    for (i = 0; i < numConns; i++) {
+        if (warmer[i].status == 0) {
+            relIFuseConn (warmer[i].irods_conn);
+            numWarm++;
+        } else {
+            rodsLogError (LOG_ERROR, warmer[i].status, "warm_iquest_fuse_irods_conns");
         }
-        pthread_mutex_unlock (&ConnLock);
+    }
+    free (warmer);
+    rodsLog (LOG_NOTICE, "warm_iquest_fuse_irods_conns: opened %d of %d iRODS connections", numWarm, numConns);
+    return numWarm;
+}
+
+int disconnect_all (iquest_fuse_t *iqf) {
+    int i;
+    for (i = 0; i < IQF_NUM_CONN_CLASSES; i++) {
+	if (iqf->conn_pool[i] != NULL)
+	    disconnectConnPool (iqf->conn_pool[i]);
+    }
+    return 0;
+}
+
+void conn_manager (iquest_fuse_t *iqf) {
+    struct timespec timeout;
+    int i;
+
+    while (1) {
+	/* adapt the pool to demand and drop idle connections that timed
+	 * out or are above the limit; waiters are woken by the pool */
+	for (i = 0; i < IQF_NUM_CONN_CLASSES; i++) {
+	    manageConnPool (iqf->conn_pool[i], IQF_CONN_TIMEOUT);
+	}
+
 	bzero (&timeout, sizeof (timeout));
 	timeout.tv_sec = time (0) + IQF_CONN_MANAGER_SLEEP_TIME;
 	pthread_mutex_lock (&ConnManagerLock);
@@ -1365,6 +1233,7 @@ int
 ifuseReconnect (iquest_fuse_irods_conn_t *irods_conn)
 {
     int status = 0;
+    int i;
 
     if (irods_conn == NULL || irods_conn->conn == NULL) 
 	return USER__NULL_INPUT_ERR;
@@ -1372,6 +1241,35 @@ ifuseReconnect (iquest_fuse_irods_conn_t *irods_conn)
     rcDisconnect (irods_conn->conn);
     irods_conn->conn=NULL;
     status = ifuseConnect (irods_conn);
+    /* whatever broke this may have broken the idle ones too (of either
+     * class): have them checked before anyone else gets one */
+    for (i = 0; i < IQF_NUM_CONN_CLASSES; i++) {
+	suspectConnPool (irods_conn->iqf->conn_pool[i]);
+    }
+    wake_conn_manager ();
+    return status;
+}
+
+/*
+ * Probes an idle connection for the conn manager, reconnecting it if it
+ * has broken.  Returns 0 if it is good to use.
+ */
+int check_iquest_fuse_irods_conn (iquest_fuse_irods_conn_t *irods_conn) {
+    miscSvrInfo_t *svrInfo = NULL;
+    int status;
+
+    if (irods_conn->conn == NULL) {
+	status = ifuseConnect (irods_conn);
+    } else {
+	status = rcGetMiscSvrInfo (irods_conn->conn, &svrInfo);
+	if (svrInfo != NULL) free (svrInfo);
+	if (status >= 0) return 0;
+	rodsLogError (LOG_NOTICE, status,
+	  "check_iquest_fuse_irods_conn: idle connection broken, reconnecting");
+	rcDisconnect (irods_conn->conn);
+	irods_conn->conn = NULL;
+	status = ifuseConnect (irods_conn);
+    }
     return status;
 }
 
@@ -1408,10 +1306,12 @@ pathCache_t **tmpPathCache)
     rstrcpy (NewlyCreatedFile[newlyInx].filePath, path, MAX_NAME_LEN);
     NewlyCreatedFile[newlyInx].descInx = descInx;
     NewlyCreatedFile[newlyInx].cachedTime = cachedTime;
-    IFuseDesc[descInx].newFlag = 1;    /* XXXXXXX use newlyInx ? */
-    fill_file_stat (&NewlyCreatedFile[newlyInx].stbuf, mode, 0, cachedTime, 
-      cachedTime, cachedTime);
-    addPathToCache (path, PathArray, &NewlyCreatedFile[newlyInx].stbuf, 
+    IFUSE_DESC(descInx).newFlag = 1;    /* XXXXXXX use newlyInx ? */
+    /* there is no DATA_ID to hand yet, so the inode is provisional until
+     * the file is next looked up in iRODS */
+    fill_file_stat (&NewlyCreatedFile[newlyInx].stbuf, iquest_virtual_ino (path),
+      mode, 0, cachedTime, cachedTime, cachedTime);
+    addPathToCache (path, &PathArray, &NewlyCreatedFile[newlyInx].stbuf, 
       tmpPathCache);
     pthread_mutex_unlock (&NewlyCreatedOprLock);
     return (0);
@@ -1474,7 +1374,23 @@ getDescInxInNewlyCreatedCache (char *path, int flags)
     return descInx;
 }
 
-int fill_file_stat(struct stat *stbuf, uint mode, rodsLong_t size, uint ctime, uint mtime, uint atime) {
+/*
+ * inode numbers for data objects (by DATA_ID), collections (by path) and
+ * the virtual directories of queries (by the path they are mounted at)
+ */
+ino_t iquest_data_obj_ino(const char *data_id) {
+  return IQF_INO(IQF_INO_NS_DATA_OBJ, strtoull(data_id, NULL, 10));
+}
+
+ino_t iquest_coll_ino(const char *coll_path) {
+  return IQF_INO(IQF_INO_NS_COLL, iquest_path_hash(coll_path));
+}
+
+ino_t iquest_virtual_ino(const char *path) {
+  return IQF_INO(IQF_INO_NS_VIRTUAL, iquest_path_hash(path));
+}
+
+int fill_file_stat(struct stat *stbuf, ino_t ino, uint mode, rodsLong_t size, uint ctime, uint mtime, uint atime) {
     if (mode >= 0100)
         stbuf->st_mode = S_IFREG | mode;
     else
@@ -1485,7 +1401,7 @@ int fill_file_stat(struct stat *stbuf, uint mode, rodsLong_t size, uint ctime, u
     stbuf->st_blocks = (stbuf->st_size / IQF_FILE_BLOCK_SIZE) + 1;
 
     stbuf->st_nlink = 1;
-    stbuf->st_ino = random ();
+    stbuf->st_ino = ino;
     stbuf->st_ctime = ctime;
     stbuf->st_mtime = mtime;
     stbuf->st_atime = atime;
@@ -1495,12 +1411,12 @@ int fill_file_stat(struct stat *stbuf, uint mode, rodsLong_t size, uint ctime, u
     return 0;
 }
 
-int fill_dir_stat(struct stat *stbuf, uint ctime, uint mtime, uint atime) {
+int fill_dir_stat(struct stat *stbuf, ino_t ino, uint ctime, uint mtime, uint atime) {
     stbuf->st_mode = S_IFDIR | IQF_DEFAULT_DIR_MODE;
     stbuf->st_size = IQF_DIR_SIZE;
 
     stbuf->st_nlink = 2;
-    stbuf->st_ino = random ();
+    stbuf->st_ino = ino;
     stbuf->st_ctime = ctime;
     stbuf->st_mtime = mtime;
     stbuf->st_atime = atime;
@@ -1510,25 +1426,28 @@ int fill_dir_stat(struct stat *stbuf, uint ctime, uint mtime, uint atime) {
     return 0;
 }
 
+/*
+ * Refreshes the cached size of path from its local cache file locCachePath
+ * (as copied out by getPathCacheFile), updating stbuf to match.  A changed
+ * size is published as a new entry rather than written into the old one.
+ */
 int 
-updatePathCacheStat (pathCache_t *tmpPathCache)
+updatePathCacheStat (char *path, char *locCachePath, struct stat *stbuf)
 {
     int status;
 
-    if (tmpPathCache->locCacheState != NO_FILE_CACHE &&
-      tmpPathCache->locCachePath != NULL) {
-	struct stat stbuf;
-	status = stat (tmpPathCache->locCachePath, &stbuf);
+    if (locCachePath != NULL && locCachePath[0] != '\0') {
+	struct stat locStbuf;
+	status = stat (locCachePath, &locStbuf);
 	if (status < 0) {
 	    return (errno ? (-1 * errno) : -1);
-	} else {
+	} else if (locStbuf.st_size != stbuf->st_size) {
 	    /* update the size */
-	    tmpPathCache->stbuf.st_size = stbuf.st_size; 
-	    return 0; 
+	    stbuf->st_size = locStbuf.st_size; 
+	    setPathCacheSize (path, &PathArray, locStbuf.st_size);
 	}
-    } else {
-	return 0;
     }
+    return 0;
 }
 
 /* need to call get_iquest_fuse_irods_conn before calling irodsMknodWithCache */
@@ -1553,9 +1472,33 @@ irodsMknodWithCache (char *path, mode_t mode, char *cachePath)
     }
 }
 
+/*
+ * Opens the local cache file of path, if it has one.  The name is only
+ * copied out of the path cache and opened within pathCacheReadLock so the
+ * file cannot be unlinked in between; nothing slow happens in there.
+ * Returns the fd, or -ENOENT if path has no local cache file.
+ */
+static int open_read_cache_file(char *path, int flags) {
+    char locCachePath[MAX_NAME_LEN];
+    int fd = -ENOENT;
+
+    pathCacheReadLock ();
+    if (getPathCacheFile (path, &PathArray, NULL, locCachePath) == 1 &&
+      locCachePath[0] != '\0') {
+        fd = open (locCachePath, flags);
+        if (fd < 0) {
+	    fd = (errno ? (-1 * errno) : -1);
+            rodsLog (LOG_ERROR,
+              "irodsOpenWithReadCache: local cache open error for %s, errno = %d",
+              locCachePath, -fd);
+        }
+    }
+    pathCacheReadUnlock ();
+    return fd;
+}
+
 /* need to call get_iquest_fuse_irods_conn before calling irodsOpenWithReadCache */
 int iquest_fuse_open_with_read_cache(iquest_fuse_irods_conn_t *irods_conn, char *path, int flags) {
-    pathCache_t *tmpPathCache = NULL;
     struct stat stbuf;
     int status;
     dataObjInp_t dataObjInp;
@@ -1565,28 +1508,29 @@ int iquest_fuse_open_with_read_cache(iquest_fuse_irods_conn_t *irods_conn, char
     /* do only O_RDONLY (0) */
     if ((flags & (O_WRONLY | O_RDWR)) != 0) return -1;
 
-    if (_iquest_fuse_irods_getattr(irods_conn, path, &stbuf, &tmpPathCache) < 0 ||
-      tmpPathCache == NULL) return -1;
+    if (_iquest_fuse_irods_getattr(irods_conn, path, &stbuf) < 0) return -1;
 
     /* too big to cache */
     if (stbuf.st_size > MAX_READ_CACHE_SIZE) return -1;	
 
-    if (tmpPathCache->locCachePath == NULL) {
+    memset (&dataObjInp, 0, sizeof (dataObjInp));
+    status = iquest_parse_rods_path_str(irods_conn->iqf, (char *) (path + 1), 
+      dataObjInp.objPath);
+    if (status < 0) {
+        rodsLogError (LOG_ERROR, status,
+          "irodsOpenWithReadCache: iquest_parse_rods_path_str of %s error", path);
+        /* use ENOTDIR for this type of error */
+        return -ENOTDIR;
+    }
+
+    fd = open_read_cache_file (path, flags);
+    if (fd == -ENOENT) {
 
         rodsLog (LOG_DEBUG, "irodsOpenWithReadCache: caching %s", path);
 
-        memset (&dataObjInp, 0, sizeof (dataObjInp));
         if ((status = getFileCachePath (path, cachePath)) < 0) 
 	    return status;
         /* get the file to local cache */
-	status = iquest_parse_rods_path_str(irods_conn->iqf, (char *) (path + 1), 
-          dataObjInp.objPath);
-        if (status < 0) {
-            rodsLogError (LOG_ERROR, status,
-              "irodsOpenWithReadCache: iquest_parse_rods_path_str of %s error", path);
-            /* use ENOTDIR for this type of error */
-            return -ENOTDIR;
-        }
         dataObjInp.openFlags = flags;
         dataObjInp.dataSize = stbuf.st_size;
 
@@ -1599,20 +1543,17 @@ int iquest_fuse_open_with_read_cache(iquest_fuse_irods_conn_t *irods_conn, char
 
 	    return status; 
 	}
-        tmpPathCache->locCachePath = strdup (cachePath);
-        tmpPathCache->locCacheState = HAVE_READ_CACHE;
+        /* another open of path may have cached it meanwhile; if so use that */
+        if (_addPathToCacheWithFile (path, &PathArray, &stbuf, time (0),
+          cachePath, HAVE_READ_CACHE, 0) <= 0) {
+            unlink (cachePath);
+        }
+        fd = open_read_cache_file (path, flags);
     } else {
         rodsLog (LOG_DEBUG, "irodsOpenWithReadCache: read cache match for %s",
           path);
     }
-
-    fd = open (tmpPathCache->locCachePath, flags);
-    if (fd < 0) {
-        rodsLog (LOG_ERROR,
-          "irodsOpenWithReadCache: local cache open error for %s, errno = %d",
-          tmpPathCache->locCachePath, errno);
-	return(errno ? (-1 * errno) : -1);
-    }
+    if (fd < 0) return fd;
 
     descInx = allocIFuseDesc ();
     if (descInx < 0) {
@@ -1623,7 +1564,7 @@ int iquest_fuse_open_with_read_cache(iquest_fuse_irods_conn_t *irods_conn, char
     }
     fillIFuseDesc (descInx, irods_conn, fd, dataObjInp.objPath,
       (char *) path);
-    IFuseDesc[descInx].locCacheState = HAVE_READ_CACHE;
+    IFUSE_DESC(descInx).locCacheState = HAVE_READ_CACHE;
 
     return descInx;
 }
@@ -1720,55 +1661,62 @@ int
 getNewlyCreatedDescByPath (char *path)
 {
     int i;
-    int inuseCnt = 0;
-
-    pthread_mutex_lock (&DescLock);
-    for (i = 3; i < MAX_IFUSE_DESC; i++) {
-	if (inuseCnt >= IFuseDescInuseCnt) break;
-        if (IFuseDesc[i].inuseFlag == IRODS_INUSE) { 
-            inuseCnt++;
-	    if (IFuseDesc[i].locCacheState != HAVE_NEWLY_CREATED_CACHE ||
-	      IFuseDesc[i].localPath == NULL) {
-	        continue;
-	    }
-	    if (strcmp (IFuseDesc[i].localPath, path) == 0) { 
-                pthread_mutex_unlock (&DescLock);
-                return (i);
-            }
+    uint64_t hash;
+
+    hash = iquest_path_hash (path);
+    pthread_rwlock_rdlock (&DescPathLock);
+    for (i = DescPathIndex[hash & (DESC_PATH_INDEX_SLOTS - 1)]; i != 0;
+      i = IFUSE_DESC(i).pathNext) {
+	if (IFUSE_DESC(i).pathHash != hash ||
+	  IFUSE_DESC(i).locCacheState != HAVE_NEWLY_CREATED_CACHE) {
+	    continue;
+	}
+	if (strcmp (IFUSE_DESC(i).localPath, path) == 0) { 
+	    pthread_rwlock_unlock (&DescPathLock);
+	    return (i);
 	}
     }
-    pthread_mutex_unlock (&DescLock);
+    pthread_rwlock_unlock (&DescPathLock);
     return (-1);
 }
 
+/* fromPathCache must have been looked up within pathCacheReadLock */
 int renmeOpenedIFuseDesc (iquest_fuse_t *iqf, pathCache_t *fromPathCache, char *to) {
     int descInx;
     int status;
-    pathCache_t *tmpPathCache = NULL;
+    struct stat stbuf = fromPathCache->stbuf;
+    char *locCachePath = NULL;
 
     if ((descInx = getNewlyCreatedDescByPath (
       (char *)fromPathCache->filePath)) >= 3) {
-        rmPathFromCache ((char *) to, PathArray);
-        rmPathFromCache ((char *) to, NonExistPathArray);
-	addPathToCache ((char *) to, PathArray, &fromPathCache->stbuf, 
-	  &tmpPathCache);
-        tmpPathCache->locCachePath = fromPathCache->locCachePath;
-	fromPathCache->locCachePath = NULL;
-        tmpPathCache->locCacheState = HAVE_NEWLY_CREATED_CACHE;
-	fromPathCache->locCacheState = NO_FILE_CACHE;
-	if (IFuseDesc[descInx].objPath != NULL) 
-	    free (IFuseDesc[descInx].objPath);
-	IFuseDesc[descInx].objPath = (char *) malloc (MAX_NAME_LEN);
+        rmPathFromCache ((char *) to, &PathArray);
+        rmPathFromCache ((char *) to, &NonExistPathArray);
+	addPathToCache ((char *) to, &PathArray, &stbuf, NULL);
+	/* move the local cache file over without touching either entry */
+	if (takePathCacheFile (fromPathCache->filePath, &PathArray,
+	  &locCachePath) > 0) {
+	    if (_addPathToCacheWithFile ((char *) to, &PathArray, &stbuf,
+	      time (0), locCachePath, HAVE_NEWLY_CREATED_CACHE, 1) <= 0) {
+		unlink (locCachePath);
+	    }
+	    free (locCachePath);
+	}
+	if (IFUSE_DESC(descInx).objPath != NULL) 
+	    free (IFUSE_DESC(descInx).objPath);
+	IFUSE_DESC(descInx).objPath = (char *) malloc (MAX_NAME_LEN);
         status = iquest_parse_rods_path_str(iqf, (char *) (to + 1),
-          IFuseDesc[descInx].objPath);
+          IFUSE_DESC(descInx).objPath);
         if (status < 0) {
             rodsLogError (LOG_ERROR, status,
               "renmeOpenedIFuseDesc: iquest_parse_rods_path_str of %s error", to);
             return -ENOTDIR;
         }
-	if (IFuseDesc[descInx].localPath != NULL) 
-	    free (IFuseDesc[descInx].localPath);
-        IFuseDesc[descInx].localPath = strdup (to);
+	desc_path_unlink (descInx);
+	if (IFUSE_DESC(descInx).localPath != NULL) 
+	    free (IFUSE_DESC(descInx).localPath);
+        IFUSE_DESC(descInx).localPath = strdup (to);
+	if (IFUSE_DESC(descInx).localPath != NULL)
+	    desc_path_link (descInx);
 	return 0;
     } else {
 	return -ENOTDIR;
@@ -1798,36 +1746,72 @@ int map_irods_auth_errors(int irods_err, int fuse_err) {
 
 
 
-int _iquest_fuse_irods_getattr(iquest_fuse_irods_conn_t *irods_conn, const char *path, struct stat *stbuf, pathCache_t **out_pathCache) {
-    int status;
-    dataObjInp_t dataObjInp;
-    rodsObjStat_t *rodsObjStatOut = NULL;
-#ifdef CACHE_FUSE_PATH
-    pathCache_t *nonExistPathCache;
-    pathCache_t *tmpPathCache;
-#endif
+/*
+ * Joins the request in flight for op on key, if any (see joinInFlight).
+ * op names the operation, so that keys of different operations cannot
+ * collide.
+ */
+static int iquest_join_in_flight(const char *op, const char *key, inFlight_t **out_flight, int *out_status, struct stat *out_stbuf, nameList_t **out_list) {
+  char *flight_key = NULL;
+  int status;
 
-    rodsLog (LOG_DEBUG, "_iquest_fuse_irods_getattr: %s", path);
+  *out_flight = NULL;
+  if (asprintf(&flight_key, "%s\n%s", op, key) < 0) {
+    return SYS_MALLOC_ERR;
+  }
+  status = joinInFlight(&InFlightRequests, flight_key, out_flight, out_status, out_stbuf, out_list);
+  free(flight_key);
+  return status;
+}
 
-#ifdef CACHE_FUSE_PATH 
-    if (out_pathCache != NULL) *out_pathCache = NULL;
-    if (matchPathInPathCache( (char *) path, NonExistPathArray, &nonExistPathCache) == 1) {
+/*
+ * Hands the result of a request led after iquest_join_in_flight to
+ * whoever has joined it since (if it could be put in flight at all).
+ */
+static void iquest_finish_in_flight(inFlight_t *flight, int status, struct stat *stbuf, nameList_t *list) {
+  if (flight != NULL) {
+    finishInFlight(&InFlightRequests, flight, status, stbuf, list);
+  }
+}
+
+#ifdef CACHE_FUSE_PATH
+/*
+ * Looks path up in PathArray and NonExistPathArray.
+ * Returns 0 (with stbuf filled in) on a hit, -ENOENT if path is known not
+ * to exist, or 1 on a miss.
+ */
+static int iquest_getattr_from_cache(const char *path, struct stat *stbuf) {
+    char locCachePath[MAX_NAME_LEN];
+
+    if (getPathCacheStat ((char *) path, &NonExistPathArray, NULL) == 1) {
         rodsLog (LOG_DEBUG, "_iquest_fuse_irods_getattr: a match for non existing path %s", 
 	  path);
         return -ENOENT;
     }
 
-    if (matchPathInPathCache ((char *) path, PathArray, &tmpPathCache) == 1) {
+    if (getPathCacheFile ((char *) path, &PathArray, stbuf, locCachePath) == 1) {
         rodsLog (LOG_DEBUG, "_iquest_fuse_irods_getattr: a match for path %s", path);
-	status = updatePathCacheStat (tmpPathCache);
-	if (status < 0) {
-	    /* we have a problem */
-	    rmPathFromCache ((char *) path, PathArray);
-	} else {
-	    *stbuf = tmpPathCache->stbuf;
-	    if (out_pathCache != NULL) *out_pathCache = tmpPathCache;
+	if (updatePathCacheStat ((char *) path, locCachePath, stbuf) >= 0) {
 	    return (0);
 	}
+	/* we have a problem */
+	rmPathFromCache ((char *) path, &PathArray);
+    }
+    return (1);
+}
+#endif
+
+int _iquest_fuse_irods_getattr(iquest_fuse_irods_conn_t *irods_conn, const char *path, struct stat *stbuf) {
+    int status;
+    dataObjInp_t dataObjInp;
+    rodsObjStat_t *rodsObjStatOut = NULL;
+
+    rodsLog (LOG_DEBUG, "_iquest_fuse_irods_getattr: %s", path);
+
+#ifdef CACHE_FUSE_PATH 
+    status = iquest_getattr_from_cache (path, stbuf);
+    if (status <= 0) {
+	return (status);
     }
 #endif
 
@@ -1854,7 +1838,15 @@ int _iquest_fuse_irods_getattr(iquest_fuse_irods_conn_t *irods_conn, const char
 	          "_iquest_fuse_irods_getattr: rcObjStat of %s error", path);
 	    }
 #ifdef CACHE_FUSE_PATH
-            addPathToCache ((char *) path, NonExistPathArray, stbuf, NULL);
+	    if (status == USER_FILE_DOES_NOT_EXIST) {
+		addPathToCache ((char *) path, &NonExistPathArray, stbuf, NULL);
+	    } else {
+		/* may well be gone by the next mount: keep it out of the file */
+		_addPathToCache ((char *) path, &NonExistPathArray, stbuf,
+		  time (0), NULL);
+	    }
+	    /* a cached listing of the parent may still show it */
+	    rmParentListFromCache ((char *) path);
 #endif
 	    
 	    return map_irods_auth_errors(status, -ENOENT);
@@ -1862,17 +1854,18 @@ int _iquest_fuse_irods_getattr(iquest_fuse_irods_conn_t *irods_conn, const char
     }
 
     if (rodsObjStatOut->objType == COLL_OBJ_T) {
-	fill_dir_stat(stbuf, 
+	fill_dir_stat(stbuf, iquest_coll_ino (dataObjInp.objPath),
 	  atoi (rodsObjStatOut->createTime), atoi (rodsObjStatOut->modifyTime),
 	  atoi (rodsObjStatOut->modifyTime));
     } else if (rodsObjStatOut->objType == UNKNOWN_OBJ_T) {
 #ifdef CACHE_FUSE_PATH
-        addPathToCache ((char *) path, NonExistPathArray, stbuf, NULL);
+        addPathToCache ((char *) path, &NonExistPathArray, stbuf, NULL);
 #endif
         if (rodsObjStatOut != NULL) freeRodsObjStat (rodsObjStatOut);
             return -ENOENT;
     } else {
-	fill_file_stat(stbuf, rodsObjStatOut->dataMode, rodsObjStatOut->objSize,
+	fill_file_stat(stbuf, iquest_data_obj_ino (rodsObjStatOut->dataId),
+	  rodsObjStatOut->dataMode, rodsObjStatOut->objSize,
 	  atoi (rodsObjStatOut->createTime), atoi (rodsObjStatOut->modifyTime),
 	  atoi (rodsObjStatOut->modifyTime));
     }
@@ -1881,7 +1874,7 @@ int _iquest_fuse_irods_getattr(iquest_fuse_irods_conn_t *irods_conn, const char
         freeRodsObjStat (rodsObjStatOut);
 
 #ifdef CACHE_FUSE_PATH
-    addPathToCache ((char *) path, PathArray, stbuf, out_pathCache);
+    addPathToCache ((char *) path, &PathArray, stbuf, NULL);
 #endif
     return 0;
 }
@@ -1971,24 +1964,155 @@ int iquest_genquery_add_select_str(genQueryInp_t *genQueryInp, char *select) {
   }
 */
 
+/*
+ * copies the conditions in query_cond into genQueryInp, which must have been
+ * zeroed; the copies are freed by clearGenQueryInp
+ */
 int iquest_genquery_set_query_cond(genQueryInp_t *genQueryInp, iquest_fuse_query_cond_t *query_cond) {
+  int i;
   int status;
 
-  status = clearInxVal( &genQueryInp->sqlCondInp );
-  if( status < 0) {
-    return -1;
+  for (i = 0; i < query_cond->where_cond->len; i++) {
+    status = addInxVal(&genQueryInp->sqlCondInp, query_cond->where_cond->inx[i], query_cond->where_cond->value[i]);
+    if( status < 0) {
+      return -1;
+    }
   }
-  genQueryInp->sqlCondInp = *query_cond->where_cond;
 
-  status = clearKeyVal( &genQueryInp->condInput );
-  if( status < 0) {
-    return -1;
+  for (i = 0; i < query_cond->cond->len; i++) {
+    status = addKeyVal(&genQueryInp->condInput, query_cond->cond->keyWord[i], query_cond->cond->value[i]);
+    if( status < 0) {
+      return -1;
+    }
   }
-  genQueryInp->condInput = *query_cond->cond;
   
   return 0;
 }
 
+/*
+ * Runs genQueryInp to completion, calling row_func for each row of every
+ * page of results.  If row_func returns non-zero the query is closed and
+ * that value returned.  A query that matches nothing is not an error.
+ */
+int iquest_genquery_run(iquest_fuse_t *iqf, genQueryInp_t *genQueryInp, int (*row_func)(genQueryOut_t *genQueryOut, int row, void *arg), void *arg) {
+  iquest_fuse_irods_conn_t *irods_conn = NULL;
+  genQueryOut_t *genQueryOut = NULL;
+  int status;
+  int i;
+
+  status = get_iquest_fuse_irods_conn(&irods_conn, iqf);
+  if (status != 0) {
+    return status;
+  }
+
+  /* now that we are connected, we can't return until cleanup */
+
+  genQueryInp->continueInx = 0;
+  rodsLog(LOG_DEBUG, "iquest_genquery_run: calling rcGenQuery");
+  status = rcGenQuery(irods_conn->conn, genQueryInp, &genQueryOut);
+  if (status < 0 && isReadMsgError(status)) {
+    ifuseReconnect(irods_conn);
+    status = rcGenQuery(irods_conn->conn, genQueryInp, &genQueryOut);
+  }
+  while (status == 0) {
+    rodsLog(LOG_DEBUG, "iquest_genquery_run: have %d attributes and %d rows", genQueryOut->attriCnt, genQueryOut->rowCnt);
+    for (i = 0; status == 0 && i < genQueryOut->rowCnt; i++) {
+      status = row_func(genQueryOut, i, arg);
+    }
+    if (status != 0 || genQueryOut->continueInx <= 0) {
+      break;
+    }
+    genQueryInp->continueInx = genQueryOut->continueInx;
+    freeGenQueryOut(&genQueryOut);
+    rodsLog(LOG_DEBUG, "iquest_genquery_run: calling rcGenQuery");
+    status = rcGenQuery(irods_conn->conn, genQueryInp, &genQueryOut);
+  }
+
+  if (genQueryOut != NULL && genQueryOut->continueInx > 0) {
+    /* stopped early: asking for no more rows closes the query */
+    genQueryInp->continueInx = genQueryOut->continueInx;
+    genQueryInp->maxRows = 0;
+    freeGenQueryOut(&genQueryOut);
+    rcGenQuery(irods_conn->conn, genQueryInp, &genQueryOut);
+  }
+  freeGenQueryOut(&genQueryOut);
+
+  if (status == CAT_NO_ROWS_FOUND) {
+    status = 0;
+  }
+
+  relIFuseConn(irods_conn);
+  return status;
+}
+
+static int iquest_query_cond_unit_cmp(const void *a, const void *b) {
+  return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/*
+ * Builds (in memory that must be freed) a cache key for a query against
+ * query_zone with query_cond, followed by extra.  The where conditions are
+ * sorted, so that the same conditions given in a different order in the
+ * path share a key; a metadata attribute name condition stays paired with
+ * the value condition that follows it.  Returns NULL if out of memory.
+ */
+char *iquest_query_cond_key(char *query_zone, iquest_fuse_query_cond_t *query_cond, char *extra) {
+  inxValPair_t *where_cond = query_cond->where_cond;
+  keyValPair_t *cond = query_cond->cond;
+  char **unit;
+  int num_units = 0;
+  size_t key_len;
+  char *key = NULL;
+  char *p;
+  int i;
+
+  unit = (char **)malloc_and_zero_or_exit((where_cond->len + 1) * sizeof(char *));
+  for (i = 0; i < where_cond->len; i++) {
+    int status;
+    if (where_cond->inx[i] == COL_META_DATA_ATTR_NAME && i + 1 < where_cond->len &&
+	where_cond->inx[i + 1] == COL_META_DATA_ATTR_VALUE) {
+      status = asprintf(&unit[num_units], "%d %s\t%d %s", where_cond->inx[i], where_cond->value[i],
+			where_cond->inx[i + 1], where_cond->value[i + 1]);
+      i++;
+    } else {
+      status = asprintf(&unit[num_units], "%d %s", where_cond->inx[i], where_cond->value[i]);
+    }
+    if (status < 0) {
+      rodsLog(LOG_ERROR, "iquest_query_cond_key: could not allocate memory for where condition");
+      goto cleanup;
+    }
+    num_units++;
+  }
+  qsort(unit, num_units, sizeof(char *), iquest_query_cond_unit_cmp);
+
+  if (query_zone == NULL) query_zone = "";
+  if (extra == NULL) extra = "";
+  key_len = strlen(query_zone) + 1 + strlen(extra) + 1;
+  for (i = 0; i < num_units; i++) {
+    key_len += strlen(unit[i]) + 1;
+  }
+  for (i = 0; i < cond->len; i++) {
+    key_len += strlen(cond->keyWord[i]) + strlen(cond->value[i]) + 2;
+  }
+
+  key = (char *)malloc_and_zero_or_exit(key_len);
+  p = key + sprintf(key, "%s\n", query_zone);
+  for (i = 0; i < num_units; i++) {
+    p += sprintf(p, "%s\n", unit[i]);
+  }
+  for (i = 0; i < cond->len; i++) {
+    p += sprintf(p, "%s=%s\n", cond->keyWord[i], cond->value[i]);
+  }
+  strcpy(p, extra);
+
+ cleanup:
+  for (i = 0; i < num_units; i++) {
+    free(unit[i]);
+  }
+  free(unit);
+  return key;
+}
+
 int iquest_genquery_add_where_str(genQueryInp_t *genQueryInp, char *where_attr, char *where_op, char *where_val) {
   int status;
 
@@ -2050,326 +2174,402 @@ int _iquest_where_cond_add(inxValPair_t *where_cond, char *where_attr, char *whe
   return(status);
 }
 
+static int iquest_add_row_to_list(genQueryOut_t *genQueryOut, int row, void *arg) {
+  nameList_t *list = (nameList_t *)arg;
+  sqlResult_t *v = &genQueryOut->sqlResult[0];
+  char *name = &v->value[v->len * row];
+
+  /* neither could be a directory entry */
+  if (name[0] == '\0' || strchr(name, '/') != NULL) {
+    rodsLog(LOG_DEBUG, "iquest_add_row_to_list: skipping [%s]", name);
+    return 0;
+  }
+  if (addNameToList(list, name, NULL) < 0) {
+    return -ENOMEM;
+  }
+  return 0;
+}
+
 /*
- * checks if the specified attr is valid given the query
- * returns 0 if the attr exists, error (<0) otherwise
+ * Queries for the distinct values of the select column for the query
+ * (restricted to the metadata attribute attr, unless it is NULL) and
+ * caches them under key.
  */
-int iquest_query_attr_exists(iquest_fuse_t *iqf, char *query_zone, iquest_fuse_query_cond_t *query_cond, char *attr) {
+static int iquest_fetch_query_list(iquest_fuse_t *iqf, listCacheTable_t *cache, const char *key, char *query_zone, iquest_fuse_query_cond_t *query_cond, char *select, char *attr, nameList_t **out_list) {
   genQueryInp_t genQueryInp;
-  genQueryOut_t *genQueryOut = NULL;
+  nameList_t *list;
   int status;
-  iquest_fuse_irods_conn_t *irods_conn = NULL;
-  int nf, nr;
-  char *found_attr;
 
-  rodsLog(LOG_DEBUG, "iquest_query_attr_exists: attr [%s]", attr);
-  
   memset(&genQueryInp, 0, sizeof (genQueryInp_t));
   status = iquest_genquery_set_query_cond(&genQueryInp, query_cond);
-  
-  if( query_zone != NULL && query_zone[0] != '\0' ) { 
+  if( status >= 0 && query_zone != NULL && query_zone[0] != '\0' ) {
     status = addKeyVal( &genQueryInp.condInput, ZONE_KW, query_zone);
-    if( status < 0) {
-      rodsLogError(LOG_ERROR, status, "iquest_query_attr_exists: addKeyVal");
-      return status;
-    }
-    rodsLog(LOG_DEBUG, "iquest_query_attr_exists: query_zone is %s", query_zone);
+    rodsLog(LOG_DEBUG, "iquest_get_query_list: query_zone is %s", query_zone);
   }
-
-  iquest_genquery_add_select_str(&genQueryInp, "META_DATA_ATTR_NAME");
-  iquest_genquery_add_where_str(&genQueryInp, "META_DATA_ATTR_NAME", "=", attr);
-  
-  genQueryInp.maxRows = MAX_SQL_ROWS;
-  genQueryInp.continueInx=0;
-  
-  status = get_iquest_fuse_irods_conn(&irods_conn, iqf);
-  if (status != 0) {
+  if( status >= 0 ) {
+    status = iquest_genquery_add_select_str(&genQueryInp, select);
+  }
+  if( status >= 0 && attr != NULL ) {
+    status = iquest_genquery_add_where_str(&genQueryInp, "META_DATA_ATTR_NAME", "=", attr);
+  }
+  if( status < 0 ) {
+    rodsLogError(LOG_ERROR, status, "iquest_get_query_list: could not build query");
+    clearGenQueryInp(&genQueryInp);
     return status;
   }
-  
-  /* now that we are connected, we can't return until cleanup */
+  genQueryInp.maxRows = MAX_SQL_ROWS;
 
-  rodsLog(LOG_DEBUG, "iquest_query_attr_exists: calling rcGenQuery");
-  status = rcGenQuery(irods_conn->conn, &genQueryInp, &genQueryOut);
+  list = newNameList(key, 0);
+  status = iquest_genquery_run(iqf, &genQueryInp, iquest_add_row_to_list, list);
+  clearGenQueryInp(&genQueryInp);
   if( status < 0 ) {
-    goto cleanup;
+    /* do not cache a partial listing */
+    rodsLogError(LOG_ERROR, status, "iquest_get_query_list: iquest_genquery_run");
+    releaseNameList(list);
+    return status;
   }
+#ifdef CACHE_FUSE_PATH
+  addListToCache(cache, list);
+#endif
+  *out_list = list;
+  return 0;
+}
+
+/*
+ * Gets the distinct values of the select column for the query (restricted
+ * to the metadata attribute attr, unless it is NULL), from cache if
+ * possible, or else from whoever is already querying for them.  On success
+ * *out_list is set to the list, which must be released with
+ * releaseNameList.
+ */
+static int iquest_get_query_list(iquest_fuse_t *iqf, listCacheTable_t *cache, char *query_zone, iquest_fuse_query_cond_t *query_cond, char *select, char *attr, nameList_t **out_list) {
+  inFlight_t *flight;
+  char *key;
+  int status;
 
-  nf = genQueryOut->attriCnt;
-  if(nf != 1) {
-    status = -200;
-    goto cleanup;
+  *out_list = NULL;
+  key = iquest_query_cond_key(query_zone, query_cond, attr);
+  if (key == NULL) {
+    return -ENOMEM;
   }
-  
-  nr = genQueryOut->rowCnt;
-  if( nr != 1 ) {
-    rodsLog(LOG_DEBUG, "iquest_query_attr_exists: have %d rows", nr);
-    status = -1;
-    goto cleanup;
+#ifdef CACHE_FUSE_PATH
+  *out_list = getListFromCache(cache, key);
+  if (*out_list != NULL) {
+    rodsLog(LOG_DEBUG, "iquest_get_query_list: have %u cached %s", (*out_list)->numNames, select);
+    free(key);
+    return 0;
   }
+#endif
 
-  rodsLog(LOG_DEBUG, "iquest_query_attr_exists: have %d fields and %d rows", nf, nr);
-
-  found_attr = &((&genQueryOut->sqlResult[0])->value[0]);
-  if( strcmp(found_attr, attr) != 0 ) {
-    rodsLog(LOG_DEBUG, "iquest_query_attr_exists: results were not equal [%s] != [%s]", found_attr, attr);
-    status = -1;
-    goto cleanup;
+  if (iquest_join_in_flight(cache->name, key, &flight, &status, NULL, out_list) == 0) {
+    free(key);
+    return status;
   }
-  
- cleanup:
-  relIFuseConn (irods_conn);
-  
-  rodsLog(LOG_DEBUG, "iquest_query_attr_exists: attr [%s] status [%d]", attr, status);
+  status = 1;
+#ifdef CACHE_FUSE_PATH
+  /* it may have been cached since we looked */
+  *out_list = getListFromCache(cache, key);
+  if (*out_list != NULL) {
+    status = 0;
+  }
+#endif
+  if (status > 0) {
+    status = iquest_fetch_query_list(iqf, cache, key, query_zone, query_cond, select, attr, out_list);
+  }
+  iquest_finish_in_flight(flight, status, NULL, *out_list);
+  free(key);
   return status;
 }
 
 /*
- * checks if the specified value is valid given the query
- * returns 0 if the value exists, error (<0) otherwise
+ * Gets the names of the metadata attributes matching query_cond in
+ * query_zone (see iquest_get_query_list).
  */
-int iquest_query_value_exists(iquest_fuse_t *iqf, char *query_zone, iquest_fuse_query_cond_t *query_cond, char *attr, char *value) {
-  genQueryInp_t genQueryInp;
-  genQueryOut_t *genQueryOut = NULL;
-  int status;
-  iquest_fuse_irods_conn_t *irods_conn = NULL;
-  int nf, nr;
-  char *found_attr;
+int iquest_get_attr_list(iquest_fuse_t *iqf, char *query_zone, iquest_fuse_query_cond_t *query_cond, nameList_t **out_list) {
+  return iquest_get_query_list(iqf, &AttrListCache, query_zone, query_cond, "META_DATA_ATTR_NAME", NULL, out_list);
+}
 
-  rodsLog(LOG_DEBUG, "iquest_query_value_exists: attr [%s]", attr);
-  
-  memset(&genQueryInp, 0, sizeof (genQueryInp_t));
-  status = iquest_genquery_set_query_cond(&genQueryInp, query_cond);
-  
-  if( query_zone != NULL && query_zone[0] != '\0' ) { 
-    status = addKeyVal( &genQueryInp.condInput, ZONE_KW, query_zone);
-    if( status < 0) {
-      rodsLogError(LOG_ERROR, status, "iquest_query_value_exists: addKeyVal");
-      return status;
-    }
-    rodsLog(LOG_DEBUG, "iquest_query_value_exists: query_zone is %s", query_zone);
-  }
+/*
+ * Gets the values of the metadata attribute attr matching query_cond in
+ * query_zone (see iquest_get_query_list).
+ */
+int iquest_get_value_list(iquest_fuse_t *iqf, char *query_zone, iquest_fuse_query_cond_t *query_cond, char *attr, nameList_t **out_list) {
+  return iquest_get_query_list(iqf, &ValueListCache, query_zone, query_cond, "META_DATA_ATTR_VALUE", attr, out_list);
+}
 
-  iquest_genquery_add_select_str(&genQueryInp, "META_DATA_ATTR_NAME");
-  iquest_genquery_add_where_str(&genQueryInp, "META_DATA_ATTR_NAME", "=", attr);
-  
-  genQueryInp.maxRows = MAX_SQL_ROWS;
-  genQueryInp.continueInx=0;
-  
-  status = get_iquest_fuse_irods_conn(&irods_conn, iqf);
-  if (status != 0) {
-    return status;
-  }
-  
-  /* now that we are connected, we can't return until cleanup */
+/* the columns of a completed query, in the order they are selected */
+static char *iquest_query_result_select[] = {
+  "DATA_ID", "DATA_NAME", "COLL_NAME", "DATA_SIZE",
+  "DATA_CREATE_TIME", "DATA_MODIFY_TIME", "DATA_MODE"
+};
+#define IQUEST_QUERY_RESULT_NUM_SELECT (sizeof(iquest_query_result_select) / sizeof(char *))
 
-  rodsLog(LOG_DEBUG, "iquest_query_value_exists: calling rcGenQuery");
-  status = rcGenQuery(irods_conn->conn, &genQueryInp, &genQueryOut);
-  if( status < 0 ) {
-    goto cleanup;
-  }
+static int iquest_add_row_to_query_result(genQueryOut_t *genQueryOut, int row, void *arg) {
+  nameList_t *result = (nameList_t *)arg;
+  char *col[IQUEST_QUERY_RESULT_NUM_SELECT];
+  unsigned int i;
 
-  nf = genQueryOut->attriCnt;
-  if(nf != 1) {
-    status = -200;
-    goto cleanup;
+  if( genQueryOut->attriCnt != IQUEST_QUERY_RESULT_NUM_SELECT ) {
+    rodsLog(LOG_ERROR, "iquest_add_row_to_query_result: have %d attributes", genQueryOut->attriCnt);
+    return -200;
   }
-  
-  nr = genQueryOut->rowCnt;
-  if( nr != 1 ) {
-    rodsLog(LOG_DEBUG, "iquest_query_value_exists: have %d rows", nr);
-    status = -1;
-    goto cleanup;
+  for (i = 0; i < IQUEST_QUERY_RESULT_NUM_SELECT; i++) {
+    sqlResult_t *v = &genQueryOut->sqlResult[i];
+    col[i] = &v->value[v->len * row];
   }
+  return addRowToQueryResult(result, col[1], col[2], strtoull(col[0], NULL, 10),
+			     strtoll(col[3], NULL, 10), atoi(col[4]), atoi(col[5]), atoi(col[6]));
+}
 
-  rodsLog(LOG_DEBUG, "iquest_query_value_exists: have %d fields and %d rows", nf, nr);
+/*
+ * Gets the data objects under coll_path that match the completed query
+ * query_cond in query_zone, from QueryResultCache if possible.  On success
+ * *out_result is set to the result, which must be released with
+ * releaseNameList.
+ */
+static int iquest_fetch_query_result(iquest_fuse_t *iqf, const char *key, char *coll_path, char *query_zone, iquest_fuse_query_cond_t *query_cond, nameList_t **out_result);
+
+int iquest_get_query_result(iquest_fuse_t *iqf, char *coll_path, char *query_zone, iquest_fuse_query_cond_t *query_cond, nameList_t **out_result) {
+  inFlight_t *flight;
+  char *key;
+  int status;
 
-  found_attr = &((&genQueryOut->sqlResult[0])->value[0]);
-  if( strcmp(found_attr, attr) != 0 ) {
-    rodsLog(LOG_DEBUG, "iquest_query_value_exists: results were not equal [%s] != [%s]", found_attr, attr);
-    status = -1;
-    goto cleanup;
+  *out_result = NULL;
+  key = iquest_query_cond_key(query_zone, query_cond, coll_path);
+  if (key == NULL) {
+    return -ENOMEM;
   }
-  
- cleanup:
-  relIFuseConn (irods_conn);
-  
-  rodsLog(LOG_DEBUG, "iquest_query_value_exists: attr [%s] status [%d]", attr, status);
+#ifdef CACHE_FUSE_PATH
+  *out_result = getListFromCache(&QueryResultCache, key);
+  if (*out_result != NULL) {
+    rodsLog(LOG_DEBUG, "iquest_get_query_result: have %u cached data objects", (*out_result)->numNames);
+    free(key);
+    return 0;
+  }
+#endif
+
+  if (iquest_join_in_flight(QueryResultCache.name, key, &flight, &status, NULL, out_result) == 0) {
+    free(key);
+    return status;
+  }
+  status = 1;
+#ifdef CACHE_FUSE_PATH
+  /* it may have been cached since we looked */
+  *out_result = getListFromCache(&QueryResultCache, key);
+  if (*out_result != NULL) {
+    status = 0;
+  }
+#endif
+  if (status > 0) {
+    status = iquest_fetch_query_result(iqf, key, coll_path, query_zone, query_cond, out_result);
+  }
+  iquest_finish_in_flight(flight, status, NULL, *out_result);
+  free(key);
   return status;
 }
 
-int iquest_query_and_fill_attr_list(iquest_fuse_t *iqf, char *query_zone, iquest_fuse_query_cond_t *query_cond, void *buf, fuse_fill_dir_t filler) {
+/*
+ * Queries for the data objects under coll_path that match the completed
+ * query query_cond in query_zone, and caches them under key.
+ */
+static int iquest_fetch_query_result(iquest_fuse_t *iqf, const char *key, char *coll_path, char *query_zone, iquest_fuse_query_cond_t *query_cond, nameList_t **out_result) {
   genQueryInp_t genQueryInp;
-  genQueryOut_t *genQueryOut = NULL;
+  nameList_t *result;
+  unsigned int i;
   int status;
-  struct stat stbuf;
-  int i = 0;
-
-  rodsLog(LOG_DEBUG, "iquest_query_and_fill_attr_list");
 
   memset(&genQueryInp, 0, sizeof (genQueryInp_t));
   status = iquest_genquery_set_query_cond(&genQueryInp, query_cond);
-
-  memset(&stbuf, 0, sizeof(struct stat));
-
-  if( query_zone != NULL && query_zone[0] != '\0' ) { 
-    addKeyVal( &genQueryInp.condInput, ZONE_KW, query_zone);
-    if( status < 0) {
-      rodsLogError(LOG_ERROR, status, "iquest_query_and_fill_value_list: addKeyVal");
-      return status;
+  if( status >= 0 && query_zone != NULL && query_zone[0] != '\0' ) {
+    status = addKeyVal( &genQueryInp.condInput, ZONE_KW, query_zone);
+    rodsLog(LOG_DEBUG, "iquest_get_query_result: query_zone is %s", query_zone);
+  }
+  if( status >= 0 && strcmp(coll_path, IQF_PATH_SEP) != 0 ) {
+    /* only what is in or below the collection the query was made in */
+    char *scope = NULL;
+    if( asprintf(&scope, "like '%s/%%' || = '%s'", coll_path, coll_path) < 0 ) {
+      status = SYS_MALLOC_ERR;
+    } else {
+      status = addInxVal(&genQueryInp.sqlCondInp, getAttrIdFromAttrName("COLL_NAME"), scope);
+      free(scope);
     }
-    rodsLog(LOG_DEBUG, "iquest_query_and_fill_value_list: query_zone is %s", query_zone);
   }
-
-  // SELECT META_DATA_ATTR_NAME
-  iquest_genquery_add_select_str(&genQueryInp, "META_DATA_ATTR_NAME");
-
-  // WHERE
-  //iquest_genquery_add_where_str(&genQueryInp, "META_DATA_ATTR_NAME", "=", "target");
-
+  for (i = 0; status >= 0 && i < IQUEST_QUERY_RESULT_NUM_SELECT; i++) {
+    status = iquest_genquery_add_select_str(&genQueryInp, iquest_query_result_select[i]);
+  }
+  if( status < 0 ) {
+    rodsLogError(LOG_ERROR, status, "iquest_get_query_result: could not build query");
+    clearGenQueryInp(&genQueryInp);
+    return status;
+  }
   genQueryInp.maxRows = MAX_SQL_ROWS;
-  genQueryInp.continueInx=0;
 
-  fill_dir_stat(&stbuf, 0, 0, 0);
-
-  int connstat = -1;
-  iquest_fuse_irods_conn_t *irods_conn = NULL;
-  connstat = get_iquest_fuse_irods_conn(&irods_conn, iqf);
-  if (connstat != 0) {
-    return connstat;
+  result = newQueryResult(key);
+  status = iquest_genquery_run(iqf, &genQueryInp, iquest_add_row_to_query_result, result);
+  clearGenQueryInp(&genQueryInp);
+  if( status < 0 ) {
+    /* do not cache a partial result */
+    rodsLogError(LOG_ERROR, status, "iquest_get_query_result: iquest_genquery_run");
+    releaseNameList(result);
+    return status;
   }
+  finishQueryResult(result);
+#ifdef CACHE_FUSE_PATH
+  addListToCache(&QueryResultCache, result);
+#endif
+  *out_result = result;
+  return 0;
+}
 
-  /* now that we are connected, we can't return until cleanup */
-
-  rodsLog(LOG_DEBUG, "iquest_query_and_fill_attr_list: calling rcGenQuery");
-  status = rcGenQuery(irods_conn->conn, &genQueryInp, &genQueryOut);
-  if( status < 0 ) {
-    goto cleanup;
-  }
-  do {
-    sqlResult_t *v[MAX_SQL_ATTR];
-    int nf, nr;
-    nf = genQueryOut->attriCnt;
-    if(nf != 1) {
-      status = -200;
-      break;
-    }
-    
-    for (i = 0; i < nf; i++) {
-      v[i] = &genQueryOut->sqlResult[i];
-      //cname[i] = getAttrNameFromAttrId(v[i]->attriInx);
-      //if (cname[i] == NULL)
-      //return(NO_COLUMN_NAME_FOUND);
-    }
-    
-    nr = genQueryOut->rowCnt;
-    rodsLog(LOG_DEBUG, "iquest_query_and_fill_attr_list: have %d attributes and %d rows", nf, nr);
-    for( i = 0; i < nr; i++ ) {
-      //&v[0]->value[v[0]->len * i],&v[1]->value[v[1]->len * i]
-      //rodsLog(LOG_DEBUG, "iquest_query_and_fill_attr_list: calling filler(%s)", &v[0]->value[v[0]->len * i]);
-      filler(buf, &v[0]->value[v[0]->len * i], &stbuf, 0);
-    }
-
-    genQueryInp.continueInx=genQueryOut->continueInx;
-    rodsLog(LOG_DEBUG, "iquest_query_and_fill_attr_list: calling rcGenQuery");
-    status = rcGenQuery(irods_conn->conn, &genQueryInp, &genQueryOut);
-    if (status < 0) {
-      goto cleanup;
+/*
+ * If path is an entry in the directory of a completed query, copies the
+ * iRODS path of the data object it stands for into obj_path (which must
+ * hold MAX_NAME_LEN characters) and returns 1.  Returns 0 if path is not
+ * in a query and < 0 if it is but does not name a data object.
+ */
+int iquest_query_path_to_obj_path(iquest_fuse_t *iqf, const char *path, char *obj_path) {
+  char coll_path[MAX_NAME_LEN];
+  char zone_hint[MAX_NAME_LEN];
+  char *coll = NULL;
+  iquest_fuse_query_cond_t *query_cond = NULL;
+  char *query_part_attr = NULL;
+  char *pqpath = NULL;
+  nameList_t *result = NULL;
+  char *_path;
+  int query_mode;
+  int status;
+  int row;
+
+  _path = strdup(path);
+  query_mode = iquest_parse_fuse_path(iqf, _path, &coll, &query_cond, &query_part_attr, &pqpath);
+  if( query_mode < -1 ) {
+    status = query_mode;
+  } else if( query_mode > 0 ) {
+    /* Q and Q/attr are directories */
+    status = -EISDIR;
+  } else if( query_cond->where_cond->len == 0 ) {
+    status = 0;
+  } else if( pqpath[0] == '\0' ) {
+    /* the query directory itself */
+    status = -EISDIR;
+  } else if( strchr(pqpath, '/') != NULL ) {
+    status = -ENOENT;
+  } else if( (status = iquest_parse_rods_path_str(iqf, coll, coll_path)) == 0 &&
+	     (status = iquest_zone_hint_from_rods_path(iqf, coll_path, zone_hint)) == 0 &&
+	     (status = iquest_get_query_result(iqf, coll_path, zone_hint, query_cond, &result)) == 0 ) {
+    row = findNameInList(result, pqpath);
+    if( row < 0 ) {
+      status = -ENOENT;
+    } else {
+      status = getQueryResultPath(result, row, obj_path);
+      if( status == 0 ) {
+	rodsLog(LOG_DEBUG, "iquest_query_path_to_obj_path: %s is %s", path, obj_path);
+	status = 1;
+      }
     }
-  } while (status==0 && genQueryOut->continueInx > 0);
+    releaseNameList(result);
+  }
 
-  /* add built-in column names */
-  for(i = 0; i < NumOfColumnNames; i++) {
-    //filler(buf, columnNames[i].columnName, &stbuf, 0);
+  free(coll);
+  if( query_cond != NULL ) {
+    iquest_fuse_query_cond_destroy(query_cond);
   }
-  
- cleanup:
-  relIFuseConn (irods_conn);
+  free(query_part_attr);
+  free(pqpath);
+  free(_path);
   return status;
 }
 
-int iquest_query_and_fill_value_list(iquest_fuse_t *iqf, char *query_zone, iquest_fuse_query_cond_t *query_cond, char *attr, void *buf, fuse_fill_dir_t filler) {
-  genQueryInp_t genQueryInp;
-  genQueryOut_t *genQueryOut = NULL;
+/*
+ * checks if the specified attr is valid given the query
+ * returns 0 if the attr exists, error (<0) otherwise
+ */
+int iquest_query_attr_exists(iquest_fuse_t *iqf, char *query_zone, iquest_fuse_query_cond_t *query_cond, char *attr) {
+  nameList_t *attr_list = NULL;
   int status;
-  struct stat stbuf;
 
-  rodsLog(LOG_DEBUG, "iquest_query_and_fill_value_list: called with attr [%s]",attr);
-  
-  memset(&genQueryInp, 0, sizeof (genQueryInp_t));
-  status = iquest_genquery_set_query_cond(&genQueryInp, query_cond);
+  rodsLog(LOG_DEBUG, "iquest_query_attr_exists: attr [%s]", attr);
+
+  status = iquest_get_attr_list(iqf, query_zone, query_cond, &attr_list);
   if( status < 0 ) {
-    return -1;
+    return status;
   }
+  status = findNameInList(attr_list, attr) >= 0 ? 0 : -ENOENT;
+  releaseNameList(attr_list);
 
-  memset(&stbuf, 0, sizeof(struct stat));
+  rodsLog(LOG_DEBUG, "iquest_query_attr_exists: attr [%s] status [%d]", attr, status);
+  return status;
+}
 
-  //  if( iqf->conf->irods_zone != NULL && iqf->conf->irods_zone[0] != '\0' ) { 
-  //    addKeyVal( &genQueryInp.condInput, ZONE_KW, iqf->conf->irods_zone);
-  //    rodsLog(LOG_DEBUG, "iquest_query_and_fill_value_list: zone is %s", iqf->conf->irods_zone);
-  //  }
-  if( query_zone != NULL && query_zone[0] != '\0' ) { 
-    addKeyVal( &genQueryInp.condInput, ZONE_KW, query_zone);
-    rodsLog(LOG_DEBUG, "iquest_query_and_fill_value_list: query_zone is %s", query_zone);
-  }
+/*
+ * checks if the specified value is valid given the query
+ * returns 0 if the value exists, error (<0) otherwise
+ */
+int iquest_query_value_exists(iquest_fuse_t *iqf, char *query_zone, iquest_fuse_query_cond_t *query_cond, char *attr, char *value) {
+  nameList_t *value_list = NULL;
+  int status;
 
-  iquest_genquery_add_select_str(&genQueryInp, "META_DATA_ATTR_VALUE");
+  rodsLog(LOG_DEBUG, "iquest_query_value_exists: attr [%s] value [%s]", attr, value);
 
-  iquest_genquery_add_where_str(&genQueryInp, "META_DATA_ATTR_NAME", "=", attr);
+  status = iquest_get_value_list(iqf, query_zone, query_cond, attr, &value_list);
+  if( status < 0 ) {
+    return status;
+  }
+  status = findNameInList(value_list, value) >= 0 ? 0 : -ENOENT;
+  releaseNameList(value_list);
 
-  genQueryInp.maxRows= MAX_SQL_ROWS;
-  genQueryInp.continueInx=0;
+  rodsLog(LOG_DEBUG, "iquest_query_value_exists: attr [%s] status [%d]", attr, status);
+  return status;
+}
+
+/*
+ * fills the directory path with the names in list, each as a directory
+ */
+static int iquest_fill_query_list(const char *path, nameList_t *list, void *buf, fuse_fill_dir_t filler) {
+  char child_path[MAX_NAME_LEN];
+  struct stat stbuf;
+  unsigned int i;
 
-  fill_dir_stat(&stbuf, 0, 0, 0);
+  memset(&stbuf, 0, sizeof(struct stat));
 
-  int connstat = -1;
-  iquest_fuse_irods_conn_t *irods_conn = NULL;
-  connstat = get_iquest_fuse_irods_conn(&irods_conn, iqf);
-  if (connstat != 0) {
-    return connstat;
+  for( i = 0; i < list->numNames; i++ ) {
+    snprintf(child_path, MAX_NAME_LEN, "%s/%s", path, NAME_LIST_NAME(list, i));
+    fill_dir_stat(&stbuf, iquest_virtual_ino(child_path), 0, 0, 0);
+    if( filler(buf, NAME_LIST_NAME(list, i), &stbuf, 0) != 0 ) {
+      rodsLog(LOG_ERROR, "iquest_fill_query_list: filler error");
+      return -ENOMEM;
+    }
   }
+  return 0;
+}
 
-  /* now that we are connected, we can't return until cleanup */
+int iquest_query_and_fill_attr_list(iquest_fuse_t *iqf, const char *path, char *query_zone, iquest_fuse_query_cond_t *query_cond, void *buf, fuse_fill_dir_t filler) {
+  nameList_t *attr_list = NULL;
+  int status;
+
+  rodsLog(LOG_DEBUG, "iquest_query_and_fill_attr_list");
 
-  rodsLog(LOG_DEBUG, "iquest_query_and_fill_value_list: calling rcGenQuery");
-  status = rcGenQuery(irods_conn->conn, &genQueryInp, &genQueryOut);
+  status = iquest_get_attr_list(iqf, query_zone, query_cond, &attr_list);
   if( status < 0 ) {
-    goto cleanup;
-  }
-  do {
-    sqlResult_t *v[MAX_SQL_ATTR];
-    int i, nf, nr;
-    nf = genQueryOut->attriCnt;
-    if(nf != 1) {
-      status = -200;
-      break;
-    }
-    
-    for (i = 0; i < nf; i++) {
-      v[i] = &genQueryOut->sqlResult[i];
-      //cname[i] = getAttrNameFromAttrId(v[i]->attriInx);
-      //if (cname[i] == NULL)
-      //return(NO_COLUMN_NAME_FOUND);
-    }
+    return status;
+  }
+  status = iquest_fill_query_list(path, attr_list, buf, filler);
+  releaseNameList(attr_list);
+  return status;
+}
 
-    nr = genQueryOut->rowCnt;
-    rodsLog(LOG_DEBUG, "iquest_query_and_fill_value_list: have %d attributes and %d rows", nf, nr);
-    for( i = 0; i < nr; i++ ) {
-      //&v[0]->value[v[0]->len * i],&v[1]->value[v[1]->len * i]
-      //rodsLog(LOG_DEBUG, "iquest_query_and_fill_value_list: calling filler(%s)", &v[0]->value[v[0]->len * i]);
-      filler(buf, &v[0]->value[v[0]->len * i], &stbuf, 0);
-    }
+int iquest_query_and_fill_value_list(iquest_fuse_t *iqf, const char *path, char *query_zone, iquest_fuse_query_cond_t *query_cond, char *attr, void *buf, fuse_fill_dir_t filler) {
+  nameList_t *value_list = NULL;
+  int status;
 
-    genQueryInp.continueInx=genQueryOut->continueInx;
-    rodsLog(LOG_DEBUG, "iquest_query_and_fill_value_list: calling rcGenQuery");
-    status = rcGenQuery(irods_conn->conn, &genQueryInp, &genQueryOut);
-    if (status < 0) {
-      goto cleanup;
-    }
-  } while (status==0 && genQueryOut->continueInx > 0);
-  
- cleanup:
-  relIFuseConn (irods_conn);
+  rodsLog(LOG_DEBUG, "iquest_query_and_fill_value_list: called with attr [%s]",attr);
+
+  status = iquest_get_value_list(iqf, query_zone, query_cond, attr, &value_list);
+  if( status < 0 ) {
+    return status;
+  }
+  status = iquest_fill_query_list(path, value_list, buf, filler);
+  releaseNameList(value_list);
   return status;
 }
 
@@ -2602,6 +2802,39 @@ int iquest_parse_fuse_path(iquest_fuse_t *iqf, char *path, char **rods_path, iqu
   return query_mode;
 }
 
+#ifdef CACHE_FUSE_PATH
+/*
+ * Caches the stats of entries first to first + count - 1 of a listing of
+ * path in PathArray, in one bulk insert.  Stats that are already cached
+ * are kept unless replace is set.
+ */
+static int iquest_cache_list_stats(const char *path, nameList_t *list, unsigned int first, unsigned int count, int replace) {
+  char **names;
+  unsigned int i;
+  int status;
+
+  if (list->stbuf == NULL || first >= list->numNames) {
+    return 0;
+  }
+  if (count > list->numNames - first) {
+    count = list->numNames - first;
+  }
+  if (count == 0) {
+    return 0;
+  }
+  names = (char **) malloc(count * sizeof(char *));
+  if (names == NULL) {
+    return -ENOMEM;
+  }
+  for (i = 0; i < count; i++) {
+    names[i] = NAME_LIST_NAME(list, first + i);
+  }
+  status = addChildPathsToCache(&PathArray, path, count, names, &list->stbuf[first], replace);
+  free(names);
+  return status;
+}
+#endif
+
 /*
  * ReadDir when no query is present in the path
  */
@@ -2611,9 +2844,9 @@ int iquest_readdir_coll(iquest_fuse_t *iqf, const char *path, void *buf, fuse_fi
     collEnt_t collEnt;
     int status = -1;
     int connstat = -1;
-#ifdef CACHE_FUSE_PATH
     struct stat stbuf;
-    pathCache_t *tmpPathCache;
+#ifdef CACHE_FUSE_PATH
+    nameList_t *list;
 #endif
     /* don't know why we need this. the example have them */
     (void) offset;
@@ -2653,51 +2886,625 @@ int iquest_readdir_coll(iquest_fuse_t *iqf, const char *path, void *buf, fuse_fi
 		return map_irods_auth_errors(status, -ENOENT);
 	}
     }
+#ifdef CACHE_FUSE_PATH
+    list = newNameList (path, 1);
+#endif
     while ((status = rclReadCollection (irods_conn->conn, &collHandle, &collEnt))
       >= 0) {
 	char myDir[MAX_NAME_LEN], mySubDir[MAX_NAME_LEN];
-#ifdef CACHE_FUSE_PATH
-	char childPath[MAX_NAME_LEN];
+	char *name;
 
 	bzero (&stbuf, sizeof (struct stat));
-#endif
         if (collEnt.objType == DATA_OBJ_T) {
-	    filler (buf, collEnt.dataName, NULL, 0);
-#ifdef CACHE_FUSE_PATH
-	    if (strcmp (path, IQF_PATH_SEP) == 0) {
-	        snprintf (childPath, MAX_NAME_LEN, "/%s", collEnt.dataName);
-	    } else {
-	        snprintf (childPath, MAX_NAME_LEN, "%s/%s", 
-		  path, collEnt.dataName);
-	    }
-            if (matchPathInPathCache ((char *) childPath, PathArray, 
-	      &tmpPathCache) != 1) {
-	        fill_file_stat(&stbuf, collEnt.dataMode, collEnt.dataSize,
-	          atoi (collEnt.createTime), atoi (collEnt.modifyTime), 
-	          atoi (collEnt.modifyTime));
-	        addPathToCache (childPath, PathArray, &stbuf, &tmpPathCache);
-	    }
-#endif
+	    name = collEnt.dataName;
+	    fill_file_stat(&stbuf, iquest_data_obj_ino (collEnt.dataId),
+	      collEnt.dataMode, collEnt.dataSize,
+	      atoi (collEnt.createTime), atoi (collEnt.modifyTime), 
+	      atoi (collEnt.modifyTime));
         } else if (collEnt.objType == COLL_OBJ_T) {
 	    splitPathByKey (collEnt.collName, myDir, mySubDir, '/');
-	    filler (buf, mySubDir, NULL, 0);
+	    name = mySubDir;
+	    fill_dir_stat(&stbuf, iquest_coll_ino (collEnt.collName),
+	      atoi (collEnt.createTime), atoi (collEnt.modifyTime), 
+	      atoi (collEnt.modifyTime));
+        } else {
+	    continue;
+	}
+	filler (buf, name, &stbuf, 0);
 #ifdef CACHE_FUSE_PATH
-            if (strcmp (path, IQF_PATH_SEP) == 0) {
-                snprintf (childPath, MAX_NAME_LEN, "/%s", mySubDir);
-            } else {
-	        snprintf (childPath, MAX_NAME_LEN, "%s/%s", path, mySubDir);
-	    }
-            if (matchPathInPathCache ((char *) childPath, PathArray, 
-              &tmpPathCache) != 1) {
-	        fill_dir_stat(&stbuf, 
-	          atoi (collEnt.createTime), atoi (collEnt.modifyTime), 
-	          atoi (collEnt.modifyTime));
-	        addPathToCache (childPath, PathArray, &stbuf, &tmpPathCache);
-	    }
+	addNameToList (list, name, &stbuf);
 #endif
-        }
     }
+#ifdef CACHE_FUSE_PATH
+    iquest_cache_list_stats (path, list, 0, list->numNames, 0);
+    releaseNameList (list);
+#endif
     rclCloseCollection (&collHandle);
     relIFuseConn (irods_conn);
     return map_irods_auth_errors(status, 0);
 }
+
+/*
+ * drops the cached listing of the collection containing path
+ */
+int rmParentListFromCache(char *path) {
+  char parent[MAX_NAME_LEN];
+  char *slash;
+
+  rstrcpy(parent, path, MAX_NAME_LEN);
+  slash = strrchr(parent, '/');
+  if (slash == NULL) return 0;
+  if (slash == parent) {
+    slash[1] = '\0';
+  } else {
+    slash[0] = '\0';
+  }
+  return rmListFromCache(&CollListCache, parent);
+}
+
+/*
+ * Lists the collection coll_path (mounted at path) from iRODS, caching a
+ * stat for each entry in PathArray and the whole listing in CollListCache.
+ * On success *out_list is set to the listing, which must be released with
+ * releaseNameList.
+ */
+static int _iquest_fetch_coll_list(iquest_fuse_t *iqf, const char *path, char *coll_path, nameList_t **out_list) {
+  iquest_fuse_irods_conn_t *irods_conn = NULL;
+  collHandle_t collHandle;
+  collEnt_t collEnt;
+  nameList_t *list;
+  struct stat stbuf;
+  int status;
+
+  *out_list = NULL;
+  status = get_iquest_fuse_irods_conn(&irods_conn, iqf);
+  if (status != 0) return status;
+
+  rodsLog(LOG_DEBUG, "iquest_fetch_coll_list: calling rclOpenCollection for %s", coll_path);
+  status = rclOpenCollection(irods_conn->conn, coll_path, DATA_QUERY_FIRST_FG, &collHandle);
+  if (status < 0) {
+    if (isReadMsgError(status)) {
+      ifuseReconnect(irods_conn);
+      status = rclOpenCollection(irods_conn->conn, coll_path, DATA_QUERY_FIRST_FG, &collHandle);
+    }
+    if (status < 0) {
+      rodsLog(LOG_ERROR, "iquest_fetch_coll_list: rclOpenCollection of %s error. status = %d", coll_path, status);
+      relIFuseConn(irods_conn);
+      return map_irods_auth_errors(status, -ENOENT);
+    }
+  }
+
+  list = newNameList(path, 1);
+  list->queryTime = list->fullTime = time(0);
+  while ((status = rclReadCollection(irods_conn->conn, &collHandle, &collEnt)) >= 0) {
+    char myDir[MAX_NAME_LEN], mySubDir[MAX_NAME_LEN];
+    char *name;
+
+    bzero(&stbuf, sizeof(struct stat));
+    if (collEnt.objType == DATA_OBJ_T) {
+      name = collEnt.dataName;
+      fill_file_stat(&stbuf, iquest_data_obj_ino(collEnt.dataId),
+		     collEnt.dataMode, collEnt.dataSize,
+		     atoi(collEnt.createTime), atoi(collEnt.modifyTime),
+		     atoi(collEnt.modifyTime));
+    } else {
+      splitPathByKey(collEnt.collName, myDir, mySubDir, '/');
+      name = mySubDir;
+      fill_dir_stat(&stbuf, iquest_coll_ino(collEnt.collName),
+		    atoi(collEnt.createTime), atoi(collEnt.modifyTime),
+		    atoi(collEnt.modifyTime));
+    }
+    if (strcmp(name, "") == 0) {
+      rodsLog(LOG_DEBUG, "iquest_fetch_coll_list: skipping empty name in [%s]", coll_path);
+      continue;
+    }
+    if (addNameToList(list, name, &stbuf) < 0) {
+      rodsLog(LOG_ERROR, "iquest_fetch_coll_list: could not add [%s] to listing of %s", name, coll_path);
+      status = -ENOMEM;
+      break;
+    }
+  }
+  rclCloseCollection(&collHandle);
+  relIFuseConn(irods_conn);
+
+  if (status < 0 && status != CAT_NO_ROWS_FOUND) {
+    /* do not cache a partial listing */
+    releaseNameList(list);
+    if (status == -ENOMEM) return status;
+    return map_irods_auth_errors(status, -ENOENT);
+  }
+#ifdef CACHE_FUSE_PATH
+  iquest_cache_list_stats(path, list, 0, list->numNames, 0);
+  addListToCache(&CollListCache, list);
+#endif
+  *out_list = list;
+  return 0;
+}
+
+static char *iquest_data_obj_stat_select[] = {
+  "DATA_NAME", "DATA_ID", "DATA_SIZE", "DATA_MODE", "DATA_CREATE_TIME", "DATA_MODIFY_TIME"
+};
+static char *iquest_coll_stat_select[] = {
+  "COLL_NAME", "COLL_CREATE_TIME", "COLL_MODIFY_TIME"
+};
+
+/* SELECT DATA_NAME, DATA_ID, DATA_SIZE, DATA_MODE, DATA_CREATE_TIME, DATA_MODIFY_TIME */
+static int iquest_add_data_obj_delta(genQueryOut_t *genQueryOut, int row, void *arg) {
+  nameList_t *delta = (nameList_t *)arg;
+  char *col[6];
+  struct stat stbuf;
+  int i;
+
+  if (genQueryOut->attriCnt != 6) {
+    return -200;
+  }
+  for (i = 0; i < 6; i++) {
+    sqlResult_t *v = &genQueryOut->sqlResult[i];
+    col[i] = &v->value[v->len * row];
+  }
+  bzero(&stbuf, sizeof(struct stat));
+  fill_file_stat(&stbuf, iquest_data_obj_ino(col[1]), atoi(col[3]), strtoll(col[2], NULL, 10),
+		 atoi(col[4]), atoi(col[5]), atoi(col[5]));
+  return internNameInList(delta, col[0], &stbuf);
+}
+
+/* SELECT COLL_NAME, COLL_CREATE_TIME, COLL_MODIFY_TIME */
+static int iquest_add_coll_delta(genQueryOut_t *genQueryOut, int row, void *arg) {
+  nameList_t *delta = (nameList_t *)arg;
+  char *col[3];
+  char myDir[MAX_NAME_LEN], mySubDir[MAX_NAME_LEN];
+  struct stat stbuf;
+  int i;
+
+  if (genQueryOut->attriCnt != 3) {
+    return -200;
+  }
+  for (i = 0; i < 3; i++) {
+    sqlResult_t *v = &genQueryOut->sqlResult[i];
+    col[i] = &v->value[v->len * row];
+  }
+  splitPathByKey(col[0], myDir, mySubDir, '/');
+  if (strcmp(mySubDir, "") == 0) {
+    return 0;
+  }
+  bzero(&stbuf, sizeof(struct stat));
+  fill_dir_stat(&stbuf, iquest_coll_ino(col[0]), atoi(col[1]), atoi(col[2]), atoi(col[2]));
+  return internNameInList(delta, mySubDir, &stbuf);
+}
+
+/*
+ * runs one delta query for the entries of coll_path of a kind (data objects
+ * or sub-collections) changed since `since'
+ */
+static int iquest_run_coll_delta_query(iquest_fuse_t *iqf, nameList_t *delta, char *coll_path, char **select, int num_select, char *parent_col, char *time_col, char *since, int (*row_func)(genQueryOut_t *genQueryOut, int row, void *arg)) {
+  genQueryInp_t genQueryInp;
+  int status = 0;
+  int i;
+
+  memset(&genQueryInp, 0, sizeof (genQueryInp_t));
+  for (i = 0; status >= 0 && i < num_select; i++) {
+    status = iquest_genquery_add_select_str(&genQueryInp, select[i]);
+  }
+  if (status >= 0) {
+    status = iquest_genquery_add_where_str(&genQueryInp, parent_col, "=", coll_path);
+  }
+  if (status >= 0) {
+    status = iquest_genquery_add_where_str(&genQueryInp, time_col, ">", since);
+  }
+  if (status >= 0) {
+    genQueryInp.maxRows = MAX_SQL_ROWS;
+    status = iquest_genquery_run(iqf, &genQueryInp, row_func, delta);
+  }
+  clearGenQueryInp(&genQueryInp);
+  return status;
+}
+
+/*
+ * Refreshes an expired listing of the collection coll_path (mounted at
+ * path) by asking only for the data objects and sub-collections modified
+ * since it was last queried, and merging them into it (and PathArray).
+ * Entries that have gone are not noticed until the next full listing.
+ * On success *out_list is set to the refreshed listing, which must be
+ * released with releaseNameList.
+ */
+static int _iquest_refresh_coll_list(iquest_fuse_t *iqf, const char *path, char *coll_path, nameList_t *old_list, nameList_t **out_list) {
+  nameList_t *list;
+  unsigned int num_changed;
+  char since[TIME_LEN];
+  unsigned int i;
+  int status;
+
+  *out_list = NULL;
+  if (old_list->stbuf == NULL) {
+    return -1;
+  }
+
+  /* catalog times are the server's, so overlap with the last query */
+  snprintf(since, TIME_LEN, "%011u", old_list->queryTime > LIST_CACHE_REFRESH_SKEW ?
+	   old_list->queryTime - LIST_CACHE_REFRESH_SKEW : 0);
+  rodsLog(LOG_DEBUG, "iquest_refresh_coll_list: refreshing %s with changes since %s", coll_path, since);
+
+  list = newNameList(path, 1);
+  list->queryTime = time(0);
+  list->fullTime = old_list->fullTime;
+
+  /* changed entries go in first, so they take the place of the old ones */
+  status = iquest_run_coll_delta_query(iqf, list, coll_path, iquest_data_obj_stat_select, 6,
+				       "COLL_NAME", "DATA_MODIFY_TIME", since, iquest_add_data_obj_delta);
+  if (status >= 0) {
+    status = iquest_run_coll_delta_query(iqf, list, coll_path, iquest_coll_stat_select, 3,
+					 "COLL_PARENT_NAME", "COLL_MODIFY_TIME", since, iquest_add_coll_delta);
+  }
+  if (status < 0) {
+    rodsLogError(LOG_ERROR, status, "iquest_refresh_coll_list: delta query of %s", coll_path);
+    releaseNameList(list);
+    return status;
+  }
+  num_changed = list->numNames;
+  rodsLog(LOG_DEBUG, "iquest_refresh_coll_list: %u entries of %s changed", num_changed, coll_path);
+
+  for (i = 0; i < old_list->numNames; i++) {
+    status = internNameInList(list, NAME_LIST_NAME(old_list, i), &old_list->stbuf[i]);
+    if (status < 0) {
+      releaseNameList(list);
+      return status;
+    }
+  }
+#ifdef CACHE_FUSE_PATH
+  /*
+   * only the changed entries replace the stats we have: the rest are as
+   * old as the listing, and getattr may have cached newer ones since
+   */
+  iquest_cache_list_stats(path, list, 0, num_changed, 1);
+  iquest_cache_list_stats(path, list, num_changed, list->numNames - num_changed, 0);
+  addListToCache(&CollListCache, list);
+#endif
+  *out_list = list;
+  return 0;
+}
+
+/*
+ * Lists (or, given the expired old_list, refreshes) the collection
+ * coll_path mounted at path, unless someone else is already doing so, in
+ * which case their listing is used.
+ */
+static int iquest_get_coll_list(iquest_fuse_t *iqf, const char *path, char *coll_path, nameList_t *old_list, nameList_t **out_list) {
+  inFlight_t *flight;
+  int status;
+
+  *out_list = NULL;
+  if (iquest_join_in_flight(CollListCache.name, path, &flight, &status, NULL, out_list) == 0) {
+    return status;
+  }
+  status = 1;
+#ifdef CACHE_FUSE_PATH
+  /* it may have been listed since we looked */
+  *out_list = getListFromCache(&CollListCache, path);
+  if (*out_list != NULL) {
+    status = 0;
+  }
+#endif
+  if (status > 0) {
+    if (old_list != NULL) {
+      status = _iquest_refresh_coll_list(iqf, path, coll_path, old_list, out_list);
+    } else {
+      status = _iquest_fetch_coll_list(iqf, path, coll_path, out_list);
+    }
+  }
+  iquest_finish_in_flight(flight, status, NULL, *out_list);
+  return status;
+}
+
+/*
+ * Lists a collection (see _iquest_fetch_coll_list), sharing the listing
+ * with anyone else asking for it at the same time.
+ */
+int iquest_fetch_coll_list(iquest_fuse_t *iqf, const char *path, char *coll_path, nameList_t **out_list) {
+  return iquest_get_coll_list(iqf, path, coll_path, NULL, out_list);
+}
+
+/*
+ * Refreshes a collection listing (see _iquest_refresh_coll_list), sharing
+ * it with anyone else asking for it at the same time.
+ */
+int iquest_refresh_coll_list(iquest_fuse_t *iqf, const char *path, char *coll_path, nameList_t *old_list, nameList_t **out_list) {
+  return iquest_get_coll_list(iqf, path, coll_path, old_list, out_list);
+}
+
+/*
+ * Batching of stat misses.
+ * Concurrent getattr misses for entries of the same collection are gathered
+ * for up to stat_batch_window msecs and answered together, by one query for
+ * the data objects and one for the sub-collections among them, instead of
+ * an rcObjStat each.  The first miss leads the batch: it waits out the
+ * window, runs the queries and hands every waiter its stat (or -ENOENT).
+ * Nobody holds a connection while waiting.
+ */
+typedef struct iquest_stat_waiter {
+  const char *name;
+  struct stat *stbuf;
+  int status;			/* 0, -ENOENT, or 1 to stat on its own */
+  int done;
+  struct iquest_stat_waiter *next;
+} iquest_stat_waiter_t;
+
+typedef struct iquest_stat_batch {
+  char coll_path[MAX_NAME_LEN];	/* collection of the entries */
+  char path[MAX_NAME_LEN];	/* where it is mounted */
+  unsigned int num_names;
+  size_t cond_len;		/* of the longer IN condition */
+  iquest_stat_waiter_t *waiters;
+  struct iquest_stat_batch *next;
+} iquest_stat_batch_t;
+
+static pthread_mutex_t StatBatchLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t StatBatchCond = PTHREAD_COND_INITIALIZER;
+static iquest_stat_batch_t *StatBatches = NULL;	/* those still gathering */
+static int StatMissesInFlight = 0;
+
+/*
+ * builds the condition "IN ('a', 'b', ...)" for the names in a batch, each
+ * prefixed with prefix, in a malloc'd string
+ */
+static char *iquest_stat_batch_in_cond(iquest_stat_batch_t *batch, const char *prefix) {
+  iquest_stat_waiter_t *w;
+  size_t len = 8;
+  char *cond, *p;
+
+  for (w = batch->waiters; w != NULL; w = w->next) {
+    len += strlen(prefix) + strlen(w->name) + 4;
+  }
+  cond = (char *) malloc(len);
+  if (cond == NULL) return NULL;
+  p = cond + sprintf(cond, "IN (");
+  for (w = batch->waiters; w != NULL; w = w->next) {
+    p += sprintf(p, "%s'%s%s'", w == batch->waiters ? "" : ", ", prefix, w->name);
+  }
+  sprintf(p, ")");
+  return cond;
+}
+
+/*
+ * queries for the stats of every name in batch, interning the ones found
+ * into found
+ */
+static int iquest_run_stat_batch(iquest_fuse_t *iqf, iquest_stat_batch_t *batch, nameList_t *found) {
+  genQueryInp_t genQueryInp;
+  char prefix[MAX_NAME_LEN];
+  char *cond;
+  int status = 0;
+  int i;
+
+  /* data objects */
+  memset(&genQueryInp, 0, sizeof (genQueryInp_t));
+  for (i = 0; status >= 0 && i < 6; i++) {
+    status = iquest_genquery_add_select_str(&genQueryInp, iquest_data_obj_stat_select[i]);
+  }
+  if (status >= 0) {
+    status = iquest_genquery_add_where_str(&genQueryInp, "COLL_NAME", "=", batch->coll_path);
+  }
+  if (status >= 0) {
+    cond = iquest_stat_batch_in_cond(batch, "");
+    status = cond != NULL ? addInxVal(&genQueryInp.sqlCondInp, getAttrIdFromAttrName("DATA_NAME"), cond) : SYS_MALLOC_ERR;
+    free(cond);
+  }
+  if (status >= 0) {
+    genQueryInp.maxRows = MAX_SQL_ROWS;
+    status = iquest_genquery_run(iqf, &genQueryInp, iquest_add_data_obj_delta, found);
+  }
+  clearGenQueryInp(&genQueryInp);
+  if (status < 0 || found->numNames == batch->num_names) {
+    return status;
+  }
+
+  /* sub-collections, by full name */
+  snprintf(prefix, MAX_NAME_LEN, "%s/", strcmp(batch->coll_path, "/") == 0 ? "" : batch->coll_path);
+  memset(&genQueryInp, 0, sizeof (genQueryInp_t));
+  for (i = 0; status >= 0 && i < 3; i++) {
+    status = iquest_genquery_add_select_str(&genQueryInp, iquest_coll_stat_select[i]);
+  }
+  if (status >= 0) {
+    cond = iquest_stat_batch_in_cond(batch, prefix);
+    status = cond != NULL ? addInxVal(&genQueryInp.sqlCondInp, getAttrIdFromAttrName("COLL_NAME"), cond) : SYS_MALLOC_ERR;
+    free(cond);
+  }
+  if (status >= 0) {
+    genQueryInp.maxRows = MAX_SQL_ROWS;
+    status = iquest_genquery_run(iqf, &genQueryInp, iquest_add_coll_delta, found);
+  }
+  clearGenQueryInp(&genQueryInp);
+  return status;
+}
+
+/*
+ * Stats obj_path (mounted at path) as part of a batch with other misses in
+ * the same collection.
+ * Returns 0 with stbuf filled in, -ENOENT if it does not exist, or 1 if it
+ * could not be batched and has to be stat'ed on its own.
+ */
+static int iquest_batch_stat(iquest_fuse_t *iqf, const char *path, char *obj_path, struct stat *stbuf) {
+  char coll_path[MAX_NAME_LEN], name[MAX_NAME_LEN];
+  char parent[MAX_NAME_LEN], child[MAX_NAME_LEN];
+  iquest_stat_batch_t *batch, **bp;
+  iquest_stat_waiter_t waiter, *w;
+  nameList_t *found;
+  size_t cond_len;
+  int status;
+
+  if (iqf->conf->stat_batch_window == 0) {
+    return 1;
+  }
+  splitPathByKey(obj_path, coll_path, name, '/');
+  splitPathByKey((char *) path, parent, child, '/');
+  if (coll_path[0] == '\0' || name[0] == '\0' || strchr(name, '\'') != NULL) {
+    return 1;
+  }
+  if (parent[0] == '\0') {
+    strcpy(parent, IQF_PATH_SEP);
+  }
+  cond_len = strlen(coll_path) + strlen(name) + 5;
+
+  bzero(&waiter, sizeof(waiter));
+  waiter.name = name;
+  waiter.stbuf = stbuf;
+  waiter.status = 1;
+
+  pthread_mutex_lock(&StatBatchLock);
+  for (batch = StatBatches; batch != NULL; batch = batch->next) {
+    if (strcmp(batch->coll_path, coll_path) == 0 && strcmp(batch->path, parent) == 0 &&
+	batch->num_names < IQF_STAT_BATCH_MAX_NAMES &&
+	batch->cond_len + cond_len <= IQF_STAT_BATCH_MAX_COND_LEN) {
+      break;
+    }
+  }
+  if (batch != NULL) {
+    /* join it and wait for the leader to answer */
+    waiter.next = batch->waiters;
+    batch->waiters = &waiter;
+    batch->num_names++;
+    batch->cond_len += cond_len;
+    while (!waiter.done) {
+      pthread_cond_wait(&StatBatchCond, &StatBatchLock);
+    }
+    pthread_mutex_unlock(&StatBatchLock);
+    return waiter.status;
+  }
+  if (__atomic_load_n(&StatMissesInFlight, __ATOMIC_RELAXED) <= 1) {
+    /* nobody to batch with */
+    pthread_mutex_unlock(&StatBatchLock);
+    return 1;
+  }
+  batch = (iquest_stat_batch_t *) malloc_and_zero_or_exit(sizeof(iquest_stat_batch_t));
+  rstrcpy(batch->coll_path, coll_path, MAX_NAME_LEN);
+  rstrcpy(batch->path, parent, MAX_NAME_LEN);
+  batch->waiters = &waiter;
+  batch->num_names = 1;
+  batch->cond_len = cond_len;
+  batch->next = StatBatches;
+  StatBatches = batch;
+  pthread_mutex_unlock(&StatBatchLock);
+
+  usleep(iqf->conf->stat_batch_window * 1000);
+
+  pthread_mutex_lock(&StatBatchLock);
+  for (bp = &StatBatches; *bp != batch; bp = &(*bp)->next);
+  *bp = batch->next;
+  pthread_mutex_unlock(&StatBatchLock);
+
+  /* the batch is closed, so its waiters can be read without the lock */
+  found = newNameList(parent, 1);
+  status = 1;
+  if (batch->num_names > 1) {
+    rodsLog(LOG_DEBUG, "iquest_batch_stat: querying %u entries of %s together", batch->num_names, coll_path);
+    status = iquest_run_stat_batch(iqf, batch, found);
+    if (status < 0) {
+      rodsLogError(LOG_ERROR, status, "iquest_batch_stat: batched stat of %u entries of %s", batch->num_names, coll_path);
+    }
+  }
+  if (status >= 0 && batch->num_names > 1) {
+    int any_missing = 0;
+    for (w = batch->waiters; w != NULL; w = w->next) {
+      int row = findNameInList(found, w->name);
+      if (row >= 0) {
+	*w->stbuf = found->stbuf[row];
+	w->status = 0;
+      } else {
+	w->status = -ENOENT;
+	any_missing = 1;
+      }
+    }
+#ifdef CACHE_FUSE_PATH
+    iquest_cache_list_stats(parent, found, 0, found->numNames, 1);
+    for (w = batch->waiters; w != NULL; w = w->next) {
+      if (w->status == -ENOENT) {
+	struct stat stbuf;
+	snprintf(child, MAX_NAME_LEN, "%s/%s", strcmp(parent, IQF_PATH_SEP) == 0 ? "" : parent, w->name);
+	bzero(&stbuf, sizeof(struct stat));
+	addPathToCache(child, &NonExistPathArray, &stbuf, NULL);
+      }
+    }
+    if (any_missing) {
+      /* a cached listing of the parent may still show them */
+      rmListFromCache(&CollListCache, parent);
+    }
+#endif
+  }
+  releaseNameList(found);
+
+  pthread_mutex_lock(&StatBatchLock);
+  for (w = batch->waiters; w != NULL; w = w->next) {
+    w->done = 1;
+  }
+  pthread_cond_broadcast(&StatBatchCond);
+  pthread_mutex_unlock(&StatBatchLock);
+  free(batch);
+  return waiter.status;
+}
+
+/*
+ * getattr for a path with no query in it.  A miss is batched with other
+ * concurrent misses in the same collection where possible, and only takes
+ * a connection if it has to be stat'ed on its own.
+ */
+int iquest_fuse_irods_getattr(iquest_fuse_t *iqf, const char *path, struct stat *stbuf) {
+  iquest_fuse_irods_conn_t *irods_conn = NULL;
+  char obj_path[MAX_NAME_LEN];
+  inFlight_t *flight;
+  int status;
+
+#ifdef CACHE_FUSE_PATH
+  status = iquest_getattr_from_cache(path, stbuf);
+  if (status <= 0) {
+    return status;
+  }
+#endif
+  /* someone may already be asking for the same path */
+  if (iquest_join_in_flight("stat", path, &flight, &status, stbuf, NULL) == 0) {
+    return status;
+  }
+  status = 1;
+#ifdef CACHE_FUSE_PATH
+  /* or may have just done so */
+  status = iquest_getattr_from_cache(path, stbuf);
+#endif
+  if (status > 0) {
+    __atomic_fetch_add(&StatMissesInFlight, 1, __ATOMIC_RELAXED);
+    if (iquest_parse_rods_path_str(iqf, (char *) (path + 1), obj_path) >= 0) {
+      status = iquest_batch_stat(iqf, path, obj_path, stbuf);
+    }
+    if (status > 0) {
+      status = get_iquest_fuse_irods_conn(&irods_conn, iqf);
+      if (status == 0) {
+	status = _iquest_fuse_irods_getattr(irods_conn, path, stbuf);
+	relIFuseConn(irods_conn);
+      }
+    }
+    __atomic_fetch_sub(&StatMissesInFlight, 1, __ATOMIC_RELAXED);
+  }
+  iquest_finish_in_flight(flight, status, stbuf, NULL);
+  return status;
+}
+
+/*
+ * Fills a directory from a collection listing, passing the stat of each
+ * entry to the filler.  If the listing came from the cache, stats that have
+ * since dropped out of PathArray are put back so that the getattr calls
+ * following the readdir do not go to the server.
+ */
+int iquest_fill_coll_list(const char *path, nameList_t *list, int from_cache, void *buf, fuse_fill_dir_t filler) {
+  unsigned int i;
+
+  for (i = 0; i < list->numNames; i++) {
+    struct stat *stbuf = list->stbuf != NULL ? &list->stbuf[i] : NULL;
+    if (filler(buf, NAME_LIST_NAME(list, i), stbuf, 0) != 0) {
+      rodsLog(LOG_ERROR, "iquest_fill_coll_list: filler error");
+      return -ENOMEM;
+    }
+  }
+#ifdef CACHE_FUSE_PATH
+  if (from_cache) {
+    iquest_cache_list_stats(path, list, 0, list->numNames, 0);
+  }
+#endif
+  return 0;
+}
@@ -0,0 +1,430 @@
+/*****************************************************************************
+ * Copyright (c) 2012 Genome Research Ltd.
+ *
+ * Author: Joshua C. Randall <jcrandall@alum.mit.edu>
+ *
+ * This file is part of iquestFuse.
+ *
+ * iquestFuse is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Implementation of the iquestFuse listing cache.
+ *
+ * Tables are chained hash tables protected by a single mutex, which is only
+ * held to find, link or unlink a list; filling a directory from a list is
+ * done without it, under a reference.  Lists are expired lazily when they
+ * are looked up and evicted in least recently used order when a table goes
+ * over its byte budget.
+ *****************************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+
+#include "iquest_fuse.h"
+#include "iquest_fuse_lib.h"
+#include "iquest_fuse_list_cache.h"
+
+/*
+ * allocates a new, empty name list with one reference held by the caller
+ * if withStat is nonzero a stat is kept for each name
+ */
+nameList_t *newNameList(const char *key, int withStat) {
+  nameList_t *list;
+
+  list = (nameList_t *) malloc_and_zero_or_exit(sizeof(nameList_t));
+  list->key = strdup(key);
+  list->hash = iquest_path_hash(key);
+  list->refCnt = 1;
+  list->maxNames = NAME_LIST_INIT_NAMES;
+  list->nameOffset = (unsigned int *) malloc_and_zero_or_exit(list->maxNames * sizeof(unsigned int));
+  if (withStat) {
+    list->stbuf = (struct stat *) malloc_and_zero_or_exit(list->maxNames * sizeof(struct stat));
+  }
+  list->arenaSize = NAME_LIST_INIT_ARENA;
+  list->arena = (char *) malloc_and_zero_or_exit(list->arenaSize);
+  return list;
+}
+
+/*
+ * appends a name (and its stat, if the list keeps them) to a list that has
+ * not been published yet
+ */
+int addNameToList(nameList_t *list, const char *name, struct stat *stbuf) {
+  size_t len = strlen(name) + 1;
+
+  if (list->numNames >= list->maxNames) {
+    unsigned int maxNames = list->maxNames * 2;
+    unsigned int *nameOffset;
+    nameOffset = (unsigned int *) realloc(list->nameOffset, maxNames * sizeof(unsigned int));
+    if (nameOffset == NULL) return SYS_MALLOC_ERR;
+    list->nameOffset = nameOffset;
+    if (list->stbuf != NULL) {
+      struct stat *newStbuf = (struct stat *) realloc(list->stbuf, maxNames * sizeof(struct stat));
+      if (newStbuf == NULL) return SYS_MALLOC_ERR;
+      list->stbuf = newStbuf;
+    }
+    list->maxNames = maxNames;
+  }
+  if (list->arenaLen + len > list->arenaSize) {
+    size_t arenaSize = list->arenaSize * 2;
+    char *arena;
+    while (arenaSize < list->arenaLen + len) arenaSize *= 2;
+    arena = (char *) realloc(list->arena, arenaSize);
+    if (arena == NULL) return SYS_MALLOC_ERR;
+    list->arena = arena;
+    list->arenaSize = arenaSize;
+  }
+
+  memcpy(list->arena + list->arenaLen, name, len);
+  list->nameOffset[list->numNames] = list->arenaLen;
+  if (list->stbuf != NULL) {
+    if (stbuf != NULL) {
+      list->stbuf[list->numNames] = *stbuf;
+    } else {
+      bzero(&list->stbuf[list->numNames], sizeof(struct stat));
+    }
+  }
+  list->arenaLen += len;
+  list->numNames++;
+  return 0;
+}
+
+/*
+ * (re)builds the hash index of a list with indexSize slots
+ */
+static int name_list_index(nameList_t *list, unsigned int indexSize) {
+  unsigned int *index;
+  unsigned int i, j, mask;
+
+  index = (unsigned int *) calloc(indexSize, sizeof(unsigned int));
+  if (index == NULL) return SYS_MALLOC_ERR;
+  mask = indexSize - 1;
+  for (i = 0; i < list->numNames; i++) {
+    j = iquest_path_hash(NAME_LIST_NAME(list, i)) & mask;
+    while (index[j] != 0) {
+      j = (j + 1) & mask;
+    }
+    index[j] = i + 1;
+  }
+  free(list->index);
+  list->index = index;
+  list->indexSize = indexSize;
+  return 0;
+}
+
+/*
+ * trims the arrays of a finished list to size and builds its hash index
+ */
+static int name_list_seal(nameList_t *list) {
+  unsigned int indexSize;
+  void *p;
+
+  if (list->numNames > 0 && list->numNames < list->maxNames) {
+    if ((p = realloc(list->nameOffset, list->numNames * sizeof(unsigned int))) != NULL) {
+      list->nameOffset = (unsigned int *) p;
+    }
+    if (list->stbuf != NULL &&
+	(p = realloc(list->stbuf, list->numNames * sizeof(struct stat))) != NULL) {
+      list->stbuf = (struct stat *) p;
+    }
+    list->maxNames = list->numNames;
+  }
+  if (list->arenaLen > 0 && list->arenaLen < list->arenaSize &&
+      (p = realloc(list->arena, list->arenaLen)) != NULL) {
+    list->arena = (char *) p;
+    list->arenaSize = list->arenaLen;
+  }
+
+  /* keep the index at most half full */
+  indexSize = 16;
+  while (indexSize < list->numNames * 2) indexSize *= 2;
+  if (name_list_index(list, indexSize) < 0) {
+    return SYS_MALLOC_ERR;
+  }
+
+  list->allocSize = sizeof(nameList_t) + strlen(list->key) + 1 +
+    list->maxNames * sizeof(unsigned int) + list->arenaSize +
+    list->indexSize * sizeof(unsigned int);
+  if (list->stbuf != NULL) {
+    list->allocSize += list->maxNames * sizeof(struct stat);
+  }
+  list->allocSize += list->attachSize;
+  return 0;
+}
+
+/*
+ * returns the position of name in a list that has not been published yet,
+ * appending it (and its stat) first if it is not already there.  The list
+ * is indexed as it grows, so it must not also be added to by addNameToList.
+ */
+int internNameInList(nameList_t *list, const char *name, struct stat *stbuf) {
+  unsigned int i, j, mask;
+  int status;
+
+  if (list->numNames * 2 >= list->indexSize) {
+    if (name_list_index(list, list->indexSize > 0 ? list->indexSize * 2 : 16) < 0) {
+      return SYS_MALLOC_ERR;
+    }
+  }
+  mask = list->indexSize - 1;
+  j = iquest_path_hash(name) & mask;
+  while ((i = list->index[j]) != 0) {
+    if (strcmp(NAME_LIST_NAME(list, i - 1), name) == 0) return i - 1;
+    j = (j + 1) & mask;
+  }
+  status = addNameToList(list, name, stbuf);
+  if (status < 0) return status;
+  list->index[j] = list->numNames;
+  return list->numNames - 1;
+}
+
+/*
+ * returns the position of name in the list, or -1 if it is not in it
+ */
+int findNameInList(nameList_t *list, const char *name) {
+  unsigned int i, j, mask;
+
+  if (list->index == NULL) {
+    /* not sealed yet */
+    for (i = 0; i < list->numNames; i++) {
+      if (strcmp(NAME_LIST_NAME(list, i), name) == 0) return i;
+    }
+    return -1;
+  }
+  mask = list->indexSize - 1;
+  j = iquest_path_hash(name) & mask;
+  while ((i = list->index[j]) != 0) {
+    if (strcmp(NAME_LIST_NAME(list, i - 1), name) == 0) return i - 1;
+    j = (j + 1) & mask;
+  }
+  return -1;
+}
+
+static void name_list_free(nameList_t *list) {
+  free(list->key);
+  free(list->nameOffset);
+  free(list->stbuf);
+  free(list->arena);
+  free(list->index);
+  if (list->freeAttach != NULL) {
+    list->freeAttach(list->attach);
+  }
+  free(list);
+}
+
+/*
+ * takes another reference to a list
+ */
+void holdNameList(nameList_t *list) {
+  __atomic_add_fetch(&list->refCnt, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * drops a reference to a list, freeing it when the last one goes
+ */
+void releaseNameList(nameList_t *list) {
+  if (list == NULL) return;
+  if (__atomic_sub_fetch(&list->refCnt, 1, __ATOMIC_ACQ_REL) == 0) {
+    name_list_free(list);
+  }
+}
+
+int initListCacheTable(listCacheTable_t *table, const char *name, uint ttl, unsigned long maxBytes) {
+  bzero(table, sizeof(listCacheTable_t));
+  table->name = name;
+  table->ttl = ttl;
+  table->maxBytes = maxBytes;
+  pthread_mutex_init(&table->lock, NULL);
+  table->numSlots = LIST_CACHE_INIT_SLOTS;
+  table->slot = (nameList_t **) malloc_and_zero_or_exit(table->numSlots * sizeof(nameList_t *));
+  table->lru.lruNext = &table->lru;
+  table->lru.lruPrev = &table->lru;
+  return 0;
+}
+
+static void list_cache_lru_unlink(nameList_t *list) {
+  list->lruPrev->lruNext = list->lruNext;
+  list->lruNext->lruPrev = list->lruPrev;
+}
+
+static void list_cache_lru_push(listCacheTable_t *table, nameList_t *list) {
+  list->lruNext = table->lru.lruNext;
+  list->lruPrev = &table->lru;
+  table->lru.lruNext->lruPrev = list;
+  table->lru.lruNext = list;
+}
+
+/*
+ * unlinks a list from the table and returns it (with the table's reference
+ * still held, to be released once the lock is dropped)
+ * table lock must be held
+ */
+static nameList_t *list_cache_unlink(listCacheTable_t *table, nameList_t *list) {
+  nameList_t **prev = &table->slot[list->hash & (table->numSlots - 1)];
+
+  while (*prev != list) {
+    prev = &(*prev)->next;
+  }
+  *prev = list->next;
+  list->next = NULL;
+  list_cache_lru_unlink(list);
+  table->numLists--;
+  table->numBytes -= list->allocSize;
+  return list;
+}
+
+/*
+ * table lock must be held
+ */
+static nameList_t *list_cache_find(listCacheTable_t *table, const char *key, uint64_t hash) {
+  nameList_t *list;
+
+  for (list = table->slot[hash & (table->numSlots - 1)]; list != NULL; list = list->next) {
+    if (list->hash == hash && strcmp(list->key, key) == 0) return list;
+  }
+  return NULL;
+}
+
+/*
+ * doubles the number of hash chains
+ * table lock must be held
+ */
+static void list_cache_grow(listCacheTable_t *table) {
+  unsigned int numSlots = table->numSlots * 2;
+  nameList_t **slot;
+  unsigned int i;
+
+  slot = (nameList_t **) calloc(numSlots, sizeof(nameList_t *));
+  if (slot == NULL) return;	/* carry on with longer chains */
+  for (i = 0; i < table->numSlots; i++) {
+    nameList_t *list = table->slot[i];
+    while (list != NULL) {
+      nameList_t *next = list->next;
+      list->next = slot[list->hash & (numSlots - 1)];
+      slot[list->hash & (numSlots - 1)] = list;
+      list = next;
+    }
+  }
+  free(table->slot);
+  table->slot = slot;
+  table->numSlots = numSlots;
+}
+
+/*
+ * Returns the cached list for key with a reference held for the caller
+ * (who must releaseNameList it), or NULL if there is no unexpired list.
+ * An expired list is dropped from the table and, if out_expired is not
+ * NULL, handed back through it (also referenced) so it can be refreshed.
+ */
+nameList_t *_getListFromCache(listCacheTable_t *table, const char *key, nameList_t **out_expired) {
+  uint64_t hash = iquest_path_hash(key);
+  nameList_t *list, *expired = NULL;
+
+  pthread_mutex_lock(&table->lock);
+  list = list_cache_find(table, key, hash);
+  if (list != NULL && (uint) time(0) >= list->cachedTime + table->ttl) {
+    expired = list_cache_unlink(table, list);
+    list = NULL;
+  } else if (list != NULL) {
+    __atomic_add_fetch(&list->refCnt, 1, __ATOMIC_RELAXED);
+    list_cache_lru_unlink(list);
+    list_cache_lru_push(table, list);
+  }
+  pthread_mutex_unlock(&table->lock);
+
+  if (out_expired != NULL) {
+    *out_expired = expired;
+  } else {
+    releaseNameList(expired);
+  }
+  return list;
+}
+
+nameList_t *getListFromCache(listCacheTable_t *table, const char *key) {
+  return _getListFromCache(table, key, NULL);
+}
+
+/*
+ * Publishes a finished list, replacing any list with the same key.  The
+ * table takes its own reference; the caller keeps theirs.  The list must
+ * not be modified afterwards.
+ */
+int addListToCache(listCacheTable_t *table, nameList_t *list) {
+  nameList_t *old, *victims = NULL;
+  int status;
+
+  status = name_list_seal(list);
+  if (status < 0) return status;
+  list->cachedTime = time(0);
+  __atomic_add_fetch(&list->refCnt, 1, __ATOMIC_RELAXED);
+
+  pthread_mutex_lock(&table->lock);
+  old = list_cache_find(table, list->key, list->hash);
+  if (old != NULL) {
+    old = list_cache_unlink(table, old);
+    old->next = victims;
+    victims = old;
+  }
+  if (table->numLists >= table->numSlots) {
+    list_cache_grow(table);
+  }
+  list->next = table->slot[list->hash & (table->numSlots - 1)];
+  table->slot[list->hash & (table->numSlots - 1)] = list;
+  list_cache_lru_push(table, list);
+  table->numLists++;
+  table->numBytes += list->allocSize;
+
+  /* evict least recently used lists (but never the one just added) */
+  while (table->maxBytes > 0 && table->numBytes > table->maxBytes &&
+	 table->lru.lruPrev != list) {
+    old = list_cache_unlink(table, table->lru.lruPrev);
+    old->next = victims;
+    victims = old;
+  }
+  pthread_mutex_unlock(&table->lock);
+
+  while (victims != NULL) {
+    old = victims;
+    victims = victims->next;
+    releaseNameList(old);
+  }
+  return 0;
+}
+
+/*
+ * drops the cached list for key, if any
+ * returns 1 if there was one, 0 if not
+ */
+int rmListFromCache(listCacheTable_t *table, const char *key) {
+  uint64_t hash = iquest_path_hash(key);
+  nameList_t *list;
+
+  pthread_mutex_lock(&table->lock);
+  list = list_cache_find(table, key, hash);
+  if (list != NULL) {
+    list_cache_unlink(table, list);
+  }
+  pthread_mutex_unlock(&table->lock);
+
+  if (list == NULL) return 0;
+  releaseNameList(list);
+  return 1;
+}
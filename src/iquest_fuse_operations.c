@@ -42,20 +42,36 @@
 #include "iquest_fuse.h"
 #include "iquest_fuse_operations.h"
 #include "iquest_fuse_lib.h"
+#include "iquest_fuse_cache_file.h"
+#include "iquest_fuse_read_ahead.h"
 
 #include "miscUtil.h"
 
 //extern iquest_fuse_irods_conn_t *ConnHead;
 
-extern iFuseDesc_t IFuseDesc[];
-extern pathCacheQue_t NonExistPathArray[];
-extern pathCacheQue_t PathArray[];
+extern pathCacheTable_t NonExistPathArray;
+extern pathCacheTable_t PathArray;
+extern listCacheTable_t CollListCache;
 
 
 void *iquest_fuse_init(struct fuse_conn_info *conn) {
   iquest_fuse_t *iqf = (iquest_fuse_t*)(fuse_get_context()->private_data);
   
-  if(iqf->conf->require_conn > 0) {
+#ifdef CACHE_FUSE_PATH
+  /* expiry and eviction of cached paths happens off the request path */
+  startPathCacheManager();
+#endif
+
+  if(iqf->conf->conn_pool_warm > 0) {
+    /*
+     * Open the connections the first requests will want now, all at once,
+     * and optionally exit with error if none could be opened
+     */
+    if(warm_iquest_fuse_irods_conns(iqf, iqf->conf->conn_pool_warm) <= 0 && iqf->conf->require_conn > 0) {
+      rodsLog(LOG_ERROR, "iRODS connection failure and require-conn option in effect");
+      exit(4);
+    }
+  } else if(iqf->conf->require_conn > 0) {
     /*
      * Try to make an iRODS connection now and optionally exit with error if it is not connected
      */
@@ -67,6 +83,8 @@ void *iquest_fuse_init(struct fuse_conn_info *conn) {
       rodsLog(LOG_ERROR, "iRODS connection failure and require-conn option in effect");
       exit(4);
     }
+    /* keep it in the pool for the first request */
+    relIFuseConn(irods_conn);
   }
   
   return iqf;
@@ -75,6 +93,9 @@ void *iquest_fuse_init(struct fuse_conn_info *conn) {
 void iquest_fuse_destroy(void *data) {
   iquest_fuse_t *iqf = (iquest_fuse_t*)data;
   rodsLog(LOG_DEBUG, "iquest_fuse_destroy: destroying iquest_fuse");
+#ifdef CACHE_FUSE_PATH
+  closePathCacheFile();
+#endif
   iquest_fuse_t_destroy(iqf);
 }
 
@@ -86,6 +107,7 @@ int iquest_fuse_getattr(const char *path, struct stat *stbuf) {
   iquest_fuse_query_cond_t *query_cond = NULL;
   char *query_part_attr = NULL;
   char *pqpath = NULL;
+  nameList_t *query_result = NULL;
   int status = -1;
   char *_path;
   int query_mode;
@@ -118,7 +140,7 @@ int iquest_fuse_getattr(const char *path, struct stat *stbuf) {
     /* partial query: (Q was the last thing specified) */
     rodsLog(LOG_DEBUG, "iquest_fuse_getattr: path contains a partial query");
     /* Q is always a dir */
-    fill_dir_stat(stbuf, 0, 0, 0); 
+    fill_dir_stat(stbuf, iquest_virtual_ino(path), 0, 0, 0); 
     status = 0;
   } else if( query_mode >= 1) {
     /* partial query: have attribute but no value */
@@ -129,7 +151,7 @@ int iquest_fuse_getattr(const char *path, struct stat *stbuf) {
     } else {
       /* attr exists */
       rodsLog(LOG_DEBUG, "iquest_fuse_getattr: attr [%s] exists", query_part_attr);
-      fill_dir_stat(stbuf, 0, 0, 0); 
+      fill_dir_stat(stbuf, iquest_virtual_ino(path), 0, 0, 0); 
     }
   } else if( query_mode <= 0 ) {
     /* completed or no query */
@@ -139,32 +161,27 @@ int iquest_fuse_getattr(const char *path, struct stat *stbuf) {
 	 /* have completed query with no post-query path (e.g. this is the query value specification) */
 	 rodsLog(LOG_DEBUG, "iquest_fuse_getattr: path contains [%d] complete queries and nothing more", query_cond->where_cond->len);
 	 //TODO check if query value is valid
-	 fill_dir_stat(stbuf, 0, 0, 0); 
+	 fill_dir_stat(stbuf, iquest_virtual_ino(path), 0, 0, 0); 
 	 status = 0;
        } else {
 	 rodsLog(LOG_DEBUG, "iquest_fuse_getattr: path contains [%d] complete queries and a post-query path", query_cond->where_cond->len);
-	 //TODO get the actual query results and the real data object stats
-	 //fill_dir_stat(stbuf, 0, 0, 0);
-	 fill_file_stat(stbuf, 0, 0, 0, 0, 0); 
-	 /*
-	   fill_file_stat(stbuf, rodsObjStatOut->dataMode, rodsObjStatOut->objSize,
-	   atoi (rodsObjStatOut->createTime), atoi (rodsObjStatOut->modifyTime),
-	   atoi (rodsObjStatOut->modifyTime));
-	 */
-	 status = 0;
+	 /* query results are listed flat, by data object name */
+	 status = -ENOENT;
+	 if( strchr(pqpath, '/') == NULL &&
+	     iquest_get_query_result(iqf, coll_path, zone_hint, query_cond, &query_result) == 0 ) {
+	   int row = findNameInList(query_result, pqpath);
+	   if( row >= 0 ) {
+	     status = getQueryResultStat(query_result, row, stbuf);
+	   }
+	   releaseNameList(query_result);
+	 }
        }
      } else {
       /* no query in path */
       rodsLog(LOG_DEBUG, "iquest_fuse_getattr: path does not contain any queries");
       
-      int connstat = -1;
-      iquest_fuse_irods_conn_t *irods_conn = NULL;  
-      connstat = get_iquest_fuse_irods_conn(&irods_conn, iqf);
-      if(connstat != 0) return connstat;
-      
-      rodsLog(LOG_DEBUG, "iquest_fuse_getattr: calling _iquest_fuse_irods_getattr");
-      status = _iquest_fuse_irods_getattr(irods_conn, path, stbuf, NULL);
-      relIFuseConn(irods_conn);
+      rodsLog(LOG_DEBUG, "iquest_fuse_getattr: calling iquest_fuse_irods_getattr");
+      status = iquest_fuse_irods_getattr(iqf, path, stbuf);
     }
   } else {
     rodsLog(LOG_ERROR, "iquest_fuse_getattr: reached an impossible point");
@@ -182,18 +199,15 @@ int iquest_fuse_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off
 
   char coll_path[MAX_NAME_LEN];
   char zone_hint[MAX_NAME_LEN];
-  collHandle_t collHandle;
-  collEnt_t collEnt;
+  char indicator_path[MAX_NAME_LEN];
   int status = -1;
-  int connstat = -1;
   struct stat stbuf;
-#ifdef CACHE_FUSE_PATH
-  pathCache_t *tmpPathCache;
-#endif
+  nameList_t *coll_list = NULL;
+  nameList_t *stale_list = NULL;
+  int from_cache = 0;
   /* don't know why we need this. the example have them */
   //    (void) offset;
   //    (void) fi;
-  iquest_fuse_irods_conn_t *irods_conn = NULL;
   char *coll = NULL; 
   iquest_fuse_query_cond_t *query_cond = NULL;
   char *query_part_attr = NULL;
@@ -239,7 +253,7 @@ int iquest_fuse_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off
     filler(buf, ".", NULL, 0);
     filler(buf, "..", NULL, 0);
 
-    iquest_query_and_fill_attr_list(iqf, zone_hint, query_cond, buf, filler);
+    iquest_query_and_fill_attr_list(iqf, path, zone_hint, query_cond, buf, filler);
     
     free(coll);
     free(query_cond);
@@ -254,7 +268,7 @@ int iquest_fuse_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off
     filler(buf, "..", NULL, 0);
     
     rodsLog(LOG_DEBUG, "iquest_fuse_readdir: calling iquest_query_and_fill_value_list with query_part_attr [%s]", query_part_attr);
-    iquest_query_and_fill_value_list(iqf, zone_hint, query_cond, query_part_attr, buf, filler);
+    iquest_query_and_fill_value_list(iqf, path, zone_hint, query_cond, query_part_attr, buf, filler);
 
     free(coll);
     free(query_cond);
@@ -271,18 +285,36 @@ int iquest_fuse_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off
     /* add query indicator to directory listing if show_indicator is set */
     if(iqf->conf->show_indicator > 0) {
       bzero(&stbuf, sizeof (struct stat));
-      fill_dir_stat(&stbuf, 1349696964, 1349696964, 1349696964);
+      snprintf(indicator_path, MAX_NAME_LEN, "%s/%s", path, iqf->conf->indicator);
+      fill_dir_stat(&stbuf, iquest_virtual_ino(indicator_path), 1349696964, 1349696964, 1349696964);
       filler(buf, iqf->conf->indicator, &stbuf, 0);
     }
 
-    //TODO 
+    if( pqpath[0] == '\0' ) {
+      status = iquest_get_query_result(iqf, coll_path, zone_hint, query_cond, &coll_list);
+      if( status == 0 ) {
+	unsigned int i;
+	for( i = 0; i < coll_list->numNames; i++ ) {
+	  getQueryResultStat(coll_list, i, &stbuf);
+	  if( filler(buf, NAME_LIST_NAME(coll_list, i), &stbuf, 0) != 0 ) {
+	    rodsLog(LOG_ERROR, "iquest_fuse_readdir: filler error");
+	    status = -ENOMEM;
+	    break;
+	  }
+	}
+	releaseNameList(coll_list);
+      }
+    } else {
+      /* entries in a query directory are data objects */
+      status = -ENOTDIR;
+    }
 
     free(coll);
     free(query_cond);
     free(query_part_attr);
     free(pqpath);
     free(_path);
-    return 0;
+    return status;
   } else if(query_mode <= 0 && query_cond->where_cond->len == 0 ) {
     /* no query in path */
     rodsLog(LOG_DEBUG, "iquest_fuse_readdir: path does not contain a query");
@@ -295,7 +327,8 @@ int iquest_fuse_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off
 	rodsLog(LOG_DEBUG, "iquest_fuse_readdir: skipping showing of query indicator in root (don't support root queries yet)");
       } else {
 	bzero(&stbuf, sizeof (struct stat));
-	fill_dir_stat(&stbuf, 1349696964, 1349696964, 1349696964);
+	snprintf(indicator_path, MAX_NAME_LEN, "%s/%s", path, iqf->conf->indicator);
+	fill_dir_stat(&stbuf, iquest_virtual_ino(indicator_path), 1349696964, 1349696964, 1349696964);
 	filler(buf, iqf->conf->indicator, &stbuf, 0);
       }
     }
@@ -314,94 +347,33 @@ int iquest_fuse_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off
       return -ENOTDIR;
     }
     
-    connstat = get_iquest_fuse_irods_conn(&irods_conn, iqf);
-    if (connstat != 0) return connstat;
-    
-    rodsLog (LOG_DEBUG, "iquest_fuse_readdir: calling rclOpenCollection for %s", coll_path);
-    status = rclOpenCollection (irods_conn->conn, coll_path, DATA_QUERY_FIRST_FG, &collHandle);
-
-    if (status < 0) {
-      if (isReadMsgError (status)) {
-	ifuseReconnect (irods_conn);
-	status = rclOpenCollection (irods_conn->conn, coll_path, DATA_QUERY_FIRST_FG, 
-				    &collHandle);
-      }
-      if (status < 0) {
-	rodsLog (LOG_ERROR,
-		 "iquest_fuse_readdir: rclOpenCollection of %s error. status = %d",
-		 coll_path, status);
-	relIFuseConn (irods_conn);
-	return map_irods_auth_errors(status, -ENOENT);
+#ifdef CACHE_FUSE_PATH
+    coll_list = _getListFromCache(&CollListCache, path, &stale_list);
+    if (coll_list != NULL) {
+      rodsLog(LOG_DEBUG, "iquest_fuse_readdir: listing of %s is cached", path);
+      from_cache = 1;
+    } else if (stale_list != NULL) {
+      /* catch up with what changed unless it is time to look for deletions */
+      if ((uint) time(0) < stale_list->fullTime + iqf->conf->list_cache_rescan &&
+	  iquest_refresh_coll_list(iqf, path, coll_path, stale_list, &coll_list) == 0) {
+	/* the refresh has just cached its stats, no need to do it again */
+	rodsLog(LOG_DEBUG, "iquest_fuse_readdir: refreshed listing of %s", path);
       }
+      releaseNameList(stale_list);
     }
-
-    while ((status = rclReadCollection(irods_conn->conn, &collHandle, &collEnt)) >= 0) {
-      char myDir[MAX_NAME_LEN], mySubDir[MAX_NAME_LEN];
-#ifdef CACHE_FUSE_PATH
-      char childPath[MAX_NAME_LEN];
-
-      bzero (&stbuf, sizeof (struct stat));
-#endif
-      if (collEnt.objType == DATA_OBJ_T) {
-	status = filler(buf, collEnt.dataName, NULL, 0);
-	if(status != 0) {
-	  rodsLog( LOG_ERROR, "iquest_fuse_readdir: filler error" );
-	  status = -ENOMEM;
-	  break;
-	}
-#ifdef CACHE_FUSE_PATH
-	if (strcmp (path, IQF_PATH_SEP) == 0) {
-	  snprintf (childPath, MAX_NAME_LEN, "/%s", collEnt.dataName);
-	} else {
-	  snprintf (childPath, MAX_NAME_LEN, "%s/%s", 
-		    path, collEnt.dataName);
-	}
-	if (matchPathInPathCache ((char *) childPath, PathArray, 
-				  &tmpPathCache) != 1) {
-	  fill_file_stat(&stbuf, collEnt.dataMode, collEnt.dataSize,
-			atoi (collEnt.createTime), atoi (collEnt.modifyTime), 
-			atoi (collEnt.modifyTime));
-	  addPathToCache (childPath, PathArray, &stbuf, &tmpPathCache);
-	}
-#endif
-      } else { // if (collEnt.objType == COLL_OBJ_T) {
-	splitPathByKey (collEnt.collName, myDir, mySubDir, '/');
-	if(strcmp(mySubDir,"") != 0) {
-	  status = filler(buf, mySubDir, NULL, 0);
-	  if(status != 0) {
-	    rodsLog( LOG_ERROR, "iquest_fuse_readdir: filler error" );
-	    status = -ENOMEM;
-	    break;
-	  }
-	  rodsLog(LOG_DEBUG, "iquest_fuse_readdir: filler succeeded for [%s]", mySubDir);
-	} else {
-	  rodsLog(LOG_DEBUG, "iquest_fuse_readdir: skipping empty mySubDir [%s] myDir [%s]", mySubDir, myDir);
-	}
-#ifdef CACHE_FUSE_PATH
-	if (strcmp (path, IQF_PATH_SEP) == 0) {
-	  snprintf (childPath, MAX_NAME_LEN, "/%s", mySubDir);
-	} else {
-	  snprintf (childPath, MAX_NAME_LEN, "%s/%s", path, mySubDir);
-	}
-	if (matchPathInPathCache ((char *) childPath, PathArray, 
-				  &tmpPathCache) != 1) {
-	  fill_dir_stat (&stbuf, 
-		       atoi (collEnt.createTime), atoi (collEnt.modifyTime), 
-		       atoi (collEnt.modifyTime));
-	  rodsLog(LOG_DEBUG, "iquest_fuse_readdir: calling addPathToCache childPath [%s]", childPath);
-	  addPathToCache (childPath, PathArray, &stbuf, &tmpPathCache);
-	}
 #endif
+    if (coll_list == NULL) {
+      status = iquest_fetch_coll_list(iqf, path, coll_path, &coll_list);
+      if (status < 0) {
+	rodsLogError(LOG_DEBUG, status, "iquest_fuse_readdir");
+	return status;
       }
     }
-    rclCloseCollection (&collHandle);
-    relIFuseConn (irods_conn);
-    if(status >= 0 || status == CAT_NO_ROWS_FOUND) {
+    status = iquest_fill_coll_list(path, coll_list, from_cache, buf, filler);
+    releaseNameList(coll_list);
+    if (status >= 0) {
       rodsLog(LOG_DEBUG, "iquest_fuse_readdir: success");
-      return 0;
-    } 
-    status = map_irods_auth_errors(status, -ENOENT);
-    rodsLogError(LOG_DEBUG, status, "iquest_fuse_readdir");
+    }
     return status;
   }
   rodsLog(LOG_DEBUG, "iquest_fuse_readdir: returning -1");
@@ -415,15 +387,21 @@ int iquest_fuse_open(const char *path, struct fuse_file_info *fi) {
   int connstat = -1;
   int fd;
   int descInx;
+  int query_path;
   iquest_fuse_irods_conn_t *irods_conn = NULL;
   
   rodsLog (LOG_DEBUG, "iquest_fuse_open: %s, flags = %d", path, fi->flags);
   
+  /* an entry in a query directory opens the data object it stands for */
+  memset (&dataObjInp, 0, sizeof (dataObjInp));
+  query_path = iquest_query_path_to_obj_path(iqf, path, dataObjInp.objPath);
+  if (query_path < 0) return query_path;
+
 #ifdef CACHE_FUSE_PATH
-  if ((descInx = getDescInxInNewlyCreatedCache ((char *) path, fi->flags)) 
+  if (!query_path && (descInx = getDescInxInNewlyCreatedCache ((char *) path, fi->flags)) 
       > 0) {
     rodsLog (LOG_DEBUG, "iquest_fuse_open: a match for %s", path);
-    fi->fh = descInx;
+    fi->fh = getIFuseDescHandle (descInx);
     return (0);
   }
 #endif
@@ -431,22 +409,23 @@ int iquest_fuse_open(const char *path, struct fuse_file_info *fi) {
   if (connstat != 0) return connstat;
 
 #ifdef CACHE_FILE_FOR_READ
-  if ((descInx = iquest_fuse_open_with_read_cache (irods_conn, 
+  if (!query_path && (descInx = iquest_fuse_open_with_read_cache (irods_conn, 
 					 (char *) path, fi->flags)) > 0) {
     rodsLog (LOG_DEBUG, "iquest_fuse_open: a match for %s", path);
-    fi->fh = descInx;
+    fi->fh = getIFuseDescHandle (descInx);
     relIFuseConn (irods_conn);
     return (0);
   }
 #endif
-  memset (&dataObjInp, 0, sizeof (dataObjInp));
-  status = iquest_parse_rods_path_str(iqf, (char *) (path + 1), dataObjInp.objPath);
-  if (status < 0) {
-    rodsLogError (LOG_ERROR, status, 
-		  "iquest_fuse_open: iquest_parse_rods_path_str of %s error", path);
-    /* use ENOTDIR for this type of error */
-    relIFuseConn (irods_conn);
-    return -ENOTDIR;
+  if (!query_path) {
+    status = iquest_parse_rods_path_str(iqf, (char *) (path + 1), dataObjInp.objPath);
+    if (status < 0) {
+      rodsLogError (LOG_ERROR, status, 
+		    "iquest_fuse_open: iquest_parse_rods_path_str of %s error", path);
+      /* use ENOTDIR for this type of error */
+      relIFuseConn (irods_conn);
+      return -ENOTDIR;
+    }
   }
   
   dataObjInp.openFlags = fi->flags;
@@ -470,15 +449,15 @@ int iquest_fuse_open(const char *path, struct fuse_file_info *fi) {
       ifuseReconnect (irods_conn);
       fd = rcDataObjOpen (irods_conn->conn, &dataObjInp);
     }
-    relIFuseConn (irods_conn);
     if (fd < 0) {
+      relIFuseConn (irods_conn);
       rodsLogError (LOG_ERROR, status,
 		    "iquest_fuse_open: rcDataObjOpen of %s error, status = %d", path, fd);
       return map_irods_auth_errors(status, -ENOENT);
     }
   }
 #ifdef CACHE_FUSE_PATH
-  rmPathFromCache ((char *) path, NonExistPathArray);
+  rmPathFromCache ((char *) path, &NonExistPathArray);
 #endif
   descInx = allocIFuseDesc ();
   if (descInx < 0) {
@@ -489,39 +468,28 @@ int iquest_fuse_open(const char *path, struct fuse_file_info *fi) {
   }
   fillIFuseDesc (descInx, irods_conn, fd, dataObjInp.objPath, 
 		 (char *) path);
+  if ((fi->flags & O_ACCMODE) == O_RDONLY) {
+    /* shares what it reads with every other reader of the object */
+    setIFuseDescBlockKey (descInx, (char *) path);
+  }
   relIFuseConn (irods_conn);
-  fi->fh = descInx;
+  fi->fh = getIFuseDescHandle (descInx);
   return(0);
 }
 
 int iquest_fuse_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
   int descInx;
-  int status, myError;
+  int status;
   
   rodsLog (LOG_DEBUG, "irodsRead: %s", path);
   
-  descInx = fi->fh;
+  descInx = getIFuseDescInx (fi->fh);
   
-  if (checkFuseDesc (descInx) < 0) {
+  if (descInx < 0 || checkFuseDesc (descInx) < 0) {
     return -EBADF;
   }
   lockDesc (descInx);
-  if ((status = ifuseLseek ((char *) path, descInx, offset)) < 0) {
-    unlockDesc (descInx);
-    if ((myError = getErrno (status)) > 0) {
-      return (-myError);
-    } else {
-      return -ENOENT;
-    }
-  }
-  
-  if (size <= 0) {
-    unlockDesc (descInx);
-	return 0;
-  }
-  
-  status = ifuseRead ((char *) path, descInx, buf, size, offset);
-  
+  status = readWithReadAhead ((char *) path, descInx, buf, size, offset);
   unlockDesc (descInx);
   
   return status;
@@ -534,9 +502,9 @@ int iquest_fuse_release(const char *path, struct fuse_file_info *fi) {
   
   rodsLog(LOG_DEBUG, "iquest_fuse_release: %s", path);
   
-  descInx = fi->fh;
+  descInx = getIFuseDescInx (fi->fh);
   
-  if (checkFuseDesc(descInx) < 0) {
+  if (descInx < 0 || checkFuseDesc(descInx) < 0) {
     return(-EBADF);
   }
   
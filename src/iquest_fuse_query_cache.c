@@ -0,0 +1,229 @@
+/*****************************************************************************
+ * Copyright (c) 2012 Genome Research Ltd.
+ *
+ * Author: Joshua C. Randall <jcrandall@alum.mit.edu>
+ *
+ * This file is part of iquestFuse.
+ *
+ * iquestFuse is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+/*****************************************************************************
+ * Implementation of the iquestFuse completed-query result cache.
+ *
+ * A result is built row by row while the query is paged through, then
+ * trimmed by finishQueryResult and published with addListToCache; from
+ * then on it is immutable, so the readdir, getattr and open of a query
+ * directory's entries can all be answered from one fetch without locking.
+ *****************************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "iquest_fuse.h"
+#include "iquest_fuse_lib.h"
+#include "iquest_fuse_query_cache.h"
+
+static void query_result_cols_free(void *attach) {
+  queryResultCols_t *cols = (queryResultCols_t *) attach;
+
+  free(cols->dataId);
+  free(cols->size);
+  free(cols->createTime);
+  free(cols->modifyTime);
+  free(cols->collNum);
+  free(cols->mode);
+  releaseNameList(cols->colls);
+  free(cols);
+}
+
+/*
+ * resizes the column arrays to hold maxRows rows
+ */
+static int query_result_cols_resize(queryResultCols_t *cols, unsigned int maxRows) {
+  void *p;
+
+#define QUERY_RESULT_RESIZE(col) \
+  if ((p = realloc(cols->col, maxRows * sizeof(*cols->col))) == NULL) return SYS_MALLOC_ERR; \
+  cols->col = p;
+
+  QUERY_RESULT_RESIZE(dataId);
+  QUERY_RESULT_RESIZE(size);
+  QUERY_RESULT_RESIZE(createTime);
+  QUERY_RESULT_RESIZE(modifyTime);
+  QUERY_RESULT_RESIZE(collNum);
+  QUERY_RESULT_RESIZE(mode);
+#undef QUERY_RESULT_RESIZE
+
+  cols->maxRows = maxRows;
+  return 0;
+}
+
+/*
+ * allocates a new, empty query result with one reference held by the caller
+ */
+nameList_t *newQueryResult(const char *key) {
+  nameList_t *result;
+  queryResultCols_t *cols;
+
+  cols = (queryResultCols_t *) malloc_and_zero_or_exit(sizeof(queryResultCols_t));
+  cols->maxRows = NAME_LIST_INIT_NAMES;
+  cols->dataId = (uint64_t *) malloc_and_zero_or_exit(cols->maxRows * sizeof(uint64_t));
+  cols->size = (int64_t *) malloc_and_zero_or_exit(cols->maxRows * sizeof(int64_t));
+  cols->createTime = (uint32_t *) malloc_and_zero_or_exit(cols->maxRows * sizeof(uint32_t));
+  cols->modifyTime = (uint32_t *) malloc_and_zero_or_exit(cols->maxRows * sizeof(uint32_t));
+  cols->collNum = (uint32_t *) malloc_and_zero_or_exit(cols->maxRows * sizeof(uint32_t));
+  cols->mode = (uint16_t *) malloc_and_zero_or_exit(cols->maxRows * sizeof(uint16_t));
+  cols->colls = newNameList("", 0);
+
+  result = newNameList(key, 0);
+  result->attach = cols;
+  result->freeAttach = query_result_cols_free;
+  return result;
+}
+
+static void query_result_set_row(queryResultCols_t *cols, unsigned int row, uint64_t dataId, int64_t size, uint createTime, uint modifyTime, int collNum, uint mode) {
+  cols->dataId[row] = dataId;
+  cols->size[row] = size;
+  cols->createTime[row] = createTime;
+  cols->modifyTime[row] = modifyTime;
+  cols->collNum[row] = collNum;
+  cols->mode[row] = mode;
+}
+
+/*
+ * appends a row to a result that has not been published yet.  Rows for a
+ * data object that is already in it (other replicas) are skipped.  Data
+ * objects are listed by name; of those with the same name (in different
+ * collections) the one with the lowest DATA_ID keeps it and the others
+ * are listed as <name>~<DATA_ID>, whatever order the rows come in.
+ */
+int addRowToQueryResult(nameList_t *result, const char *name, const char *coll, uint64_t dataId, int64_t size, uint createTime, uint modifyTime, uint mode) {
+  queryResultCols_t *cols = QUERY_RESULT_COLS(result);
+  unsigned int numRows = result->numNames;
+  char dupName[MAX_NAME_LEN];
+  int row, collNum;
+
+  collNum = internNameInList(cols->colls, coll, NULL);
+  if (collNum < 0) return collNum;
+  mode &= 07777;
+
+  row = internNameInList(result, name, NULL);
+  if (row < 0) return row;
+  if ((unsigned int) row < numRows) {
+    if (cols->dataId[row] == dataId) {
+      return 0;
+    }
+    if (dataId < cols->dataId[row]) {
+      /* this one keeps the name, and the one that had it moves aside */
+      uint64_t oldDataId = cols->dataId[row];
+      int64_t oldSize = cols->size[row];
+      uint oldCreateTime = cols->createTime[row];
+      uint oldModifyTime = cols->modifyTime[row];
+      int oldCollNum = cols->collNum[row];
+      uint oldMode = cols->mode[row];
+
+      query_result_set_row(cols, row, dataId, size, createTime, modifyTime, collNum, mode);
+      dataId = oldDataId;
+      size = oldSize;
+      createTime = oldCreateTime;
+      modifyTime = oldModifyTime;
+      collNum = oldCollNum;
+      mode = oldMode;
+    }
+    if (snprintf(dupName, MAX_NAME_LEN, "%s%c%llu", name, QUERY_RESULT_DUP_SEP,
+		 (unsigned long long) dataId) >= MAX_NAME_LEN) {
+      rodsLog(LOG_NOTICE, "addRowToQueryResult: cannot list [%s] in [%s] next to the one in [%s]",
+	      name, NAME_LIST_NAME(cols->colls, collNum), NAME_LIST_NAME(cols->colls, cols->collNum[row]));
+      return 0;
+    }
+    numRows = result->numNames;
+    row = internNameInList(result, dupName, NULL);
+    if (row < 0) return row;
+    if ((unsigned int) row < numRows) {
+      /* another replica of one that is already listed that way */
+      return 0;
+    }
+    mode |= QUERY_RESULT_MODE_DUP;
+  }
+
+  if ((unsigned int) row >= cols->maxRows &&
+      query_result_cols_resize(cols, cols->maxRows * 2) < 0) {
+    return SYS_MALLOC_ERR;
+  }
+  query_result_set_row(cols, row, dataId, size, createTime, modifyTime, collNum, mode);
+  return 0;
+}
+
+/*
+ * trims the columns of a finished result to size and accounts for them,
+ * ready for addListToCache
+ */
+int finishQueryResult(nameList_t *result) {
+  queryResultCols_t *cols = QUERY_RESULT_COLS(result);
+  nameList_t *colls = cols->colls;
+
+  if (result->numNames > 0 && result->numNames < cols->maxRows) {
+    query_result_cols_resize(cols, result->numNames);
+  }
+  result->attachSize = sizeof(queryResultCols_t) +
+    cols->maxRows * (sizeof(uint64_t) + sizeof(int64_t) + 3 * sizeof(uint32_t) + sizeof(uint16_t)) +
+    sizeof(nameList_t) + colls->maxNames * sizeof(unsigned int) + colls->arenaSize +
+    colls->indexSize * sizeof(unsigned int);
+  return 0;
+}
+
+/*
+ * fills stbuf for the data object in the given row
+ */
+int getQueryResultStat(nameList_t *result, unsigned int row, struct stat *stbuf) {
+  queryResultCols_t *cols = QUERY_RESULT_COLS(result);
+
+  if (row >= result->numNames) return -ENOENT;
+  bzero(stbuf, sizeof(struct stat));
+  fill_file_stat(stbuf, IQF_INO(IQF_INO_NS_DATA_OBJ, cols->dataId[row]),
+		 cols->mode[row] & 07777, cols->size[row], cols->createTime[row],
+		 cols->modifyTime[row], cols->modifyTime[row]);
+  return 0;
+}
+
+/*
+ * copies the iRODS path of the data object in the given row into objPath,
+ * which must hold MAX_NAME_LEN characters
+ */
+int getQueryResultPath(nameList_t *result, unsigned int row, char *objPath) {
+  queryResultCols_t *cols = QUERY_RESULT_COLS(result);
+  char *coll, *name;
+  int nameLen;
+
+  if (row >= result->numNames) return -ENOENT;
+  coll = NAME_LIST_NAME(cols->colls, cols->collNum[row]);
+  name = NAME_LIST_NAME(result, row);
+  nameLen = strlen(name);
+  if (cols->mode[row] & QUERY_RESULT_MODE_DUP) {
+    /* the real name is the listed one without its ~<DATA_ID> */
+    nameLen = strrchr(name, QUERY_RESULT_DUP_SEP) - name;
+  }
+  if (snprintf(objPath, MAX_NAME_LEN, "%s/%.*s",
+	       strcmp(coll, "/") == 0 ? "" : coll, nameLen, name) >= MAX_NAME_LEN) {
+    return -ENAMETOOLONG;
+  }
+  return 0;
+}
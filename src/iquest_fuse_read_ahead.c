@@ -0,0 +1,540 @@
+/*****************************************************************************
+ * Copyright (c) 2012 Genome Research Ltd.
+ *
+ * Author: Joshua C. Randall <jcrandall@alum.mit.edu>
+ *
+ * This file is part of iquestFuse.
+ *
+ * iquestFuse is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Implementation of iquestFuse read-ahead.
+ *
+ * A descriptor that reads through the block cache reads ahead into the
+ * block cache instead of its bufCache, so that what it reads ahead is
+ * shared, and whatever another reader is already fetching is not fetched
+ * again.
+ *
+ * Everything about a descriptor's read-ahead is guarded by the descriptor's
+ * lock, which the read holds throughout, except the data going into the
+ * buffer being filled and the spare connection, which belong to the
+ * thread doing the read-ahead until it clears raFilling.  A descriptor is
+ * only closed once nothing is in flight (stopReadAhead).
+ *****************************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "iquest_fuse.h"
+#include "iquest_fuse_lib.h"
+#include "iquest_fuse_read_ahead.h"
+
+extern blockCacheTable_t ObjBlockCache;
+
+/* how the read would have gone without read-ahead */
+static int read_ahead_read_through(char *path, int descInx, char *buf, size_t size, off_t offset) {
+  int status, myError;
+
+  /* reads through the block cache seek for themselves, a block at a time */
+  if (IFUSE_DESC(descInx).blockKey == NULL &&
+      (status = ifuseLseek(path, descInx, offset)) < 0) {
+    if ((myError = getErrno(status)) > 0) {
+      return -myError;
+    } else {
+      return -ENOENT;
+    }
+  }
+  if (size <= 0) {
+    return 0;
+  }
+  return ifuseRead(path, descInx, buf, size, offset);
+}
+
+/* the most to read ahead for desc, or 0 for none */
+static size_t read_ahead_max(iFuseDesc_t *desc) {
+  if (desc->locCacheState != NO_FILE_CACHE || desc->raFailed ||
+      desc->objPath == NULL || desc->irods_conn == NULL) {
+    return 0;
+  }
+  return desc->irods_conn->iqf->conf->read_ahead_max_bytes;
+}
+
+/* the buffer holding (or about to hold) offset, or -1 if none */
+static int read_ahead_find(iFuseDesc_t *desc, rodsLong_t offset) {
+  bufCache_t *bc;
+  int i;
+
+  for (i = 0; i < MAX_BUF_CACHE; i++) {
+    bc = &desc->bufCache[i];
+    if (bc->state != BUF_CACHE_EMPTY && bc->beginOffset <= offset && offset < bc->endOffset) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/* frees the buffers not in use, so that only descriptors reading ahead
+ * (which are few, as each has a connection) keep any */
+static void read_ahead_free_bufs(iFuseDesc_t *desc) {
+  bufCache_t *bc;
+  int i;
+
+  for (i = 0; i < MAX_BUF_CACHE; i++) {
+    bc = &desc->bufCache[i];
+    if (bc->state == BUF_CACHE_EMPTY && bc->buf != NULL) {
+      free(bc->buf);
+      bc->buf = NULL;
+      bc->bufSize = 0;
+    }
+  }
+}
+
+/* gives back the spare connection (and the buffers not in use); nothing
+ * may be in flight */
+static void read_ahead_drop_conn(iFuseDesc_t *desc) {
+  iquest_fuse_irods_conn_t *conn = desc->raConn;
+
+  read_ahead_free_bufs(desc);
+  if (conn == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&conn->lock);
+  if (desc->raFd > 0 && conn->conn != NULL) {
+    closeIrodsFd(conn, desc->raFd);
+  }
+  relIFuseConn(conn);
+  desc->raConn = NULL;
+  desc->raFd = 0;
+  desc->raFdOffset = 0;
+}
+
+/*
+ * Reads size bytes at offset of objPath into buf over conn, connecting it
+ * and opening objPath on it (as *fd) first if need be.  Returns the number
+ * of bytes read, which is short only at the end of the object.
+ */
+static int read_ahead_fetch(iquest_fuse_irods_conn_t *conn, char *objPath, int *fd, rodsLong_t *fdOffset, char *buf, rodsLong_t offset, size_t size) {
+  dataObjInp_t dataObjInp;
+  openedDataObjInp_t dataObjReadInp;
+  fileLseekOut_t *dataObjLseekOut = NULL;
+  bytesBuf_t dataObjReadOutBBuf;
+  size_t done = 0;
+  int status = 0;
+
+  pthread_mutex_lock(&conn->lock);
+  conn->actTime = time(NULL);
+  if (conn->conn == NULL) {
+    *fd = 0;
+    status = ifuseConnect(conn);
+    if (status < 0) {
+      goto out;
+    }
+  }
+  if (*fd <= 0) {
+    memset(&dataObjInp, 0, sizeof(dataObjInp));
+    rstrcpy(dataObjInp.objPath, objPath, MAX_NAME_LEN);
+    dataObjInp.openFlags = O_RDONLY;
+    status = rcDataObjOpen(conn->conn, &dataObjInp);
+    if (status < 0) {
+      goto out;
+    }
+    *fd = status;
+    *fdOffset = 0;
+  }
+  if (*fdOffset != offset) {
+    bzero(&dataObjReadInp, sizeof(dataObjReadInp));
+    dataObjReadInp.l1descInx = *fd;
+    dataObjReadInp.offset = offset;
+    dataObjReadInp.whence = SEEK_SET;
+    status = rcDataObjLseek(conn->conn, &dataObjReadInp, &dataObjLseekOut);
+    if (dataObjLseekOut != NULL) {
+      free(dataObjLseekOut);
+    }
+    if (status < 0) {
+      goto out;
+    }
+    *fdOffset = offset;
+  }
+  while (done < size) {
+    bzero(&dataObjReadInp, sizeof(dataObjReadInp));
+    dataObjReadInp.l1descInx = *fd;
+    dataObjReadInp.len = size - done;
+    dataObjReadOutBBuf.buf = buf + done;
+    dataObjReadOutBBuf.len = size - done;
+    status = rcDataObjRead(conn->conn, &dataObjReadInp, &dataObjReadOutBBuf);
+    if (status <= 0) {
+      break;
+    }
+    done += status;
+    *fdOffset += status;
+  }
+
+ out:
+  if (status < 0 && isReadMsgError(status)) {
+    /* leave the slot with a working connection (and the open gone) */
+    ifuseReconnect(conn);
+    *fd = 0;
+  }
+  pthread_mutex_unlock(&conn->lock);
+  if (status < 0) {
+    return status;
+  }
+  return done;
+}
+
+static void *read_ahead_fill(void *arg) {
+  iFuseDesc_t *desc = (iFuseDesc_t *) arg;
+  bufCache_t *bc;
+  iquest_fuse_irods_conn_t *conn;
+  char *objPath;
+  rodsLong_t offset, fdOffset;
+  size_t size;
+  int fd, status;
+
+  pthread_mutex_lock(&desc->lock);
+  bc = &desc->bufCache[desc->raFillInx];
+  offset = bc->beginOffset;
+  size = bc->endOffset - bc->beginOffset;
+  conn = desc->raConn;
+  fd = desc->raFd;
+  fdOffset = desc->raFdOffset;
+  objPath = desc->objPath;
+  pthread_mutex_unlock(&desc->lock);
+
+  status = read_ahead_fetch(conn, objPath, &fd, &fdOffset, bc->buf, offset, size);
+
+  pthread_mutex_lock(&desc->lock);
+  desc->raFd = fd;
+  desc->raFdOffset = fdOffset;
+  if (status < 0) {
+    rodsLogError(LOG_ERROR, status, "read_ahead_fill: read of %s at %lld error", objPath, offset);
+    bc->state = BUF_CACHE_EMPTY;
+    desc->raFailed = 1;
+  } else {
+    bc->endOffset = offset + status;
+    bc->state = (status > 0) ? BUF_CACHE_READY : BUF_CACHE_EMPTY;
+    if ((size_t) status < size) {
+      desc->raEof = 1;
+      desc->raEofOffset = offset + status;
+    }
+  }
+  desc->raFilling = 0;
+  /* requests come before read-ahead: make way if any are waiting */
+  if (status < 0 || connPoolWaiting(conn->pool) > 0) {
+    read_ahead_drop_conn(desc);
+  }
+  pthread_cond_broadcast(&desc->raCond);
+  /* desc may be closed as soon as this is let go */
+  pthread_mutex_unlock(&desc->lock);
+  return NULL;
+}
+
+/* starts reading ahead of raNextOffset into a free buffer, if there is one
+ * (and a spare connection) */
+static void read_ahead_start(iFuseDesc_t *desc, size_t maxWindow) {
+  bufCache_t *bc;
+  rodsLong_t next = desc->raNextOffset;
+  size_t window;
+  pthread_t thr;
+  pthread_attr_t attr;
+  void *buf;
+  int fillInx = -1;
+  int i, status;
+
+  if (desc->raFilling) {
+    return;
+  }
+  for (i = 0; i < MAX_BUF_CACHE; i++) {
+    bc = &desc->bufCache[i];
+    if (bc->state == BUF_CACHE_READY) {
+      if (bc->endOffset <= desc->raNextOffset || bc->beginOffset > desc->raNextOffset + 2 * (rodsLong_t) maxWindow) {
+	/* behind the reader, or left over from before a seek */
+	bc->state = BUF_CACHE_EMPTY;
+      } else if (bc->endOffset > next) {
+	next = bc->endOffset;
+      }
+    }
+  }
+  if (desc->raEof && next >= desc->raEofOffset) {
+    return;
+  }
+  for (i = 0; i < MAX_BUF_CACHE; i++) {
+    if (desc->bufCache[i].state == BUF_CACHE_EMPTY) {
+      fillInx = i;
+      break;
+    }
+  }
+  if (fillInx < 0) {
+    return;
+  }
+  bc = &desc->bufCache[fillInx];
+
+  if (desc->raConn == NULL) {
+    desc->raConn = tryAcquireSpareConn(desc->irods_conn->iqf->conn_pool[IQF_CONN_BULK]);
+    if (desc->raConn == NULL) {
+      /* none to spare: try again on the next read */
+      read_ahead_free_bufs(desc);
+      return;
+    }
+    desc->raFd = 0;
+  }
+  window = (desc->raWindow == 0) ? READ_AHEAD_MIN_WINDOW : desc->raWindow * 2;
+  if (window > maxWindow) {
+    window = maxWindow;
+  }
+  if (bc->bufSize < window) {
+    buf = realloc(bc->buf, window);
+    if (buf == NULL) {
+      return;
+    }
+    bc->buf = buf;
+    bc->bufSize = window;
+  }
+
+  desc->raWindow = window;
+  bc->beginOffset = next;
+  bc->endOffset = next + window;
+  bc->state = BUF_CACHE_FILLING;
+  desc->raFillInx = fillInx;
+  desc->raFilling = 1;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  status = pthread_create(&thr, &attr, read_ahead_fill, desc);
+  pthread_attr_destroy(&attr);
+  if (status != 0) {
+    rodsLog(LOG_ERROR, "read_ahead_start: pthread_create failure, status = %d", status);
+    bc->state = BUF_CACHE_EMPTY;
+    desc->raFilling = 0;
+  }
+}
+
+static void *read_ahead_fill_blocks(void *arg) {
+  iFuseDesc_t *desc = (iFuseDesc_t *) arg;
+  size_t blockSize = ObjBlockCache.blockSize;
+  cacheBlock_t *block;
+  iquest_fuse_irods_conn_t *conn;
+  char *objPath, *blockKey;
+  rodsLong_t offset, end, objSize, fdOffset, blockOffset;
+  size_t want;
+  int fd, fetch;
+  int status = 0;
+
+  pthread_mutex_lock(&desc->lock);
+  offset = desc->raFillOffset;
+  end = offset + desc->raFillSize;
+  objSize = desc->objSize;
+  conn = desc->raConn;
+  fd = desc->raFd;
+  fdOffset = desc->raFdOffset;
+  objPath = desc->objPath;
+  blockKey = desc->blockKey;
+  pthread_mutex_unlock(&desc->lock);
+
+  for (blockOffset = offset - offset % blockSize; blockOffset < end && status >= 0; blockOffset += blockSize) {
+    block = getBlockFromCache(&ObjBlockCache, blockKey, blockOffset / blockSize, &fetch);
+    if (block == NULL) {
+      break;
+    }
+    if (fetch) {
+      want = blockSize;
+      if (blockOffset + (rodsLong_t) want > objSize) {
+	want = objSize - blockOffset;
+      }
+      status = read_ahead_fetch(conn, objPath, &fd, &fdOffset, block->data, blockOffset, want);
+      blockFetched(&ObjBlockCache, block, status);
+    }
+    releaseBlock(block);
+  }
+
+  pthread_mutex_lock(&desc->lock);
+  desc->raFd = fd;
+  desc->raFdOffset = fdOffset;
+  if (status < 0) {
+    rodsLogError(LOG_ERROR, status, "read_ahead_fill_blocks: read of %s at %lld error", objPath, blockOffset);
+    desc->raFailed = 1;
+  }
+  desc->raFilling = 0;
+  if (status < 0 || connPoolWaiting(conn->pool) > 0) {
+    read_ahead_drop_conn(desc);
+  }
+  pthread_cond_broadcast(&desc->raCond);
+  pthread_mutex_unlock(&desc->lock);
+  return NULL;
+}
+
+/* starts reading the blocks ahead of raNextOffset (and of what has been
+ * read ahead already) into the block cache */
+static void read_ahead_start_blocks(iFuseDesc_t *desc, size_t maxWindow) {
+  size_t blockSize = ObjBlockCache.blockSize;
+  rodsLong_t next, end;
+  size_t window;
+  pthread_t thr;
+  pthread_attr_t attr;
+  int status;
+
+  if (desc->raFilling) {
+    return;
+  }
+  next = (desc->raAheadOffset > desc->raNextOffset) ? desc->raAheadOffset : desc->raNextOffset;
+  if (next >= desc->objSize || next >= desc->raNextOffset + (rodsLong_t) maxWindow) {
+    return;
+  }
+  if (desc->raConn == NULL) {
+    desc->raConn = tryAcquireSpareConn(desc->irods_conn->iqf->conn_pool[IQF_CONN_BULK]);
+    if (desc->raConn == NULL) {
+      return;
+    }
+    desc->raFd = 0;
+  }
+  window = (desc->raWindow == 0) ? READ_AHEAD_MIN_WINDOW : desc->raWindow * 2;
+  if (window > maxWindow) {
+    window = maxWindow;
+  }
+  /* whole blocks */
+  end = next + window + blockSize - 1;
+  end -= end % blockSize;
+  if (end > desc->objSize) {
+    end = desc->objSize;
+  }
+
+  desc->raWindow = window;
+  desc->raFillOffset = next;
+  desc->raFillSize = end - next;
+  desc->raAheadOffset = end;
+  desc->raFilling = 1;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  status = pthread_create(&thr, &attr, read_ahead_fill_blocks, desc);
+  pthread_attr_destroy(&attr);
+  if (status != 0) {
+    rodsLog(LOG_ERROR, "read_ahead_start_blocks: pthread_create failure, status = %d", status);
+    desc->raAheadOffset = next;
+    desc->raFilling = 0;
+  }
+}
+
+/*
+ * Reads size bytes at offset from descInx, from what has been read ahead
+ * as far as possible, and reads further ahead if the descriptor is being
+ * read sequentially.  The descriptor must be locked (lockDesc).  Returns
+ * the number of bytes read or a negative errno.
+ */
+int readWithReadAhead(char *path, int descInx, char *buf, size_t size, off_t offset) {
+  iFuseDesc_t *desc = &IFUSE_DESC(descInx);
+  bufCache_t *bc;
+  size_t maxWindow;
+  size_t done = 0;
+  size_t n;
+  rodsLong_t pos;
+  int i, status;
+
+  maxWindow = read_ahead_max(desc);
+  if (maxWindow == 0) {
+    return read_ahead_read_through(path, descInx, buf, size, offset);
+  }
+
+  if (offset == desc->raNextOffset) {
+    desc->raSeqReads++;
+  } else {
+    /* a seek: start over (but use anything already read ahead) */
+    desc->raSeqReads = 0;
+    desc->raWindow = 0;
+    desc->raAheadOffset = 0;
+    if (!desc->raFilling) {
+      read_ahead_drop_conn(desc);
+    }
+  }
+
+  if (desc->blockKey != NULL) {
+    /* whatever has been read ahead is in the block cache */
+    status = read_ahead_read_through(path, descInx, buf, size, offset);
+    if (status < 0) {
+      return status;
+    }
+    desc->raNextOffset = offset + status;
+    if (desc->raSeqReads >= READ_AHEAD_SEQ_READS) {
+      read_ahead_start_blocks(desc, maxWindow);
+    }
+    return status;
+  }
+
+  while (done < size) {
+    pos = offset + done;
+    if (desc->raEof && pos >= desc->raEofOffset) {
+      break;
+    }
+    i = read_ahead_find(desc, pos);
+    if (i < 0) {
+      break;
+    }
+    bc = &desc->bufCache[i];
+    if (bc->state == BUF_CACHE_FILLING) {
+      pthread_cond_wait(&desc->raCond, &desc->lock);
+      continue;
+    }
+    n = bc->endOffset - pos;
+    if (n > size - done) {
+      n = size - done;
+    }
+    memcpy(buf + done, (char *) bc->buf + (pos - bc->beginOffset), n);
+    done += n;
+    desc->actCacheInx = i + 1;
+    if (pos + (rodsLong_t) n >= bc->endOffset) {
+      /* used up */
+      bc->state = BUF_CACHE_EMPTY;
+    }
+  }
+
+  if (done < size && !(desc->raEof && offset + (rodsLong_t) done >= desc->raEofOffset)) {
+    status = read_ahead_read_through(path, descInx, buf + done, size - done, offset + done);
+    if (status < 0) {
+      if (done == 0) {
+	return status;
+      }
+    } else {
+      done += status;
+    }
+  }
+
+  desc->raNextOffset = offset + done;
+  if (desc->raSeqReads >= READ_AHEAD_SEQ_READS) {
+    read_ahead_start(desc, maxWindow);
+  }
+  return done;
+}
+
+/*
+ * Waits for any read-ahead in flight on descInx, then gives back its spare
+ * connection.  Called before the descriptor is closed.
+ */
+void stopReadAhead(int descInx) {
+  iFuseDesc_t *desc = &IFUSE_DESC(descInx);
+  int i;
+
+  pthread_mutex_lock(&desc->lock);
+  while (desc->raFilling) {
+    pthread_cond_wait(&desc->raCond, &desc->lock);
+  }
+  for (i = 0; i < MAX_BUF_CACHE; i++) {
+    desc->bufCache[i].state = BUF_CACHE_EMPTY;
+  }
+  read_ahead_drop_conn(desc);
+  pthread_mutex_unlock(&desc->lock);
+}